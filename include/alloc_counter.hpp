@@ -0,0 +1,50 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+// Counts the heap allocations of the whole program by replacing the global operator new and delete. Include in one
+// translation unit only. malloc() calls (stb_image, the GL driver) are not seen.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+struct AllocationCounter
+{
+  std::atomic<unsigned long> count{0};
+  std::atomic<unsigned long> bytes{0};
+};
+
+inline AllocationCounter heapAllocations;
+
+// noinline: once inlined, gcc sees new paired with free() and warns about mismatched deallocation
+__attribute__((noinline)) void *operator new(std::size_t size)
+{
+  heapAllocations.count.fetch_add(1, std::memory_order_relaxed);
+  heapAllocations.bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *pointer = std::malloc(size ? size : 1))
+    return pointer;
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  heapAllocations.count.fetch_add(1, std::memory_order_relaxed);
+  heapAllocations.bytes.fetch_add(size, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+
+__attribute__((noinline)) void operator delete(void *pointer) noexcept
+{
+  std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete(void *pointer, std::size_t) noexcept
+{
+  std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+  std::free(pointer);
+}
+#endif
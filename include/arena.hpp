@@ -0,0 +1,147 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+// Linear allocator: allocating bumps an offset into one block and Reset() frees everything at once. When the block
+// runs out, allocations spill into extra blocks and the next Reset() replaces them all with a single block as big as
+// the peak, so a workload that repeats (a frame, a mesh import) stops touching the heap after its first pass.
+// Alignments up to alignof(std::max_align_t) only. Not thread safe.
+class Arena
+{
+public:
+  explicit Arena(size_t capacity = 0) : capacity(capacity)
+  {
+    if (capacity > 0)
+      block.reset(new unsigned char[capacity]);
+  }
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+  {
+    size_t offset = (used + alignment - 1) & ~(alignment - 1);
+    if (offset + bytes <= capacity)
+    {
+      used = offset + bytes;
+      peak = std::max(peak, used + spilled);
+      return block.get() + offset;
+    }
+    spill.emplace_back(new unsigned char[bytes]);
+    spilled += bytes;
+    peak = std::max(peak, used + spilled);
+    return spill.back().get();
+  }
+
+  // storage for count default constructed objects, which are never destroyed
+  template <class T>
+  T *Allocate(size_t count)
+  {
+    static_assert(std::is_trivially_destructible<T>::value, "arena objects are not destroyed");
+    T *items = (T *)Allocate(count * sizeof(T), alignof(T));
+    for (size_t i = 0; i < count; i++)
+      new (&items[i]) T;
+    return items;
+  }
+
+  // frees every allocation. Nothing allocated from the arena may be used afterwards
+  void Reset()
+  {
+    if (!spill.empty())
+    {
+      capacity = peak;
+      block.reset(new unsigned char[capacity]);
+      spill.clear();
+      spilled = 0;
+    }
+    used = 0;
+  }
+
+  // bytes in use and the most ever used between two resets
+  size_t Used() const
+  {
+    return used + spilled;
+  }
+  size_t Peak() const
+  {
+    return peak;
+  }
+
+  // scratch arena of the calling thread, set by a ScratchScope, or null
+  static Arena *&Scratch()
+  {
+    thread_local Arena *scratch = nullptr;
+    return scratch;
+  }
+
+private:
+  unique_ptr<unsigned char[]> block;
+  size_t capacity;
+  size_t used = 0;
+  vector<unique_ptr<unsigned char[]>> spill;
+  size_t spilled = 0;
+  size_t peak = 0;
+};
+
+// makes an arena the calling thread's scratch arena while this is alive
+class ScratchScope
+{
+public:
+  ScratchScope(Arena &arena) : previous(Arena::Scratch())
+  {
+    Arena::Scratch() = &arena;
+  }
+  ~ScratchScope()
+  {
+    Arena::Scratch() = previous;
+  }
+
+private:
+  Arena *previous;
+};
+
+// STL allocator drawing from the scratch arena current when the container was created, or the heap outside of a
+// ScratchScope. Memory from the arena is only given back by Arena::Reset()
+template <class T>
+struct ScratchAllocator
+{
+  typedef T value_type;
+  Arena *arena;
+
+  ScratchAllocator() : arena(Arena::Scratch()) {}
+  template <class U>
+  ScratchAllocator(const ScratchAllocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t count)
+  {
+    if (arena)
+      return (T *)arena->Allocate(count * sizeof(T), alignof(T));
+    return (T *)::operator new(count * sizeof(T));
+  }
+  void deallocate(T *items, size_t)
+  {
+    if (!arena)
+      ::operator delete(items);
+  }
+
+  template <class U>
+  bool operator==(const ScratchAllocator<U> &other) const
+  {
+    return arena == other.arena;
+  }
+  template <class U>
+  bool operator!=(const ScratchAllocator<U> &other) const
+  {
+    return arena != other.arena;
+  }
+};
+
+template <class T>
+using ScratchVector = std::vector<T, ScratchAllocator<T>>;
+#endif
@@ -0,0 +1,220 @@
+#ifndef ASSET_MANAGER_H
+#define ASSET_MANAGER_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gpu_resources.hpp"
+#include "model.hpp"
+#include "occlusion.hpp"
+#include "profiler.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+// bytes of textures and buffers AssetManager::Update() creates per frame by default
+const long ASSET_UPLOAD_BUDGET = 8 * 1024 * 1024;
+
+// Streams models in while the scene renders. Request() returns at once; loader threads parse the file (or build the
+// sphere), optimize the meshes and decode the textures (Model::Import()), then Update() creates their GL objects on
+// the GL thread, a bounded number of bytes per frame. Until a model is ready Drawable() substitutes a grey placeholder
+// sphere, sized to the model's bounds once those are known. Models are shared: asking for the same file, or a sphere
+// of the same subdivisions and textures, again returns the same model.
+class AssetManager
+{
+public:
+  AssetManager(int threads = 2)
+  {
+    vector<glm::vec3> positions;
+    vector<unsigned int> indices;
+    OccluderProxy(positions, indices);
+    vector<Vertex> vertices(positions.size(), Vertex{});
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+      vertices[i].Position = positions[i];
+      vertices[i].Normal = positions[i];
+    }
+    GpuResourceOwner owner("placeholder");
+    const unsigned char grey[] = {128, 128, 128};
+    placeholderTexture = TextureFromPixels(grey, 1, 1, 3, "placeholder");
+    Texture texture;
+    texture.id = placeholderTexture.Id();
+    texture.type = "texture_diffuse";
+    texture.path = "placeholder";
+    vector<Mesh> meshes;
+    meshes.emplace_back(std::move(vertices), std::move(indices), vector<Texture>{texture}, false);
+    placeholder.reset(new Model("placeholder", std::move(meshes)));
+
+    for (int i = 0; i < threads; i++)
+      loaders.emplace_back(&AssetManager::loaderLoop, this);
+  }
+  AssetManager(const AssetManager &) = delete;
+  AssetManager &operator=(const AssetManager &) = delete;
+  // a model still being imported is finished first, its GL objects are freed with it
+  ~AssetManager()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    wake.notify_all();
+    for (std::thread &loader : loaders)
+      loader.join();
+  }
+
+  // a model to be streamed in, owned by the manager
+  Model *Request(const string &path)
+  {
+    return request(new Model(path, false, false));
+  }
+  // a procedural body, see Model's sphere constructor. The sphere is built on the loader threads too
+  Model *RequestSphere(unsigned int subdivisions, const string &texturePath)
+  {
+    return request(new Model(subdivisions, texturePath, false));
+  }
+  Model *RequestSphere(unsigned int subdivisions, const vector<Texture> &textures)
+  {
+    return request(new Model(subdivisions, textures, false));
+  }
+
+  // a model loaded before returning, like constructing it directly, owned by the manager
+  Model *Load(const string &path)
+  {
+    return load(new Model(path, false, false));
+  }
+  Model *LoadSphere(unsigned int subdivisions, const string &texturePath)
+  {
+    return load(new Model(subdivisions, texturePath, false));
+  }
+  Model *LoadSphere(unsigned int subdivisions, const vector<Texture> &textures)
+  {
+    return load(new Model(subdivisions, textures, false));
+  }
+
+  // GL thread, once per frame: uploads the models the loaders are done with, in request order, until budget bytes
+  // have been created. A texture or mesh is never split, so one bigger than the budget still takes a whole frame
+  void Update(long budget = ASSET_UPLOAD_BUDGET)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (Model *model : imported)
+      {
+        uploading.push_back(model);
+        bounded.insert(model);
+      }
+      imported.clear();
+    }
+    while (!uploading.empty() && budget > 0)
+      if (uploading.front()->Upload(budget))
+      {
+        uploading.pop_front();
+        loading--;
+      }
+      else if (uploading.front()->NeedsDecode())
+      {
+        // a texture was evicted from the cache since the import, back to the loaders to decode it
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          queue.push_back(uploading.front());
+        }
+        uploading.pop_front();
+        wake.notify_one();
+      }
+  }
+
+  // requested models not ready yet
+  unsigned int Loading() const
+  {
+    return loading;
+  }
+
+  // what to draw for model this frame: the model once ready, the placeholder otherwise, which doesn't occlude
+  OcclusionObject Drawable(Model *model, const glm::mat4 &transform, bool occluder) const
+  {
+    if (model->Ready())
+      return {model, transform, occluder};
+    glm::mat4 proxy = transform;
+    if (bounded.count(model))
+      proxy = glm::scale(glm::translate(transform, model->boundsCenter), glm::vec3(model->boundsRadius));
+    return {placeholder.get(), proxy, false};
+  }
+
+private:
+  vector<unique_ptr<Model>> models;
+  std::map<string, Model *> byPath;
+  unique_ptr<Model> placeholder;
+  TextureHandle placeholderTexture;
+  unsigned int loading = 0;
+  // imported models being uploaded, and every model imported so far (their bounds are valid)
+  std::deque<Model *> uploading;
+  std::unordered_set<const Model *> bounded;
+
+  vector<std::thread> loaders;
+  // guards queue, imported and stop
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Model *> queue;
+  vector<Model *> imported;
+  bool stop = false;
+
+  // takes over a model not imported yet, or returns the one already known by that path
+  Model *request(Model *created)
+  {
+    unique_ptr<Model> model(created);
+    Model *&known = byPath[model->path];
+    if (known)
+      return known;
+    known = models.emplace_back(std::move(model)).get();
+    loading++;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(known);
+    }
+    wake.notify_one();
+    return known;
+  }
+
+  Model *load(Model *created)
+  {
+    unique_ptr<Model> model(created);
+    Model *&known = byPath[model->path];
+    if (known)
+      return known;
+    model->ImportAndUpload();
+    known = models.emplace_back(std::move(model)).get();
+    return known;
+  }
+
+  void loaderLoop()
+  {
+    PROFILE_THREAD("loader");
+    for (;;)
+    {
+      Model *model;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]
+                  { return stop || !queue.empty(); });
+        if (stop)
+          return;
+        model = queue.front();
+        queue.pop_front();
+      }
+      if (model->NeedsDecode())
+        model->DecodeTextures();
+      else
+        model->Import();
+      std::lock_guard<std::mutex> lock(mutex);
+      imported.push_back(model);
+    }
+  }
+};
+#endif
@@ -0,0 +1,132 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+
+#include "gpu_timer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Drives the render loop through a list of configurations and times a fixed number of frames of each, on the CPU
+// (wall clock between frames) and on the GPU (timestamps around the frame, which leave GL_TIME_ELAPSED to the code being
+// measured). Queries are read back a few frames late so that timing doesn't serialize CPU and GPU. Run with LIBGL_ALWAYS_SOFTWARE=1 to measure Mesa's software GL.
+class Benchmark
+{
+public:
+  Benchmark(const string &name, const vector<string> &configs, int warmupFrames = 10, int measuredFrames = 100)
+      : name(name), configs(configs), warmupFrames(warmupFrames), measuredFrames(measuredFrames), results(configs.size())
+  {
+  }
+  Benchmark(const Benchmark &) = delete;
+  Benchmark &operator=(const Benchmark &) = delete;
+
+  // index of the configuration the coming frame must render
+  int Config() const
+  {
+    return config;
+  }
+  bool Done() const
+  {
+    return config >= (int)configs.size();
+  }
+  // true on the first frame of a configuration, to apply its settings
+  bool ConfigChanged() const
+  {
+    return frame == 0;
+  }
+  // true once the configuration's warm-up frames are done and its frames are timed
+  bool Measuring() const
+  {
+    return frame >= warmupFrames;
+  }
+
+  void BeginFrame()
+  {
+    timer.Begin([this](float milliseconds, int measuredConfig) { collect(milliseconds, measuredConfig); });
+  }
+
+  void EndFrame()
+  {
+    auto now = std::chrono::steady_clock::now();
+    bool measured = frame >= warmupFrames;
+    if (measured && frame > 0)
+      results[config].cpu.push_back(std::chrono::duration<float, std::milli>(now - lastFrame).count());
+    lastFrame = now;
+    // warm-up frames are timed too but dropped when read back
+    timer.End(measured ? config : -1);
+
+    if (++frame == warmupFrames + measuredFrames)
+    {
+      frame = 0;
+      config++;
+      if (Done())
+      {
+        timer.Flush([this](float milliseconds, int measuredConfig) { collect(milliseconds, measuredConfig); });
+        print();
+      }
+    }
+  }
+
+  // additional per configuration value to print along the timings, e.g. a cull rate
+  void SetNote(const string &note)
+  {
+    if (!Done())
+      results[config].note = note;
+  }
+
+private:
+  struct Result
+  {
+    vector<float> cpu, gpu;
+    string note;
+  };
+
+  string name;
+  vector<string> configs;
+  int warmupFrames, measuredFrames;
+  vector<Result> results;
+  int config = 0, frame = 0;
+  GpuTimer timer;
+  std::chrono::steady_clock::time_point lastFrame;
+
+  // GPU time of a frame of measuredConfig, -1 for a warm-up frame
+  void collect(float milliseconds, int measuredConfig)
+  {
+    if (measuredConfig >= 0)
+      results[measuredConfig].gpu.push_back(milliseconds);
+  }
+
+  static void summarize(vector<float> &samples, float &average, float &median, float &worst)
+  {
+    average = median = worst = 0.0f;
+    if (samples.empty())
+      return;
+    for (float s : samples)
+      average += s;
+    average /= samples.size();
+    std::sort(samples.begin(), samples.end());
+    median = samples[samples.size() / 2];
+    worst = samples.back();
+  }
+
+  void print()
+  {
+    printf("BENCHMARK:: %s (%d frames each)\n", name.c_str(), measuredFrames);
+    printf("%-28s %10s %10s %10s %10s %10s\n", "config", "gpu avg", "gpu med", "gpu max", "cpu avg", "cpu max");
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+      float gpuAvg, gpuMed, gpuMax, cpuAvg, cpuMed, cpuMax;
+      summarize(results[i].gpu, gpuAvg, gpuMed, gpuMax);
+      summarize(results[i].cpu, cpuAvg, cpuMed, cpuMax);
+      printf("%-28s %8.3fms %8.3fms %8.3fms %8.3fms %8.3fms %s\n", configs[i].c_str(), gpuAvg, gpuMed, gpuMax, cpuAvg, cpuMax,
+             results[i].note.c_str());
+    }
+    fflush(stdout);
+  }
+};
+#endif
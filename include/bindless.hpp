@@ -0,0 +1,109 @@
+#ifndef BINDLESS_H
+#define BINDLESS_H
+
+#include <glad/glad.h>
+
+#include "gpu_resources.hpp"
+#include "shader.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+// ARB_bindless_texture entry points. glad is generated for the core profile only, so Load() fetches them itself
+typedef GLuint64(APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void(APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void(APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+
+// shader storage binding of the handle buffer, after the three of the clustered shading
+const int TEXTURE_HANDLES_BINDING = 3;
+
+// Textures made resident with ARB_bindless_texture: Add() takes the 64-bit handle of each one, the handles go to a
+// shader storage buffer, and the shaders pick a texture by its index there, taken from the instance data like the
+// layer of a texture array (see planets.vs). Draws of any number of textures then need no binds at all and instances
+// with different textures share a draw. Needs the extension and GL 4.3 for the storage buffer, see Supported(); where
+// they're missing the texture arrays are drawn instead. A texture must outlive its handle here. GL thread only
+class BindlessTextures
+{
+public:
+  // drawing with forward shading and into the G-buffer of the deferred renderer
+  Shader ForwardShader;
+  Shader GeometryShader;
+
+  // fetches the extension's functions with glad's loader, once the context is current
+  static void Load(GLADloadproc load)
+  {
+    getTextureHandle = (PFNGLGETTEXTUREHANDLEARBPROC)load("glGetTextureHandleARB");
+    makeResident = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)load("glMakeTextureHandleResidentARB");
+    makeNonResident = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)load("glMakeTextureHandleNonResidentARB");
+    supported = false;
+    if (!GLAD_GL_VERSION_4_3 || !getTextureHandle || !makeResident || !makeNonResident)
+      return;
+    // the functions may resolve without the driver exposing the extension, only the extension list tells
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count && !supported; i++)
+      supported = strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_bindless_texture") == 0;
+  }
+
+  static bool Supported()
+  {
+    return supported;
+  }
+
+  BindlessTextures(const string &shaderDirectory)
+      : ForwardShader((shaderDirectory + "/planets.vs").c_str(), (shaderDirectory + "/planets_bindless.fs").c_str()),
+        GeometryShader((shaderDirectory + "/planets.vs").c_str(), (shaderDirectory + "/gbuffer_bindless.fs").c_str())
+  {
+  }
+  BindlessTextures(const BindlessTextures &) = delete;
+  BindlessTextures &operator=(const BindlessTextures &) = delete;
+  ~BindlessTextures()
+  {
+    for (GLuint64 handle : handles)
+      makeNonResident(handle);
+  }
+
+  // makes texture resident, returns its index for the shaders. Its parameters can't change afterwards
+  int Add(unsigned int texture)
+  {
+    GLuint64 handle = getTextureHandle(texture);
+    makeResident(handle);
+    handles.push_back(handle);
+    return (int)handles.size() - 1;
+  }
+
+  // uploads the handles added so far. name is the buffer's owner in the GPU resource registry
+  void Upload(const string &name)
+  {
+    GpuResourceOwner owner(name);
+    buffer = BufferHandle::Generate();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer.Id());
+    glBufferData(GL_SHADER_STORAGE_BUFFER, handles.size() * sizeof(GLuint64), handles.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    GpuResources::Instance().Register(GPU_BUFFER, buffer.Id(), handles.size() * sizeof(GLuint64),
+                                      std::to_string(handles.size()) + " texture handles");
+  }
+
+  // binds the handle buffer for the next draws with ForwardShader or GeometryShader
+  void Bind() const
+  {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TEXTURE_HANDLES_BINDING, buffer.Id());
+  }
+
+  unsigned int Count() const
+  {
+    return handles.size();
+  }
+
+private:
+  static inline PFNGLGETTEXTUREHANDLEARBPROC getTextureHandle = nullptr;
+  static inline PFNGLMAKETEXTUREHANDLERESIDENTARBPROC makeResident = nullptr;
+  static inline PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC makeNonResident = nullptr;
+  static inline bool supported = false;
+
+  vector<GLuint64> handles;
+  BufferHandle buffer;
+};
+#endif
@@ -0,0 +1,166 @@
+#ifndef CLUSTERED_H
+#define CLUSTERED_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "lights.hpp"
+#include "profiler.hpp"
+#include "shader.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+using namespace std;
+
+// cluster grid: screen tiles times exponential depth slices
+const unsigned int CLUSTERS_X = 16;
+const unsigned int CLUSTERS_Y = 9;
+const unsigned int CLUSTERS_Z = 24;
+const unsigned int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+// initial capacity of the global light index list, in average lights per cluster. It grows when a frame wants more
+const unsigned int CLUSTER_INDEX_BUDGET = 128;
+// lights a cluster's list holds at most, the size of the cull shader's shared list (MAX_CLUSTER_LIGHTS in
+// cluster_cull.cs). Lights past it are dropped and counted in DroppedLights()
+const unsigned int CLUSTER_MAX_LIGHTS = 512;
+
+// Clustered forward shading. Every frame a compute pass bins the lights of a LightSet into view space clusters and
+// writes compact per cluster index lists, then geometry is drawn with PlanetShader, which only loops over the lights of
+// the fragment's cluster. Needs GL 4.3 (compute shaders and shader storage buffers), see Supported(). The pass counts
+// the indices it wanted and the lights it had to leave out, read back a few frames late: the index list grows to fit,
+// and what's still dropped (clusters with more than CLUSTER_MAX_LIGHTS lights) is reported by DroppedLights().
+class ClusteredLighting
+{
+public:
+  Shader PlanetShader;
+  Shader CullShader;
+
+  static bool Supported()
+  {
+    return GLAD_GL_VERSION_4_3;
+  }
+
+  ClusteredLighting(const string &shaderDirectory)
+      : PlanetShader((shaderDirectory + "/planets.vs").c_str(), (shaderDirectory + "/planets_clustered.fs").c_str()),
+        CullShader((shaderDirectory + "/cluster_cull.cs").c_str())
+  {
+    glGenBuffers(1, &gridBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * 2 * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+    glGenBuffers(1, &indexBuffer);
+    allocateIndices(CLUSTER_COUNT * CLUSTER_INDEX_BUDGET);
+    glGenBuffers(1, &readbackBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, COUNTERS * sizeof(unsigned int), NULL, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+  ClusteredLighting(const ClusteredLighting &) = delete;
+  ClusteredLighting &operator=(const ClusteredLighting &) = delete;
+  ~ClusteredLighting()
+  {
+    glDeleteBuffers(1, &gridBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    glDeleteBuffers(1, &readbackBuffer);
+    if (fence)
+      glDeleteSync(fence);
+  }
+
+  // light entries the last read back pass left out of full cluster lists, 0 when every light was shaded
+  unsigned int DroppedLights() const
+  {
+    return droppedLights;
+  }
+
+  // bins the lights for this frame's camera and leaves PlanetShader bound with everything it needs except the model
+  // transforms. zNear/zFar must match the projection
+  void CullLights(const glm::mat4 &view, const glm::mat4 &projection, float zNear, float zFar, int width, int height,
+                  const glm::vec3 &viewPos, const glm::vec3 &lightPos, const glm::vec3 &lightColor, const LightSet &lights)
+  {
+    PROFILE_GPU_ZONE("cluster light culling");
+    collect();
+    const unsigned int zero[COUNTERS] = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, lights.Buffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gridBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indexBuffer);
+
+    CullShader.use();
+    CullShader.setMat4("view", view);
+    CullShader.setMat4("invProjection", glm::inverse(projection));
+    glUniform3ui(glGetUniformLocation(CullShader.ID, "gridSize"), CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+    glUniform1ui(glGetUniformLocation(CullShader.ID, "maxIndices"), indexCapacity);
+    CullShader.setFloat("zNear", zNear);
+    CullShader.setFloat("zFar", zFar);
+    CullShader.setInt("numLights", (int)lights.lights.size());
+    glDispatchCompute(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+    // the fragment shader reads the lists, the readback the counters
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    // asynchronous readback of the counters, unless the last one is still in flight
+    if (!fence)
+    {
+      glBindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, COUNTERS * sizeof(unsigned int));
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    frameStats.lightsDropped += droppedLights;
+
+    PlanetShader.use();
+    PlanetShader.setMat4("view", view);
+    PlanetShader.setMat4("projection", projection);
+    PlanetShader.setVec3("viewPos", viewPos);
+    PlanetShader.setVec3("lightPos", lightPos);
+    PlanetShader.setVec3("lightColor", lightColor);
+    glUniform3ui(glGetUniformLocation(PlanetShader.ID, "gridSize"), CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+    PlanetShader.setVec2("screenSize", (float)width, (float)height);
+    PlanetShader.setFloat("zNear", zNear);
+    PlanetShader.setFloat("zFar", zFar);
+  }
+
+private:
+  // index count and dropped lights ahead of the index list
+  static const int COUNTERS = 2;
+  unsigned int gridBuffer, indexBuffer, readbackBuffer;
+  unsigned int indexCapacity = 0;
+  unsigned int droppedLights = 0;
+  GLsync fence = 0;
+
+  void allocateIndices(unsigned int capacity)
+  {
+    indexCapacity = capacity;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+    // counters followed by the index list
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (COUNTERS + (size_t)capacity) * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+
+  // the counters of an earlier pass if the GPU is done with them: grows the index list to what that pass wanted
+  void collect()
+  {
+    if (!fence || glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+      return;
+    glDeleteSync(fence);
+    fence = 0;
+    unsigned int counters[COUNTERS] = {};
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+    glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(counters), counters);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    droppedLights = counters[1];
+    if (counters[0] > indexCapacity)
+    {
+      // a quarter more than asked for, so that a few more lights don't reallocate again
+      unsigned int capacity = std::min(counters[0] + counters[0] / 4, CLUSTER_COUNT * CLUSTER_MAX_LIGHTS);
+      std::cout << "CLUSTERED:: light index list grown to " << capacity << " indices" << std::endl;
+      allocateIndices(capacity);
+    }
+  }
+};
+#endif
@@ -0,0 +1,284 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "lights.hpp"
+#include "profiler.hpp"
+#include "shader.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// screen tile size in pixels for light assignment
+const int LIGHT_TILE_SIZE = 16;
+// texture units of the G-buffer and tile lists in the lighting pass (the light buffer uses LIGHT_BUFFER_UNIT)
+const int GBUFFER_ALBEDO_UNIT = 0;
+const int GBUFFER_NORMAL_UNIT = 1;
+const int GBUFFER_DEPTH_UNIT = 2;
+const int GBUFFER_SPECULAR_UNIT = 3;
+const int TILE_LIGHTS_UNIT = 9;
+const int LIGHT_INDICES_UNIT = 10;
+
+// Deferred renderer for many point lights. Opaque geometry is drawn once with GeometryShader into a G-buffer
+// (albedo RGBA8, octahedral packed normal RG16F, specular strength and exponent RG8, depth), then one fullscreen pass
+// shades every pixel with the Sun and the point lights of its screen tile. Lights are assigned to 16x16 tiles on the
+// CPU by projecting their bounding spheres, so the per pixel cost depends on the local light density instead of the
+// total light count.
+class DeferredRenderer
+{
+public:
+  Shader GeometryShader;
+  Shader LightingShader;
+
+  DeferredRenderer(const string &shaderDirectory)
+      : GeometryShader((shaderDirectory + "/planets.vs").c_str(), (shaderDirectory + "/gbuffer.fs").c_str()),
+        LightingShader((shaderDirectory + "/fullscreen.vs").c_str(), (shaderDirectory + "/deferred.fs").c_str())
+  {
+    glGenFramebuffers(1, &gBuffer);
+    glGenTextures(1, &albedo);
+    glGenTextures(1, &normal);
+    glGenTextures(1, &specular);
+    glGenTextures(1, &depth);
+    // the fullscreen triangle has no attributes, but core profile still wants a VAO bound
+    glGenVertexArrays(1, &emptyVAO);
+
+    glGenBuffers(1, &tileBuffer);
+    glGenTextures(1, &tileTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, tileBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, 2 * sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, tileTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, tileBuffer);
+
+    glGenBuffers(1, &indexBuffer);
+    glGenTextures(1, &indexTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+  DeferredRenderer(const DeferredRenderer &) = delete;
+  DeferredRenderer &operator=(const DeferredRenderer &) = delete;
+  ~DeferredRenderer()
+  {
+    glDeleteFramebuffers(1, &gBuffer);
+    unsigned int textures[] = {albedo, normal, specular, depth, tileTexture, indexTexture};
+    glDeleteTextures(6, textures);
+    unsigned int buffers[] = {tileBuffer, indexBuffer};
+    glDeleteBuffers(2, buffers);
+    glDeleteVertexArrays(1, &emptyVAO);
+  }
+
+  // (re)allocates the G-buffer when the framebuffer size changed
+  void Resize(int newWidth, int newHeight)
+  {
+    if (newWidth == width && newHeight == height)
+      return;
+    width = newWidth;
+    height = newHeight;
+    tilesX = (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    tilesY = (height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+
+    allocateTarget(albedo, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    allocateTarget(normal, GL_RG16F, GL_RG, GL_FLOAT);
+    allocateTarget(specular, GL_RG8, GL_RG, GL_UNSIGNED_BYTE);
+    // depth/stencil so that it can be blitted into the default framebuffer afterwards
+    allocateTarget(depth, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, specular, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+    GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    glDrawBuffers(3, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      cout << "ERROR::DEFERRED:: G-buffer is not complete" << endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  // binds and clears the G-buffer. Draw opaque geometry with GeometryShader until LightingPass()
+  void BeginGeometryPass()
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+    glViewport(0, 0, width, height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GeometryShader.use();
+  }
+
+  // shades the G-buffer into target (which must have been cleared), then copies the G-buffer depth into it so that
+  // forward rendered geometry, like the emissive Sun, can be drawn on top with correct occlusion
+  void LightingPass(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos,
+                    const glm::vec3 &lightPos, const glm::vec3 &lightColor, LightSet &lights, unsigned int target = 0)
+  {
+    PROFILE_ZONE("deferred lighting");
+    PROFILE_GPU_ZONE("deferred lighting");
+    assignLights(view, projection, lights);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glViewport(0, 0, width, height);
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+
+    LightingShader.use();
+    LightingShader.setMat4("invViewProjection", glm::inverse(projection * view));
+    LightingShader.setVec3("lightPos", lightPos);
+    LightingShader.setVec3("lightColor", lightColor);
+    LightingShader.setVec3("viewPos", viewPos);
+    LightingShader.setInt("tileSize", LIGHT_TILE_SIZE);
+    LightingShader.setInt("tilesX", tilesX);
+    LightingShader.setInt("gAlbedo", GBUFFER_ALBEDO_UNIT);
+    LightingShader.setInt("gNormal", GBUFFER_NORMAL_UNIT);
+    LightingShader.setInt("gSpecular", GBUFFER_SPECULAR_UNIT);
+    LightingShader.setInt("gDepth", GBUFFER_DEPTH_UNIT);
+    LightingShader.setInt("pointLights", LIGHT_BUFFER_UNIT);
+    LightingShader.setInt("tileLights", TILE_LIGHTS_UNIT);
+    LightingShader.setInt("lightIndices", LIGHT_INDICES_UNIT);
+
+    glActiveTexture(GL_TEXTURE0 + GBUFFER_ALBEDO_UNIT);
+    glBindTexture(GL_TEXTURE_2D, albedo);
+    glActiveTexture(GL_TEXTURE0 + GBUFFER_NORMAL_UNIT);
+    glBindTexture(GL_TEXTURE_2D, normal);
+    glActiveTexture(GL_TEXTURE0 + GBUFFER_SPECULAR_UNIT);
+    glBindTexture(GL_TEXTURE_2D, specular);
+    glActiveTexture(GL_TEXTURE0 + GBUFFER_DEPTH_UNIT);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glActiveTexture(GL_TEXTURE0 + TILE_LIGHTS_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, tileTexture);
+    glActiveTexture(GL_TEXTURE0 + LIGHT_INDICES_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+    glActiveTexture(GL_TEXTURE0);
+    lights.Bind();
+
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glDepthMask(GL_TRUE);
+    glEnable(GL_DEPTH_TEST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+  }
+
+  // average number of lights per tile in the last frame
+  float AverageLightsPerTile() const
+  {
+    return tileCount() > 0 ? float(indices.size()) / tileCount() : 0.0f;
+  }
+
+private:
+  unsigned int gBuffer, albedo, normal, specular, depth, emptyVAO;
+  unsigned int tileBuffer, tileTexture, indexBuffer, indexTexture;
+  int width = 0, height = 0, tilesX = 0, tilesY = 0;
+  // per tile offset/count pairs and the concatenated light index lists, rebuilt every frame
+  vector<unsigned int> tiles, indices, tileFill;
+  vector<glm::ivec4> lightRects;
+
+  int tileCount() const
+  {
+    return tilesX * tilesY;
+  }
+
+  void allocateTarget(unsigned int texture, GLint internalFormat, GLenum format, GLenum type)
+  {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  // conservative screen rect (in tiles) of a light's sphere of influence: the projected corners of its view space
+  // bounding box. Returns false if the light is entirely behind the camera
+  bool lightTileRect(const PointLight &light, const glm::mat4 &view, const glm::mat4 &projection, glm::ivec4 &rect) const
+  {
+    glm::vec3 center = glm::vec3(view * glm::vec4(light.Position, 1.0f));
+    float r = light.Radius;
+    // near plane distance from the projection matrix
+    float zNear = projection[3][2] / (projection[2][2] - 1.0f);
+    if (center.z - r > -zNear)
+      return false;
+    if (center.z + r > -zNear)
+    {
+      // the sphere crosses the near plane, the projected box is unbounded
+      rect = glm::ivec4(0, 0, tilesX - 1, tilesY - 1);
+      return true;
+    }
+    float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+    for (int corner = 0; corner < 8; corner++)
+    {
+      glm::vec3 p = center + glm::vec3(corner & 1 ? r : -r, corner & 2 ? r : -r, corner & 4 ? r : -r);
+      glm::vec4 clip = projection * glm::vec4(p, 1.0f);
+      minX = std::min(minX, clip.x / clip.w);
+      maxX = std::max(maxX, clip.x / clip.w);
+      minY = std::min(minY, clip.y / clip.w);
+      maxY = std::max(maxY, clip.y / clip.w);
+    }
+    if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+      return false;
+    auto toTile = [](float ndc, int pixels)
+    { return int((glm::clamp(ndc, -1.0f, 1.0f) * 0.5f + 0.5f) * pixels) / LIGHT_TILE_SIZE; };
+    rect = glm::ivec4(toTile(minX, width), toTile(minY, height),
+                      std::min(toTile(maxX, width), tilesX - 1), std::min(toTile(maxY, height), tilesY - 1));
+    return true;
+  }
+
+  // builds the per tile light lists (counting sort: count, prefix sum, fill) and uploads them
+  void assignLights(const glm::mat4 &view, const glm::mat4 &projection, const LightSet &lights)
+  {
+    tiles.assign(tileCount() * 2, 0);
+    lightRects.resize(lights.lights.size());
+    for (size_t l = 0; l < lights.lights.size(); l++)
+    {
+      if (!lightTileRect(lights.lights[l], view, projection, lightRects[l]))
+      {
+        lightRects[l] = glm::ivec4(0, 0, -1, -1); // empty rect
+        continue;
+      }
+      const glm::ivec4 &rect = lightRects[l];
+      for (int y = rect.y; y <= rect.w; y++)
+        for (int x = rect.x; x <= rect.z; x++)
+          tiles[(y * tilesX + x) * 2 + 1]++;
+    }
+    unsigned int offset = 0;
+    for (int t = 0; t < tileCount(); t++)
+    {
+      tiles[t * 2] = offset;
+      offset += tiles[t * 2 + 1];
+    }
+    indices.resize(offset);
+    tileFill.assign(tileCount(), 0);
+    for (size_t l = 0; l < lights.lights.size(); l++)
+    {
+      const glm::ivec4 &rect = lightRects[l];
+      for (int y = rect.y; y <= rect.w; y++)
+        for (int x = rect.x; x <= rect.z; x++)
+        {
+          int t = y * tilesX + x;
+          indices[tiles[t * 2] + tileFill[t]++] = l;
+        }
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, tileBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, tiles.size() * sizeof(unsigned int), &tiles[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(indices.size(), 1) * sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+    if (!indices.empty())
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, indices.size() * sizeof(unsigned int), &indices[0]);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+};
+#endif
@@ -0,0 +1,150 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <glad/glad.h>
+
+#include "gpu_timer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+using namespace std;
+
+// dynamic resolution: smallest scale of the window's size, scale steps, share of the frame time the GPU should take,
+// and below which share it may take more again
+const float PACER_MIN_SCALE = 0.5f;
+const float PACER_SCALE_STEP = 0.05f;
+const float PACER_GPU_BUDGET = 0.85f;
+const float PACER_UPSCALE_BELOW = 0.65f;
+// the OS wakes a sleeping thread late by up to about this much, the rest of the wait is spun
+const float PACER_SPIN_MILLISECONDS = 2.0f;
+// a GPU time within this factor of the CPU's time to submit the frame is the GPU waiting on the CPU
+const float PACER_CPU_BOUND = 1.1f;
+
+// Frame pacing: Wait() before the swap holds each frame back until its slot, one target frame time after the previous
+// one, sleeping most of the way and spinning the rest, so that frames come out at even intervals instead of as fast as
+// they're made. A frame that misses its slot by more than a frame time resets the schedule rather than rushing the
+// next ones to catch up. With dynamic resolution the scene is rendered at Scale() of the window's size, set from the
+// GPU time of the frames (a GL_TIME_ELAPSED query, read back a few frames late): as the GPU time goes over the budget
+// the scale drops to fit, since it's about proportional to the pixel count, and when it's well under the scale grows a
+// step. A frame the CPU takes about as long to submit is CPU bound, its GPU time is mostly waiting for commands and
+// fewer pixels wouldn't help, so the scale isn't dropped for it. Scales are quantized and held until frames at the new
+// scale are measured, so the targets are rarely reallocated. GL thread only.
+class FramePacer
+{
+public:
+  FramePacer() : timer(GL_TIME_ELAPSED) {}
+  FramePacer(const FramePacer &) = delete;
+  FramePacer &operator=(const FramePacer &) = delete;
+
+  // paces frames to milliseconds each, 0 for no pacing, and scales the resolution with dynamicResolution. Starts over
+  // at full resolution
+  void SetTarget(float milliseconds, bool dynamicResolution)
+  {
+    target = milliseconds;
+    dynamic = dynamicResolution;
+    scale = 1.0f;
+    gpuMilliseconds = cpuMilliseconds = 0.0f;
+    framesAtScale = 0;
+    next = std::chrono::steady_clock::time_point();
+    timer.Reset();
+  }
+
+  bool Active() const
+  {
+    return target > 0.0f;
+  }
+  bool DynamicResolution() const
+  {
+    return Active() && dynamic;
+  }
+  // of the window's size, to render the scene at
+  float Scale() const
+  {
+    return DynamicResolution() ? scale : 1.0f;
+  }
+  // GPU and CPU time of a frame, smoothed over the last few
+  float GpuMilliseconds() const
+  {
+    return gpuMilliseconds;
+  }
+  float CpuMilliseconds() const
+  {
+    return cpuMilliseconds;
+  }
+
+  // before the frame's first GL command
+  void BeginFrame()
+  {
+    if (!DynamicResolution())
+      return;
+    timer.Begin([this](float milliseconds, int cpuMicroseconds) { collect(milliseconds, cpuMicroseconds / 1000.0f); });
+    frameStart = std::chrono::steady_clock::now();
+  }
+
+  // after the frame's last GL command before the swap
+  void EndFrame()
+  {
+    if (!DynamicResolution())
+      return;
+    // the CPU time travels with the frame's query, to compare with its GPU time
+    float cpu = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+    timer.End((int)(cpu * 1000.0f));
+  }
+
+  // holds the frame back until its slot, before the swap
+  void Wait()
+  {
+    if (!Active())
+      return;
+    using clock = std::chrono::steady_clock;
+    clock::duration frameTime = std::chrono::duration_cast<clock::duration>(std::chrono::duration<float, std::milli>(target));
+    clock::time_point now = clock::now();
+    if (next == clock::time_point() || now > next + frameTime)
+      next = now;
+    else
+    {
+      clock::time_point wake = next - std::chrono::duration_cast<clock::duration>(std::chrono::duration<float, std::milli>(PACER_SPIN_MILLISECONDS));
+      if (now < wake)
+        std::this_thread::sleep_until(wake);
+      while (clock::now() < next)
+        ;
+    }
+    next += frameTime;
+  }
+
+private:
+  float target = 0.0f;
+  bool dynamic = true;
+  float scale = 1.0f;
+  float gpuMilliseconds = 0.0f, cpuMilliseconds = 0.0f;
+  int framesAtScale = 0;
+  std::chrono::steady_clock::time_point next, frameStart;
+  GpuTimer timer;
+
+  // GPU and CPU time of a frame read back
+  void collect(float gpu, float cpu)
+  {
+    // the frames in flight when the scale changed were rendered at the old one
+    if (++framesAtScale <= GPU_TIMER_LATENCY)
+      return;
+    bool first = framesAtScale == GPU_TIMER_LATENCY + 1;
+    gpuMilliseconds = first ? gpu : 0.8f * gpuMilliseconds + 0.2f * gpu;
+    cpuMilliseconds = first ? cpu : 0.8f * cpuMilliseconds + 0.2f * cpu;
+    if (framesAtScale < 2 * GPU_TIMER_LATENCY)
+      return;
+    float budget = PACER_GPU_BUDGET * target;
+    float wanted = std::floor(scale * std::sqrt(budget / std::max(gpuMilliseconds, 1e-3f)) / PACER_SCALE_STEP + 1e-3f) * PACER_SCALE_STEP;
+    wanted = std::clamp(wanted, PACER_MIN_SCALE, 1.0f);
+    bool cpuBound = gpuMilliseconds < PACER_CPU_BOUND * cpuMilliseconds;
+    if (wanted < scale - 0.5f * PACER_SCALE_STEP && !cpuBound)
+      scale = wanted;
+    else if (gpuMilliseconds < PACER_UPSCALE_BELOW * target && scale < 1.0f)
+      scale = std::min(1.0f, scale + PACER_SCALE_STEP);
+    else
+      return;
+    framesAtScale = 0;
+  }
+};
+#endif
@@ -0,0 +1,219 @@
+#ifndef GPU_RESOURCES_H
+#define GPU_RESOURCES_H
+
+#include <glad/glad.h>
+
+#include "stats.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+enum GpuResourceKind
+{
+  GPU_TEXTURE,
+  GPU_BUFFER,
+  GPU_VERTEX_ARRAY,
+  GPU_RENDERBUFFER // counted with the textures
+};
+
+struct GpuAllocation
+{
+  GpuResourceKind kind;
+  unsigned int id;
+  unsigned long bytes;
+  string format; // e.g. "RGB8 1024x512 +mips", "vertices"
+  string owner;
+};
+
+// Registry of the GL objects allocated for assets: what they are, how big and who owns them. Allocations are recorded
+// against the owner of the enclosing GpuResourceOwner scope (the Model being loaded) and are freed by the GpuHandle
+// holding them. Keeps resourceStats up to date, prints per asset breakdowns and reports what is still allocated at exit.
+class GpuResources
+{
+public:
+  static GpuResources &Instance()
+  {
+    static GpuResources resources;
+    return resources;
+  }
+
+  void Register(GpuResourceKind kind, unsigned int id, unsigned long bytes, const string &format)
+  {
+    GpuAllocation &allocation = allocations[key(kind, id)];
+    allocation = {kind, id, bytes, format, currentOwner};
+    account(allocation, 1);
+  }
+
+  // deletes the GL object, registered or not
+  void Release(GpuResourceKind kind, unsigned int id)
+  {
+    auto found = allocations.find(key(kind, id));
+    if (found != allocations.end())
+    {
+      account(found->second, -1);
+      allocations.erase(found);
+    }
+    if (kind == GPU_TEXTURE)
+      glDeleteTextures(1, &id);
+    else if (kind == GPU_BUFFER)
+      glDeleteBuffers(1, &id);
+    else if (kind == GPU_RENDERBUFFER)
+      glDeleteRenderbuffers(1, &id);
+    else
+      glDeleteVertexArrays(1, &id);
+  }
+
+  // bytes per owner and kind
+  void PrintBreakdown() const
+  {
+    struct Totals
+    {
+      unsigned int count[4] = {};
+      unsigned long bytes[4] = {};
+    };
+    std::map<string, Totals> owners;
+    for (const auto &entry : allocations)
+    {
+      Totals &totals = owners[entry.second.owner];
+      totals.count[entry.second.kind]++;
+      totals.bytes[entry.second.kind] += entry.second.bytes;
+    }
+    printf("GPU_RESOURCES:: %-40s %18s %18s %6s\n", "asset", "textures", "buffers", "VAOs");
+    for (const auto &owner : owners)
+      printf("GPU_RESOURCES:: %-40s %3u %11.2f MB %3u %11.2f MB %6u\n", owner.first.c_str(),
+             owner.second.count[GPU_TEXTURE] + owner.second.count[GPU_RENDERBUFFER],
+             (owner.second.bytes[GPU_TEXTURE] + owner.second.bytes[GPU_RENDERBUFFER]) / 1048576.0, owner.second.count[GPU_BUFFER],
+             owner.second.bytes[GPU_BUFFER] / 1048576.0, owner.second.count[GPU_VERTEX_ARRAY]);
+    printf("GPU_RESOURCES:: total %.2f MB of textures, %.2f MB of buffers\n", resourceStats.textureBytes / 1048576.0,
+           resourceStats.meshBytes / 1048576.0);
+    fflush(stdout);
+  }
+
+  // lists what hasn't been released, returns the number of objects
+  size_t ReportLeaks() const
+  {
+    for (const auto &entry : allocations)
+      printf("GPU_RESOURCES::LEAK:: %s %u (%s, %lu bytes) owned by %s\n", kindName(entry.second.kind), entry.second.id,
+             entry.second.format.c_str(), entry.second.bytes, entry.second.owner.c_str());
+    if (!allocations.empty())
+      printf("GPU_RESOURCES::LEAK:: %zu objects still allocated\n", allocations.size());
+    fflush(stdout);
+    return allocations.size();
+  }
+
+private:
+  friend class GpuResourceOwner;
+
+  std::unordered_map<uint64_t, GpuAllocation> allocations;
+  string currentOwner = "(none)";
+
+  GpuResources() {}
+
+  static uint64_t key(GpuResourceKind kind, unsigned int id)
+  {
+    return (uint64_t)kind << 32 | id;
+  }
+
+  static const char *kindName(GpuResourceKind kind)
+  {
+    return kind == GPU_TEXTURE ? "texture" : kind == GPU_BUFFER ? "buffer" : kind == GPU_RENDERBUFFER ? "renderbuffer" : "vertex array";
+  }
+
+  static void account(const GpuAllocation &allocation, int sign)
+  {
+    if (allocation.kind == GPU_TEXTURE || allocation.kind == GPU_RENDERBUFFER)
+    {
+      resourceStats.textures += sign;
+      resourceStats.textureBytes += sign * (long)allocation.bytes;
+    }
+    else if (allocation.kind == GPU_BUFFER)
+      resourceStats.meshBytes += sign * (long)allocation.bytes;
+  }
+};
+
+// allocations registered while this is alive belong to owner
+class GpuResourceOwner
+{
+public:
+  GpuResourceOwner(const string &owner) : previous(GpuResources::Instance().currentOwner)
+  {
+    GpuResources::Instance().currentOwner = owner;
+  }
+  ~GpuResourceOwner()
+  {
+    GpuResources::Instance().currentOwner = previous;
+  }
+
+private:
+  string previous;
+};
+
+// Sole owner of a GL object name: can be moved but not copied, releases the object when destroyed
+template <GpuResourceKind Kind>
+class GpuHandle
+{
+public:
+  GpuHandle() {}
+  explicit GpuHandle(unsigned int id) : id(id) {}
+  GpuHandle(GpuHandle &&other) noexcept : id(other.id)
+  {
+    other.id = 0;
+  }
+  GpuHandle &operator=(GpuHandle &&other) noexcept
+  {
+    if (this != &other)
+    {
+      Reset();
+      id = other.id;
+      other.id = 0;
+    }
+    return *this;
+  }
+  GpuHandle(const GpuHandle &) = delete;
+  GpuHandle &operator=(const GpuHandle &) = delete;
+  ~GpuHandle()
+  {
+    Reset();
+  }
+
+  // a new object name, registered once its storage is allocated
+  static GpuHandle Generate()
+  {
+    unsigned int id = 0;
+    if (Kind == GPU_TEXTURE)
+      glGenTextures(1, &id);
+    else if (Kind == GPU_BUFFER)
+      glGenBuffers(1, &id);
+    else if (Kind == GPU_RENDERBUFFER)
+      glGenRenderbuffers(1, &id);
+    else
+      glGenVertexArrays(1, &id);
+    return GpuHandle(id);
+  }
+
+  unsigned int Id() const
+  {
+    return id;
+  }
+
+  void Reset()
+  {
+    if (id != 0)
+      GpuResources::Instance().Release(Kind, id);
+    id = 0;
+  }
+
+private:
+  unsigned int id = 0;
+};
+
+typedef GpuHandle<GPU_TEXTURE> TextureHandle;
+typedef GpuHandle<GPU_BUFFER> BufferHandle;
+typedef GpuHandle<GPU_VERTEX_ARRAY> VertexArrayHandle;
+typedef GpuHandle<GPU_RENDERBUFFER> RenderbufferHandle;
+#endif
@@ -0,0 +1,98 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+using namespace std;
+
+// spans a query waits before it's read, long enough for it to be available without stalling
+const int GPU_TIMER_LATENCY = 4;
+
+// Times spans of GL commands on the GPU without stalling: each span's queries are read back GPU_TIMER_LATENCY spans
+// later, when the GPU has long finished them. A span is either a pair of GL_TIMESTAMP queries, which nest in anything,
+// or one GL_TIME_ELAPSED query, of which only one may be running at a time (the frame pacer's, see frame_pacer.hpp).
+// Each span carries a tag (e.g. the configuration it belongs to) handed back with its time. GL thread only.
+class GpuTimer
+{
+public:
+  GpuTimer(GLenum target = GL_TIMESTAMP) : target(target)
+  {
+    glGenQueries(2 * GPU_TIMER_LATENCY, queries);
+  }
+  GpuTimer(const GpuTimer &) = delete;
+  GpuTimer &operator=(const GpuTimer &) = delete;
+  ~GpuTimer()
+  {
+    glDeleteQueries(2 * GPU_TIMER_LATENCY, queries);
+  }
+
+  // starts a span. The span last started in the same slot has had GPU_TIMER_LATENCY - 1 spans to finish, it's read
+  // back first and handed to done(milliseconds, tag)
+  template <typename Done>
+  void Begin(Done &&done)
+  {
+    int slot = spans % GPU_TIMER_LATENCY;
+    if (pending[slot])
+      collect(slot, done);
+    if (target == GL_TIMESTAMP)
+      glQueryCounter(queries[2 * slot], GL_TIMESTAMP);
+    else
+      glBeginQuery(target, queries[2 * slot]);
+  }
+
+  void End(int tag = 0)
+  {
+    int slot = spans % GPU_TIMER_LATENCY;
+    if (target == GL_TIMESTAMP)
+      glQueryCounter(queries[2 * slot + 1], GL_TIMESTAMP);
+    else
+      glEndQuery(target);
+    tags[slot] = tag;
+    pending[slot] = true;
+    spans++;
+  }
+
+  // reads back every span in flight, oldest first, waiting for the GPU
+  template <typename Done>
+  void Flush(Done &&done)
+  {
+    for (int i = 0; i < GPU_TIMER_LATENCY; i++)
+    {
+      int slot = (spans + i) % GPU_TIMER_LATENCY;
+      if (pending[slot])
+        collect(slot, done);
+    }
+  }
+
+  // forgets the spans in flight, for a new measurement
+  void Reset()
+  {
+    for (bool &slot : pending)
+      slot = false;
+  }
+
+private:
+  GLenum target;
+  unsigned int queries[2 * GPU_TIMER_LATENCY];
+  int tags[GPU_TIMER_LATENCY] = {};
+  bool pending[GPU_TIMER_LATENCY] = {};
+  long spans = 0;
+
+  template <typename Done>
+  void collect(int slot, Done &done)
+  {
+    GLuint64 ns = 0;
+    if (target == GL_TIMESTAMP)
+    {
+      GLuint64 start = 0;
+      glGetQueryObjectui64v(queries[2 * slot], GL_QUERY_RESULT, &start);
+      glGetQueryObjectui64v(queries[2 * slot + 1], GL_QUERY_RESULT, &ns);
+      ns -= start;
+    }
+    else
+      glGetQueryObjectui64v(queries[2 * slot], GL_QUERY_RESULT, &ns);
+    pending[slot] = false;
+    done(ns / 1.0e6f, tags[slot]);
+  }
+};
+#endif
@@ -0,0 +1,288 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <glad/glad.h>
+
+#include "shader.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+// frames kept in the frame time graph
+const int HUD_HISTORY = 120;
+// most quads drawn in a frame, text and graph bars
+const int HUD_MAX_QUADS = 4096;
+// screen pixels per font texel
+const int HUD_SCALE = 2;
+// seconds between refreshes of the averaged counters, so that they stay readable
+const float HUD_REFRESH = 0.25f;
+
+// 5x7 bitmap font for ASCII 32 to 95 (lowercase is drawn as uppercase), one byte per row, bit 4 is the leftmost pixel
+const unsigned char HUD_FONT[64][7] = {
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // ' '
+  {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04}, // '!'
+  {0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00}, // '"'
+  {0x0a, 0x1f, 0x0a, 0x0a, 0x0a, 0x1f, 0x0a}, // '#'
+  {0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04}, // '$'
+  {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // '%'
+  {0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d}, // '&'
+  {0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00}, // '''
+  {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, // '('
+  {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // ')'
+  {0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00}, // '*'
+  {0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00}, // '+'
+  {0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08}, // ','
+  {0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00}, // '-'
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c}, // '.'
+  {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // '/'
+  {0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e}, // '0'
+  {0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e}, // '1'
+  {0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f}, // '2'
+  {0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e}, // '3'
+  {0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02}, // '4'
+  {0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e}, // '5'
+  {0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e}, // '6'
+  {0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // '7'
+  {0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e}, // '8'
+  {0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c}, // '9'
+  {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00}, // ':'
+  {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08}, // ';'
+  {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02}, // '<'
+  {0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00}, // '='
+  {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}, // '>'
+  {0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04}, // '?'
+  {0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e}, // '@'
+  {0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}, // 'A'
+  {0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e}, // 'B'
+  {0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e}, // 'C'
+  {0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c}, // 'D'
+  {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f}, // 'E'
+  {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10}, // 'F'
+  {0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f}, // 'G'
+  {0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}, // 'H'
+  {0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e}, // 'I'
+  {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c}, // 'J'
+  {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // 'K'
+  {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f}, // 'L'
+  {0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11}, // 'M'
+  {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // 'N'
+  {0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}, // 'O'
+  {0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10}, // 'P'
+  {0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d}, // 'Q'
+  {0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11}, // 'R'
+  {0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e}, // 'S'
+  {0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // 'T'
+  {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}, // 'U'
+  {0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04}, // 'V'
+  {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a}, // 'W'
+  {0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11}, // 'X'
+  {0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04}, // 'Y'
+  {0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f}, // 'Z'
+  {0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e}, // '['
+  {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00}, // backslash
+  {0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e}, // ']'
+  {0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00}, // '^'
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f}, // '_'
+};
+
+// On-screen overlay with frame time, renderer and loader counters and a frame time graph. Everything is drawn as
+// quads from one font atlas (its last cell is solid for bars and panels), streamed into one dynamic vertex buffer and
+// drawn with a single call.
+class Hud
+{
+public:
+  Shader HudShader;
+
+  Hud(const string &shaderDirectory)
+      : HudShader((shaderDirectory + "/hud.vs").c_str(), (shaderDirectory + "/hud.fs").c_str())
+  {
+    // font atlas: 16x4 glyph cells of 6x8 texels, the solid cell right of them
+    unsigned char atlas[ATLAS_HEIGHT][ATLAS_WIDTH] = {};
+    for (int glyph = 0; glyph < 64; glyph++)
+      for (int row = 0; row < 7; row++)
+        for (int column = 0; column < 5; column++)
+          if (HUD_FONT[glyph][row] & (0x10 >> column))
+            atlas[(glyph / 16) * 8 + row][(glyph % 16) * 6 + column] = 255;
+    for (int y = 0; y < 8; y++)
+      for (int x = 0; x < 8; x++)
+        atlas[y][96 + x] = 255;
+    glGenTextures(1, &fontTexture);
+    glBindTexture(GL_TEXTURE_2D, fontTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, ATLAS_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, HUD_MAX_QUADS * 6 * sizeof(HudVertex), NULL, GL_STREAM_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(HudVertex), (void *)offsetof(HudVertex, x));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(HudVertex), (void *)offsetof(HudVertex, u));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(HudVertex), (void *)offsetof(HudVertex, color));
+    glBindVertexArray(0);
+    vertices.reserve(HUD_MAX_QUADS * 6);
+  }
+  Hud(const Hud &) = delete;
+  Hud &operator=(const Hud &) = delete;
+  ~Hud()
+  {
+    glDeleteTextures(1, &fontTexture);
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
+  }
+
+  // accounts a finished frame, call before the frame stats are reset. frameTime in seconds
+  void Record(float frameTime, const RenderStats &stats)
+  {
+    history[historyFrame++ % HUD_HISTORY] = frameTime * 1000.0f;
+    frames++;
+    elapsed += frameTime;
+    sum.drawCalls += stats.drawCalls;
+    sum.textureBinds += stats.textureBinds;
+    sum.triangles += stats.triangles;
+    sum.objectsDrawn += stats.objectsDrawn;
+    sum.occlusionTested += stats.occlusionTested;
+    sum.occlusionCulled += stats.occlusionCulled;
+    sum.simulationMs += stats.simulationMs;
+    sum.cullingMs += stats.cullingMs;
+    if (elapsed >= HUD_REFRESH)
+    {
+      shown = sum;
+      shownFrames = frames;
+      shownElapsed = elapsed;
+      sum = RenderStats();
+      frames = 0;
+      elapsed = 0.0f;
+    }
+  }
+
+  // draws the overlay over the current framebuffer, status is an extra line of text
+  void Draw(int width, int height, const char *status)
+  {
+    auto start = std::chrono::steady_clock::now();
+    vertices.clear();
+    unsigned int n = std::max(shownFrames, 1u);
+    float worst = 0.0f;
+    for (float ms : history)
+      worst = std::max(worst, ms);
+
+    const float x0 = 12.0f, lineHeight = 9.0f * HUD_SCALE;
+    const int lines = 6;
+    const float graphTop = x0 + lines * lineHeight + 6.0f, graphHeight = 60.0f, barWidth = 3.0f;
+    quad(x0 - 6.0f, x0 - 6.0f, x0 + 42 * 6 * HUD_SCALE, graphTop + graphHeight + 6.0f, SOLID_U, SOLID_V, SOLID_U, SOLID_V, 0xb0000000);
+
+    float y = x0;
+    char line[128];
+    snprintf(line, sizeof(line), "%5.1f FPS %6.2f MS  MAX %6.2f MS", shownElapsed > 0.0f ? shownFrames / shownElapsed : 0.0f,
+             shownElapsed * 1000.0f / n, worst);
+    text(x0, y, line, 0xffffffff);
+    snprintf(line, sizeof(line), "DRAW CALLS %u  BINDS %u  TRIANGLES %lu", shown.drawCalls / n, shown.textureBinds / n, shown.triangles / n);
+    text(x0, y += lineHeight, line, 0xffffffff);
+    snprintf(line, sizeof(line), "OBJECTS %u  OCCLUDED %u/%u", shown.objectsDrawn / n, shown.occlusionCulled / n, shown.occlusionTested / n);
+    text(x0, y += lineHeight, line, 0xffffffff);
+    snprintf(line, sizeof(line), "TEXTURES %u %.1f MB  MESHES %.1f MB", resourceStats.textures, resourceStats.textureBytes / 1048576.0f,
+             resourceStats.meshBytes / 1048576.0f);
+    text(x0, y += lineHeight, line, 0xffffffff);
+    snprintf(line, sizeof(line), "SIM %.3f  CULL %.3f  HUD %.3f MS", shown.simulationMs / n, shown.cullingMs / n, drawMs);
+    text(x0, y += lineHeight, line, 0xffffffff);
+    text(x0, y += lineHeight, status, 0xff80ffff);
+
+    // frame time graph, oldest frame on the left, full height is 33.3 ms
+    for (int i = 0; i < HUD_HISTORY; i++)
+    {
+      float ms = history[(historyFrame + i) % HUD_HISTORY];
+      float h = std::min(ms / 33.3f, 1.0f) * graphHeight;
+      unsigned int color = ms <= 16.7f ? 0xff40ff40 : ms <= 33.3f ? 0xff40ffff : 0xff4040ff;
+      quad(x0 + i * barWidth, graphTop + graphHeight - h, x0 + (i + 1) * barWidth - 1.0f, graphTop + graphHeight, SOLID_U, SOLID_V, SOLID_U,
+           SOLID_V, color);
+    }
+    // 60 Hz budget
+    quad(x0, graphTop + graphHeight * 0.5f, x0 + HUD_HISTORY * barWidth, graphTop + graphHeight * 0.5f + 1.0f, SOLID_U, SOLID_V, SOLID_U,
+         SOLID_V, 0x80ffffff);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    // orphan last frame's storage instead of waiting for the GPU to be done with it
+    glBufferData(GL_ARRAY_BUFFER, HUD_MAX_QUADS * 6 * sizeof(HudVertex), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(HudVertex), vertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    HudShader.use();
+    HudShader.setVec2("screenSize", (float)width, (float)height);
+    HudShader.setInt("font", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, fontTexture);
+    glBindVertexArray(VAO);
+    glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    drawMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+private:
+  static const int ATLAS_WIDTH = 104;
+  static const int ATLAS_HEIGHT = 32;
+  // center of the solid cell
+  static constexpr float SOLID_U = 100.0f / ATLAS_WIDTH;
+  static constexpr float SOLID_V = 4.0f / ATLAS_HEIGHT;
+
+  struct HudVertex
+  {
+    float x, y; // pixels from the top left corner
+    float u, v;
+    unsigned int color; // RGBA8, red in the lowest byte
+  };
+
+  unsigned int fontTexture, VAO, VBO;
+  vector<HudVertex> vertices;
+  float history[HUD_HISTORY] = {};
+  unsigned long historyFrame = 0;
+  RenderStats sum, shown;
+  unsigned int frames = 0, shownFrames = 0;
+  float elapsed = 0.0f, shownElapsed = 0.0f;
+  float drawMs = 0.0f;
+
+  void quad(float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1, unsigned int color)
+  {
+    if (vertices.size() + 6 > (size_t)HUD_MAX_QUADS * 6)
+      return;
+    HudVertex a = {x0, y0, u0, v0, color}, b = {x1, y0, u1, v0, color}, c = {x1, y1, u1, v1, color}, d = {x0, y1, u0, v1, color};
+    vertices.push_back(a);
+    vertices.push_back(b);
+    vertices.push_back(c);
+    vertices.push_back(a);
+    vertices.push_back(c);
+    vertices.push_back(d);
+  }
+
+  void text(float x, float y, const char *string, unsigned int color)
+  {
+    for (const char *c = string; *c; c++, x += 6 * HUD_SCALE)
+    {
+      int glyph = (*c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c) - 32;
+      if (glyph <= 0 || glyph >= 64)
+        continue;
+      float u = (glyph % 16) * 6.0f / ATLAS_WIDTH, v = (glyph / 16) * 8.0f / ATLAS_HEIGHT;
+      quad(x, y, x + 5 * HUD_SCALE, y + 7 * HUD_SCALE, u, v, u + 5.0f / ATLAS_WIDTH, v + 7.0f / ATLAS_HEIGHT, color);
+    }
+  }
+};
+#endif
@@ -0,0 +1,114 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "lights.hpp"
+#include "model.hpp"
+#include "profiler.hpp"
+#include "shader.hpp"
+#include "stats.hpp"
+#include "stream_buffer.hpp"
+
+#include <cmath>
+#include <map>
+#include <string>
+using namespace std;
+
+// projected radius in pixels below which the asteroids are drawn as impostors
+const float IMPOSTOR_PIXELS = 4.0f;
+
+// one impostor in the transform buffer, two texels: sphere center and radius, albedo
+struct ImpostorInstance
+{
+  glm::vec4 sphere;
+  glm::vec4 albedo;
+};
+
+// Impostors for bodies too small on screen for their mesh to matter: a sphere per body, ray traced on a billboard
+// that faces the camera and exactly covers the sphere's silhouette, lit like the planets (the Sun and the point lights)
+// and writing the depth of the hit point, so they intersect the meshes correctly. A body's look is reduced to its
+// bounding sphere and average albedo. All of them are one instanced draw of 4 vertices per impostor, reading the
+// instances from the transform buffer, so the vertex work doesn't depend on the mesh. Drawn after the opaque pass (and
+// after the deferred lighting) in every shading path, forward lit like the Sun is drawn forward.
+class ImpostorRenderer
+{
+public:
+  Shader ImpostorShader;
+
+  ImpostorRenderer(const string &shaderDirectory)
+      : ImpostorShader((shaderDirectory + "/impostor.vs").c_str(), (shaderDirectory + "/impostor.fs").c_str())
+  {
+    // the billboards have no attributes, but core profile still wants a VAO bound
+    glGenVertexArrays(1, &emptyVAO);
+  }
+  ImpostorRenderer(const ImpostorRenderer &) = delete;
+  ImpostorRenderer &operator=(const ImpostorRenderer &) = delete;
+  ~ImpostorRenderer()
+  {
+    glDeleteVertexArrays(1, &emptyVAO);
+  }
+
+  // projected radius in pixels of a sphere at distance from the camera, for a viewport height pixels high
+  static float ProjectedPixels(float radius, float distance, const glm::mat4 &projection, int height)
+  {
+    return radius * projection[1][1] * 0.5f * height / std::max(distance, 1e-6f);
+  }
+
+  // average albedo of model: the smallest mip level of its first mesh's diffuse texture, read back once per model
+  glm::vec3 AverageAlbedo(const Model *model)
+  {
+    auto found = albedos.find(model);
+    if (found != albedos.end())
+      return found->second;
+    glm::vec3 albedo(0.5f);
+    if (!model->meshes.empty())
+      for (const Texture &texture : model->meshes[0].textures)
+        if (texture.type == "texture_diffuse" && texture.id)
+        {
+          int width = 0, height = 0;
+          glBindTexture(GL_TEXTURE_2D, texture.id);
+          glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+          glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+          int level = (int)std::floor(std::log2((float)std::max(1, std::max(width, height))));
+          glGetTexImage(GL_TEXTURE_2D, level, GL_RGB, GL_FLOAT, &albedo[0]);
+          glBindTexture(GL_TEXTURE_2D, 0);
+          break;
+        }
+    return albedos[model] = albedo;
+  }
+
+  // draws count impostors from the transform buffer, starting at texel base, lit by the Sun and lights
+  void Draw(StreamBuffer &transforms, int base, unsigned int count, const glm::mat4 &view, const glm::mat4 &projection,
+            const glm::vec3 &viewPos, const glm::vec3 &lightPos, const glm::vec3 &lightColor, LightSet &lights)
+  {
+    if (count == 0)
+      return;
+    PROFILE_GPU_ZONE("impostors");
+    ImpostorShader.use();
+    ImpostorShader.setMat4("view", view);
+    ImpostorShader.setMat4("projection", projection);
+    ImpostorShader.setVec3("viewPos", viewPos);
+    ImpostorShader.setVec3("lightPos", lightPos);
+    ImpostorShader.setVec3("lightColor", lightColor);
+    ImpostorShader.setInt("pointLights", LIGHT_BUFFER_UNIT);
+    ImpostorShader.setInt("numPointLights", (int)lights.lights.size());
+    ImpostorShader.setInt("transforms", TRANSFORM_BUFFER_UNIT);
+    ImpostorShader.setInt("impostorBase", base);
+    lights.Bind();
+    transforms.BindTexture(TRANSFORM_BUFFER_UNIT);
+    glBindVertexArray(emptyVAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+    glBindVertexArray(0);
+    frameStats.drawCalls++;
+    frameStats.triangles += 2 * count;
+    frameStats.objectsDrawn += count;
+  }
+
+private:
+  unsigned int emptyVAO;
+  std::map<const Model *, glm::vec3> albedos;
+};
+#endif
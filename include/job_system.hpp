@@ -0,0 +1,124 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Fixed pool of worker threads running data parallel loops. The calling thread works along the workers, so a pool
+// with no workers (single core machine) just runs the loop inline. Not reentrant: jobs must not call ParallelFor.
+class JobSystem
+{
+public:
+  // threads: number of workers, by default one less than the hardware threads
+  JobSystem(int threads = -1)
+  {
+    if (threads < 0)
+      threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    for (int i = 0; i < threads; i++)
+      workers.emplace_back(&JobSystem::workerLoop, this);
+  }
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+  ~JobSystem()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+      worker.join();
+  }
+
+  // threads taking part in a ParallelFor, workers plus the caller
+  unsigned int ThreadCount() const
+  {
+    return workers.size() + 1;
+  }
+
+  // calls job(i) for every i in [0, count) and returns once all calls are done. Indices are handed out one at a time,
+  // so each call should carry a reasonable amount of work. The job is called through a pointer rather than copied
+  // into a std::function, so dispatching never allocates
+  template <class Job>
+  void ParallelFor(unsigned int count, const Job &job)
+  {
+    if (workers.empty() || count <= 1)
+    {
+      for (unsigned int i = 0; i < count; i++)
+        job(i);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      current = &job;
+      invoke = [](const void *job, unsigned int i)
+      { (*(const Job *)job)(i); };
+      jobCount = count;
+      next = 0;
+      busy = workers.size();
+      generation++;
+    }
+    wake.notify_all();
+    run(&job, invoke, count);
+    // every worker must have left this loop before the job goes out of scope
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]
+              { return busy == 0; });
+    current = nullptr;
+  }
+
+private:
+  typedef void (*JobInvoker)(const void *job, unsigned int i);
+
+  vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  const void *current = nullptr;
+  JobInvoker invoke = nullptr;
+  unsigned int jobCount = 0;
+  std::atomic<unsigned int> next{0};
+  size_t busy = 0;
+  unsigned long generation = 0;
+  bool stop = false;
+
+  void run(const void *job, JobInvoker invoker, unsigned int count)
+  {
+    for (unsigned int i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+      invoker(job, i);
+  }
+
+  void workerLoop()
+  {
+    PROFILE_THREAD("worker");
+    unsigned long seen = 0;
+    for (;;)
+    {
+      const void *job;
+      JobInvoker invoker;
+      unsigned int count;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&]
+                  { return stop || generation != seen; });
+        if (stop)
+          return;
+        seen = generation;
+        job = current;
+        invoker = invoke;
+        count = jobCount;
+      }
+      run(job, invoker, count);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--busy == 0)
+        done.notify_one();
+    }
+  }
+};
+#endif
@@ -0,0 +1,124 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+using namespace std;
+
+// texture unit reserved for the light buffer, far above the material textures bound by Mesh::Draw
+const int LIGHT_BUFFER_UNIT = 8;
+
+struct PointLight
+{
+  glm::vec3 Position;
+  float Radius; // influence ends smoothly at this distance
+  glm::vec3 Color;
+};
+
+// a set of glowing bodies orbiting the Sun. Light data lives in a texture buffer (two RGBA32F texels per light:
+// position/radius and color) so that any number of lights can be read by the shaders on GL 3.3.
+class LightSet
+{
+public:
+  vector<PointLight> lights;
+
+  LightSet()
+  {
+    glGenBuffers(1, &buffer);
+    glGenTextures(1, &texture);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, 2 * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+  LightSet(const LightSet &) = delete;
+  LightSet &operator=(const LightSet &) = delete;
+  ~LightSet()
+  {
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &buffer);
+  }
+
+  // replaces the lights with count random ones on orbits around center. Same seed, same lights, so benchmarks compare
+  // identical scenes
+  void Generate(unsigned int count, const glm::vec3 &center, unsigned int seed = 1)
+  {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    orbits.resize(count);
+    lights.resize(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+      Orbit &orbit = orbits[i];
+      orbit.center = center;
+      orbit.distance = 15.0f + 35.0f * unit(rng);
+      orbit.height = -10.0f + 20.0f * unit(rng);
+      orbit.speed = 0.05f + 0.3f * unit(rng);
+      orbit.phase = 6.2831853f * unit(rng);
+      lights[i].Radius = 8.0f + 12.0f * unit(rng);
+      // saturated random hue
+      float hue = unit(rng) * 6.0f;
+      glm::vec3 color = glm::clamp(glm::vec3(fabsf(hue - 3.0f) - 1.0f, 2.0f - fabsf(hue - 2.0f), 2.0f - fabsf(hue - 4.0f)), 0.0f, 1.0f);
+      lights[i].Color = color * 0.8f;
+    }
+    Update(0.0f);
+  }
+
+  // moves the lights along their orbits and uploads them
+  void Update(float time)
+  {
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+      const Orbit &orbit = orbits[i];
+      float a = orbit.phase + orbit.speed * time;
+      lights[i].Position = orbit.center + glm::vec3(orbit.distance * cosf(a), orbit.height, -orbit.distance * sinf(a));
+    }
+
+    staging.resize(lights.size() * 2);
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+      staging[i * 2] = glm::vec4(lights[i].Position, lights[i].Radius);
+      staging[i * 2 + 1] = glm::vec4(lights[i].Color, 0.0f);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    // orphan the previous storage so the upload doesn't wait for frames still reading it
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(staging.size(), 2) * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+    if (!staging.empty())
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, staging.size() * sizeof(glm::vec4), &staging[0]);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+
+  // the buffer object holding the light data, for binding it as a shader storage buffer
+  unsigned int Buffer() const
+  {
+    return buffer;
+  }
+
+  // binds the light buffer to LIGHT_BUFFER_UNIT
+  void Bind()
+  {
+    glActiveTexture(GL_TEXTURE0 + LIGHT_BUFFER_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+private:
+  struct Orbit
+  {
+    glm::vec3 center;
+    float distance, height, speed, phase;
+  };
+  vector<Orbit> orbits;
+  vector<glm::vec4> staging;
+  unsigned int buffer, texture;
+};
+#endif
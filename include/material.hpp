@@ -0,0 +1,172 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "gpu_resources.hpp"
+#include "model.hpp"
+#include "shader.hpp"
+#include "stats.hpp"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// size of the Materials block of the shaders
+const int MAX_MATERIALS = 64;
+// uniform buffer binding point of the Materials block
+const int MATERIAL_BLOCK_BINDING = 0;
+// texture units the material textures stay bound to, above the ones Mesh::Draw, the lights and the virtual texture
+// use so that nothing else disturbs them between draws
+const int MATERIAL_ALBEDO_UNIT = 13;
+const int MATERIAL_SPECULAR_UNIT = 14;
+const int MATERIAL_CLOUDS_UNIT = 15;
+
+// shading parameters of a material, in the std140 layout of the shaders' Material struct
+struct MaterialParameters
+{
+  // phong specular strength and exponent where the specular mask is white (water), then where it's black (land) or
+  // there is no mask. The default is the look of the planets before materials
+  glm::vec4 specular = glm::vec4(0.3f, 2.0f, 0.3f, 2.0f);
+  // cloud layer: opacity, rotation relative to the surface in radians per second
+  glm::vec4 clouds = glm::vec4(0.0f);
+  // textures the material has: specular mask, clouds. Filled in by MaterialLibrary
+  glm::ivec4 layers = glm::ivec4(0);
+};
+
+// Materials of the models, made of the textures of their meshes by type: texture_diffuse the albedo, texture_specular
+// a mask between the two specular terms and texture_clouds a layer rotating over the surface (its red channel is the
+// cover). The parameters of every material live in one uniform buffer, uploaded when a material is added, and draws
+// pick theirs with materialIndex. Bind() only binds the textures that differ from the ones bound already, so drawing
+// the models sorted by material binds each texture once per batch instead of once per mesh.
+class MaterialLibrary
+{
+public:
+  MaterialLibrary()
+  {
+    GpuResourceOwner owner("materials");
+    buffer = BufferHandle::Generate();
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer.Id());
+    glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(MaterialParameters), NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GpuResources::Instance().Register(GPU_BUFFER, buffer.Id(), MAX_MATERIALS * sizeof(MaterialParameters),
+                                      std::to_string(MAX_MATERIALS) + " materials");
+  }
+  MaterialLibrary(const MaterialLibrary &) = delete;
+  MaterialLibrary &operator=(const MaterialLibrary &) = delete;
+
+  // parameters of the material model will get, before it's created
+  void SetParameters(const Model *model, const MaterialParameters &parameters)
+  {
+    this->parameters[model] = parameters;
+  }
+
+  // index of the material of model, made of the textures of its first mesh the first time the model is ready. -1
+  // until then, or if the buffer is full
+  int Find(const Model *model)
+  {
+    auto found = indices.find(model);
+    if (found != indices.end())
+      return found->second;
+    if (!model->Ready() || model->meshes.empty())
+      return -1;
+    if (materials.size() == MAX_MATERIALS)
+    {
+      cout << "ERROR::MATERIAL:: more than " << MAX_MATERIALS << " materials, " << model->path << " has none" << endl;
+      return indices[model] = -1;
+    }
+    Material material;
+    auto known = parameters.find(model);
+    if (known != parameters.end())
+      material.parameters = known->second;
+    for (const Texture &texture : model->meshes[0].textures)
+      if (texture.type == "texture_diffuse" && !material.textures[0])
+        material.textures[0] = texture.id;
+      else if (texture.type == "texture_specular" && !material.textures[1])
+        material.textures[1] = texture.id;
+      else if (texture.type == "texture_clouds" && !material.textures[2])
+        material.textures[2] = texture.id;
+    material.parameters.layers = glm::ivec4(material.textures[1] != 0, material.textures[2] != 0, 0, 0);
+    materials.push_back(material);
+    uploaded = false;
+    return indices[model] = (int)materials.size() - 1;
+  }
+
+  // once per frame before the draws with shader: uploads the materials added since the last frame and binds the
+  // buffer to the shader's Materials block (again, as a hot reload makes a new program)
+  void Begin(Shader &shader)
+  {
+    if (!uploaded && !materials.empty())
+    {
+      staging.resize(materials.size());
+      for (size_t i = 0; i < materials.size(); i++)
+        staging[i] = materials[i].parameters;
+      glBindBuffer(GL_UNIFORM_BUFFER, buffer.Id());
+      glBufferSubData(GL_UNIFORM_BUFFER, 0, staging.size() * sizeof(MaterialParameters), &staging[0]);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      uploaded = true;
+    }
+    unsigned int block = glGetUniformBlockIndex(shader.ID, "Materials");
+    if (block != GL_INVALID_INDEX)
+      glUniformBlockBinding(shader.ID, block, MATERIAL_BLOCK_BINDING);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, buffer.Id());
+  }
+
+  // selects material index (-1 for none) for the next draws with shader. With bindTextures its textures are bound to
+  // the material units, those bound there already skipped, and the draws must not bind their own; without, the draws
+  // bind them per mesh as Mesh::Draw does
+  void Bind(int index, Shader &shader, bool bindTextures = true)
+  {
+    shader.setInt("materialIndex", index);
+    if (index < 0 || !bindTextures)
+      return;
+    const Material &material = materials[index];
+    const int units[3] = {MATERIAL_ALBEDO_UNIT, MATERIAL_SPECULAR_UNIT, MATERIAL_CLOUDS_UNIT};
+    for (int i = 0; i < 3; i++)
+      if (material.textures[i] && material.textures[i] != bound[i])
+      {
+        glActiveTexture(GL_TEXTURE0 + units[i]);
+        glBindTexture(GL_TEXTURE_2D, material.textures[i]);
+        bound[i] = material.textures[i];
+        frameStats.textureBinds++;
+      }
+    glActiveTexture(GL_TEXTURE0);
+    // Mesh::Draw may have pointed the samplers at its own units since
+    shader.setInt("texture_diffuse1", MATERIAL_ALBEDO_UNIT);
+    shader.setInt("texture_specular1", MATERIAL_SPECULAR_UNIT);
+    shader.setInt("texture_clouds", MATERIAL_CLOUDS_UNIT);
+  }
+
+  // forgets what is bound to the material units, for when something else bound textures there
+  void Invalidate()
+  {
+    bound[0] = bound[1] = bound[2] = 0;
+  }
+
+  unsigned int Count() const
+  {
+    return materials.size();
+  }
+
+private:
+  struct Material
+  {
+    // albedo, specular mask, clouds; 0 where the material has none
+    unsigned int textures[3] = {0, 0, 0};
+    MaterialParameters parameters;
+  };
+
+  BufferHandle buffer;
+  vector<Material> materials;
+  vector<MaterialParameters> staging;
+  std::map<const Model *, int> indices;
+  std::map<const Model *, MaterialParameters> parameters;
+  bool uploaded = true;
+  // textures bound to the albedo, specular and clouds units by Bind()
+  unsigned int bound[3] = {0, 0, 0};
+};
+#endif
@@ -6,7 +6,9 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "gpu_resources.hpp"
 #include "shader.hpp"
+#include "stats.hpp"
 
 #include <string>
 #include <vector>
@@ -32,6 +34,7 @@ struct Vertex
   float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// texture used by a mesh, the GL texture itself is owned by the Model
 struct Texture
 {
   unsigned int id;
@@ -46,33 +49,28 @@ public:
   vector<Vertex> vertices;
   vector<unsigned int> indices;
   vector<Texture> textures;
-  unsigned int VAO;
-
-  // constructor
-  Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+  VertexArrayHandle VAO;
+  GLenum indexType; // GL_UNSIGNED_SHORT when every vertex can be addressed with 16 bits, GL_UNSIGNED_INT otherwise
+
+  // constructor, takes over the data (pass it with std::move). Meshes own their GL objects so they can only be moved.
+  // Without upload the mesh is only built on the CPU, which any thread can do, and Upload() must be called on the GL
+  // thread before drawing it
+  Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true)
+      : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
   {
-    this->vertices = vertices;
-    this->indices = indices;
-    this->textures = textures;
+    this->indexType = this->vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 
-    // now that we have all the required data, set the vertex buffers and its attribute pointers.
-    setupMesh();
-  }
-
-  // render the mesh
-  void Draw(Shader &shader)
-  {
-    // bind appropriate textures
+    // sampler uniform of each texture (the N in diffuse_textureN numbers the textures of a type), named once here
+    // rather than on every draw
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
     unsigned int normalNr = 1;
     unsigned int heightNr = 1;
-    for (unsigned int i = 0; i < textures.size(); i++)
+    samplerNames.reserve(this->textures.size());
+    for (const Texture &texture : this->textures)
     {
-      glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-      // retrieve texture number (the N in diffuse_textureN)
       string number;
-      string name = textures[i].type;
+      const string &name = texture.type;
       if (name == "texture_diffuse")
         number = std::to_string(diffuseNr++);
       else if (name == "texture_specular")
@@ -81,44 +79,102 @@ public:
         number = std::to_string(normalNr++); // transfer unsigned int to string
       else if (name == "texture_height")
         number = std::to_string(heightNr++); // transfer unsigned int to string
+      samplerNames.push_back(name + number);
+    }
+
+    // now that we have all the required data, set the vertex buffers and its attribute pointers.
+    if (upload)
+      setupMesh();
+  }
+
+  void Upload()
+  {
+    if (!Uploaded())
+      setupMesh();
+  }
+  bool Uploaded() const
+  {
+    return VAO.Id() != 0;
+  }
 
+  // binds the textures to units 0, 1, ... and points their samplers (samplerNames) at them
+  void BindTextures(Shader &shader) const
+  {
+    for (unsigned int i = 0; i < textures.size(); i++)
+    {
+      glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
       // now set the sampler to the correct texture unit
-      glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+      glUniform1i(glGetUniformLocation(shader.ID, samplerNames[i].c_str()), i);
       // and finally bind the texture
       glBindTexture(GL_TEXTURE_2D, textures[i].id);
+      frameStats.textureBinds++;
     }
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // render the mesh, instances times (the shader tells the instances apart by gl_InstanceID). Without bindTextures
+  // the textures bound already are used, see MaterialLibrary
+  void Draw(Shader &shader, unsigned int instances = 1, bool bindTextures = true)
+  {
+    // bind appropriate textures
+    if (bindTextures)
+      BindTextures(shader);
 
     // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+    glBindVertexArray(VAO.Id());
+    if (instances == 1)
+      glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), indexType, 0);
+    else
+      glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), indexType, 0, instances);
     glBindVertexArray(0);
+    frameStats.drawCalls++;
+    frameStats.triangles += indices.size() / 3 * instances;
+  }
 
-    // always good practice to set everything back to defaults once configured.
-    glActiveTexture(GL_TEXTURE0);
+  // sizes of the GPU buffers in bytes
+  size_t VertexBufferSize() const
+  {
+    return vertices.size() * sizeof(Vertex);
+  }
+  size_t IndexBufferSize() const
+  {
+    return indices.size() * (indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int));
   }
 
 private:
   // render data
-  unsigned int VBO, EBO;
+  BufferHandle VBO, EBO;
+  vector<string> samplerNames; // per texture
 
   // initializes all the buffer objects/arrays
   void setupMesh()
   {
     // create buffers/arrays
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    VAO = VertexArrayHandle::Generate();
+    VBO = BufferHandle::Generate();
+    EBO = BufferHandle::Generate();
 
-    glBindVertexArray(VAO);
+    glBindVertexArray(VAO.Id());
     // load data into vertex buffers
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO.Id());
     // A great thing about structs is that their memory layout is sequential for all its items.
     // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
     // again translates to 3/2 floats which translates to a byte array.
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.Id());
+    if (indexType == GL_UNSIGNED_SHORT)
+    {
+      // narrow the indices, half the memory and bandwidth for the index fetch
+      vector<unsigned short> shortIndices(indices.begin(), indices.end());
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), &shortIndices[0], GL_STATIC_DRAW);
+    }
+    else
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    GpuResources::Instance().Register(GPU_VERTEX_ARRAY, VAO.Id(), 0, "vertex array");
+    GpuResources::Instance().Register(GPU_BUFFER, VBO.Id(), VertexBufferSize(), std::to_string(vertices.size()) + " vertices");
+    GpuResources::Instance().Register(GPU_BUFFER, EBO.Id(), IndexBufferSize(),
+                                      std::to_string(indices.size()) + (indexType == GL_UNSIGNED_SHORT ? " 16-bit" : " 32-bit") + " indices");
 
     // set the vertex attribute pointers
     // vertex Positions
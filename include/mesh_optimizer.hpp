@@ -0,0 +1,362 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "arena.hpp"
+#include "mesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// Default optimizer values
+const unsigned int CACHE_SIZE = 16;        // post-transform cache entries assumed when reporting statistics (FIFO)
+const unsigned int FORSYTH_CACHE_SIZE = 32; // LRU cache size used by the triangle scoring heuristic
+const float OVERDRAW_THRESHOLD = 1.05f;    // max allowed ACMR degradation when splitting clusters for overdraw, <= 0 disables the pass
+
+// The passes keep their working arrays in ScratchVectors: inside a ScratchScope they come from its arena (see
+// Model::loadModel), otherwise from the heap. Only the resulting vertex and index buffers are heap allocated.
+// scratch memory used by running every pass once over a mesh, per vertex and per triangle (arena memory is only
+// reclaimed when the arena is reset)
+const size_t OPTIMIZER_SCRATCH_PER_VERTEX = 64;
+const size_t OPTIMIZER_SCRATCH_PER_TRIANGLE = 32;
+
+// post-transform vertex cache efficiency of an index buffer
+struct VertexCacheStats
+{
+  float acmr; // average cache miss ratio: transformed vertices per triangle (0.5 is ideal for big regular grids, 3 is worst)
+  float atvr; // average transformed vertex ratio: transformed vertices per unique vertex (1 is ideal)
+};
+
+// FNV-1a over the raw bytes of a vertex
+uint64_t hashVertex(const Vertex &vertex)
+{
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&vertex);
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < sizeof(Vertex); i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// welds bit-identical vertices (every attribute, so UV seams and hard edges are kept) and remaps the index buffer.
+// Uses an open addressing hash table of vertex indices so that the whole pass is linear.
+void WeldVertices(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+  if (vertices.empty())
+    return;
+
+  size_t tableSize = 1;
+  while (tableSize < vertices.size() * 2)
+    tableSize *= 2;
+  const unsigned int empty = ~0u;
+  ScratchVector<unsigned int> table(tableSize, empty);
+
+  ScratchVector<unsigned int> remap(vertices.size());
+  vector<Vertex> result;
+  result.reserve(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    size_t slot = hashVertex(vertices[i]) & (tableSize - 1);
+    while (table[slot] != empty && std::memcmp(&result[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+      slot = (slot + 1) & (tableSize - 1);
+    if (table[slot] == empty)
+    {
+      table[slot] = result.size();
+      result.push_back(vertices[i]);
+    }
+    remap[i] = table[slot];
+  }
+
+  for (unsigned int &index : indices)
+    index = remap[index];
+  vertices.swap(result);
+}
+
+// simulates a FIFO post-transform cache of the given size over the index buffer
+VertexCacheStats AnalyzeVertexCache(const vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = CACHE_SIZE)
+{
+  VertexCacheStats stats = {0.0f, 0.0f};
+  if (indices.empty() || vertexCount == 0)
+    return stats;
+
+  // timestamp of the moment each vertex entered the cache; a vertex is cached if it entered less than cacheSize misses ago
+  ScratchVector<unsigned int> cachedAt(vertexCount, 0);
+  unsigned int misses = 0;
+  for (unsigned int index : indices)
+  {
+    if (cachedAt[index] == 0 || misses - cachedAt[index] >= cacheSize)
+    {
+      misses++;
+      cachedAt[index] = misses;
+    }
+  }
+
+  // unique vertices actually referenced, unreferenced ones don't cost anything
+  ScratchVector<bool> used(vertexCount, false);
+  size_t uniqueVertices = 0;
+  for (unsigned int index : indices)
+  {
+    if (!used[index])
+    {
+      used[index] = true;
+      uniqueVertices++;
+    }
+  }
+
+  stats.acmr = float(misses) / float(indices.size() / 3);
+  stats.atvr = float(misses) / float(uniqueVertices);
+  return stats;
+}
+
+// vertex score of Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": vertices already in the cache score high
+// (the three of the last triangle slightly less, so that strips don't degenerate) and vertices with few remaining
+// triangles are boosted so that they are finished off instead of left dangling.
+float forsythVertexScore(int cachePosition, unsigned int remainingValence)
+{
+  if (remainingValence == 0)
+    return -1.0f;
+
+  float score = 0.0f;
+  if (cachePosition >= 0)
+  {
+    if (cachePosition < 3)
+      score = 0.75f;
+    else
+    {
+      const float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+      score = powf(1.0f - (cachePosition - 3) * scaler, 1.5f);
+    }
+  }
+  score += 2.0f * powf(float(remainingValence), -0.5f);
+  return score;
+}
+
+// reorders triangles for post-transform cache locality (Forsyth). The result is independent of the cache size of the
+// actual hardware, which is why it works well on every GPU we run on.
+void OptimizeVertexCache(vector<unsigned int> &indices, size_t vertexCount)
+{
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0)
+    return;
+
+  // triangle adjacency of every vertex, stored in one flat array
+  ScratchVector<unsigned int> valence(vertexCount, 0);
+  for (unsigned int index : indices)
+    valence[index]++;
+  ScratchVector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; v++)
+    adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+  ScratchVector<unsigned int> adjacency(indices.size());
+  ScratchVector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+  for (size_t t = 0; t < triangleCount; t++)
+    for (int k = 0; k < 3; k++)
+      adjacency[fill[indices[t * 3 + k]]++] = t;
+
+  // initial scores
+  ScratchVector<int> cachePosition(vertexCount, -1);
+  ScratchVector<float> vertexScore(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++)
+    vertexScore[v] = forsythVertexScore(-1, valence[v]);
+  ScratchVector<float> triangleScore(triangleCount);
+  for (size_t t = 0; t < triangleCount; t++)
+    triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+  ScratchVector<bool> emitted(triangleCount, false);
+  vector<unsigned int> result;
+  result.reserve(indices.size());
+
+  // LRU cache, with room for the 3 vertices being pushed in before the tail is evicted
+  ScratchVector<unsigned int> cache, nextCache;
+  cache.reserve(FORSYTH_CACHE_SIZE + 3);
+  nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+  size_t scanCursor = 0; // for the (rare) linear search when the cache has no candidates left
+  long bestTriangle = 0;
+  for (size_t t = 1; t < triangleCount; t++)
+    if (triangleScore[t] > triangleScore[bestTriangle])
+      bestTriangle = t;
+
+  for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+  {
+    if (bestTriangle < 0)
+    {
+      while (emitted[scanCursor])
+        scanCursor++;
+      bestTriangle = scanCursor;
+    }
+
+    const unsigned int *tri = &indices[bestTriangle * 3];
+    result.insert(result.end(), tri, tri + 3);
+    emitted[bestTriangle] = true;
+
+    // remove the triangle from the adjacency of its vertices
+    for (int k = 0; k < 3; k++)
+    {
+      unsigned int v = tri[k];
+      unsigned int *begin = &adjacency[adjacencyOffset[v]];
+      unsigned int *end = begin + valence[v];
+      unsigned int *it = std::find(begin, end, (unsigned int)bestTriangle);
+      std::swap(*it, *(end - 1));
+      valence[v]--;
+    }
+
+    // move the triangle's vertices to the front of the cache
+    nextCache.assign(tri, tri + 3);
+    for (unsigned int v : cache)
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+        nextCache.push_back(v);
+    for (size_t i = 0; i < nextCache.size(); i++)
+      cachePosition[nextCache[i]] = i < FORSYTH_CACHE_SIZE ? int(i) : -1;
+
+    // update scores of everything that was touched and find the next best candidate among them
+    bestTriangle = -1;
+    float bestScore = -1.0f;
+    for (unsigned int v : nextCache)
+    {
+      vertexScore[v] = forsythVertexScore(cachePosition[v], valence[v]);
+    }
+    for (unsigned int v : nextCache)
+    {
+      for (unsigned int a = adjacencyOffset[v]; a < adjacencyOffset[v] + valence[v]; a++)
+      {
+        unsigned int t = adjacency[a];
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+        if (triangleScore[t] > bestScore)
+        {
+          bestScore = triangleScore[t];
+          bestTriangle = t;
+        }
+      }
+    }
+
+    if (nextCache.size() > FORSYTH_CACHE_SIZE)
+      nextCache.resize(FORSYTH_CACHE_SIZE);
+    cache.swap(nextCache);
+  }
+
+  indices.swap(result);
+}
+
+// splits an already cache-optimized index buffer into clusters and sorts them so that outward facing clusters are drawn
+// first, which reduces overdraw of convex-ish objects (Sander et al., "Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw"). Clusters start where the cache gets flushed anyway, or wherever splitting keeps ACMR within threshold.
+void OptimizeOverdraw(vector<unsigned int> &indices, const vector<Vertex> &vertices, float threshold = OVERDRAW_THRESHOLD)
+{
+  size_t triangleCount = indices.size() / 3;
+  if (threshold <= 0.0f || triangleCount == 0)
+    return;
+
+  float targetAcmr = AnalyzeVertexCache(indices, vertices.size()).acmr * threshold;
+
+  // find cluster boundaries by simulating the FIFO cache over the triangle stream
+  ScratchVector<size_t> clusterStart;
+  clusterStart.reserve(triangleCount + 1);
+  ScratchVector<unsigned int> cachedAt(vertices.size(), 0);
+  unsigned int misses = 0, clusterMisses = 0;
+  size_t clusterTriangles = 0;
+  for (size_t t = 0; t < triangleCount; t++)
+  {
+    unsigned int triangleMisses = 0;
+    for (int k = 0; k < 3; k++)
+    {
+      unsigned int index = indices[t * 3 + k];
+      if (cachedAt[index] == 0 || misses - cachedAt[index] >= CACHE_SIZE)
+      {
+        misses++;
+        triangleMisses++;
+        cachedAt[index] = misses;
+      }
+    }
+
+    bool hardBoundary = triangleMisses == 3;
+    bool softBoundary = triangleMisses == 2 && clusterTriangles > 0 && float(clusterMisses) / clusterTriangles <= targetAcmr;
+    if (t == 0 || hardBoundary || softBoundary)
+    {
+      clusterStart.push_back(t);
+      clusterMisses = 0;
+      clusterTriangles = 0;
+    }
+    clusterMisses += triangleMisses;
+    clusterTriangles++;
+  }
+  clusterStart.push_back(triangleCount);
+
+  // mesh centroid, area weighted
+  glm::vec3 meshCenter(0.0f);
+  float meshArea = 0.0f;
+  for (size_t t = 0; t < triangleCount; t++)
+  {
+    const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+    const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+    const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+    float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+    meshCenter += (p0 + p1 + p2) * (area / 3.0f);
+    meshArea += area;
+  }
+  if (meshArea > 0.0f)
+    meshCenter /= meshArea;
+
+  // sort key of every cluster: how far out it sits along its own average normal
+  size_t clusterCount = clusterStart.size() - 1;
+  ScratchVector<float> clusterKey(clusterCount);
+  for (size_t c = 0; c < clusterCount; c++)
+  {
+    glm::vec3 center(0.0f), normal(0.0f);
+    float area = 0.0f;
+    for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+    {
+      const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+      const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+      const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+      glm::vec3 n = glm::cross(p1 - p0, p2 - p0); // length is twice the area
+      float a = glm::length(n);
+      center += (p0 + p1 + p2) * (a / 3.0f);
+      normal += n;
+      area += a;
+    }
+    if (area > 0.0f)
+      center /= area;
+    float normalLength = glm::length(normal);
+    clusterKey[c] = normalLength > 0.0f ? glm::dot(center - meshCenter, normal / normalLength) : 0.0f;
+  }
+
+  ScratchVector<unsigned int> order(clusterCount);
+  for (size_t c = 0; c < clusterCount; c++)
+    order[c] = c;
+  std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+                   { return clusterKey[a] > clusterKey[b]; });
+
+  vector<unsigned int> result;
+  result.reserve(indices.size());
+  for (unsigned int c : order)
+    result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+  indices.swap(result);
+}
+
+// reorders vertices in the order they are first referenced by the index buffer so that vertex fetch walks memory
+// linearly. Unreferenced vertices are dropped.
+void OptimizeVertexFetch(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+  const unsigned int unused = ~0u;
+  ScratchVector<unsigned int> remap(vertices.size(), unused);
+  vector<Vertex> result;
+  result.reserve(vertices.size());
+  for (unsigned int &index : indices)
+  {
+    if (remap[index] == unused)
+    {
+      remap[index] = result.size();
+      result.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices.swap(result);
+}
+#endif
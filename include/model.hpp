@@ -10,9 +10,18 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "arena.hpp"
+#include "gpu_resources.hpp"
 #include "mesh.hpp"
+#include "mesh_optimizer.hpp"
+#include "profiler.hpp"
 #include "shader.hpp"
+#include "sphere.hpp"
+#include "texture_cache.hpp"
 
+#include <algorithm>
+#include <climits>
+#include <cstdio>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -21,48 +30,270 @@
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+// textures are halved on load until neither side exceeds this, so that masks and layers far finer than the albedo
+// they go with don't take their full size on the GPU
+const int MAX_TEXTURE_SIZE = 4096;
+
+TextureHandle TextureFromFile(const char *path, const string &directory, bool gamma = false);
+TextureHandle TextureFromPixels(const unsigned char *pixels, int width, int height, int components, const string &filename,
+                                unsigned long *gpuBytes = nullptr);
 
 class Model
 {
 public:
   // model data
-  vector<Texture> textures_loaded; // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+  vector<SharedTexture> textures_loaded; // textures used by the model, shared with other models through the TextureCache
   vector<Mesh> meshes;
   string directory;
+  string path;
   bool gammaCorrection;
+  // bounding sphere in model space, and the radius of the largest sphere around the same center that is still inside
+  // the surface (only meaningful for convex models like the planets), for culling
+  glm::vec3 boundsCenter = glm::vec3(0.0f);
+  float boundsRadius = 0.0f;
+  float innerRadius = 0.0f;
+
+  // constructor, expects a filepath to a 3D model. With load the model is imported and uploaded right away, otherwise it
+  // stays empty until Import() and then Upload() are called, which is how models are streamed in
+  Model(string const &path, bool gamma = false, bool load = true) : path(path), gammaCorrection(gamma)
+  {
+    if (load)
+      ImportAndUpload();
+  }
+  // procedural body: a unit cube-sphere of the given subdivisions (see GenerateSphere()) with an image as diffuse
+  // texture. The geometry is shared with every other sphere of the same subdivisions. load works as above
+  Model(unsigned int sphereSubdivisions, string const &texturePath, bool load = true)
+      : Model(sphereSubdivisions, vector<Texture>{{0, "texture_diffuse", texturePath}}, load)
+  {
+  }
+  // same with several images, each Texture giving the type (texture_diffuse, texture_specular, texture_clouds, ...)
+  // and the path of one
+  Model(unsigned int sphereSubdivisions, const vector<Texture> &textures, bool load = true)
+      : path(spherePath(sphereSubdivisions, textures)), gammaCorrection(false), sphereSubdivisions(sphereSubdivisions),
+        sphereTextures(textures)
+  {
+    if (load)
+      ImportAndUpload();
+  }
+  // model made of meshes built in code, uploaded right away. name stands in for the path in the GPU resource registry
+  Model(string const &name, vector<Mesh> &&meshes) : meshes(std::move(meshes)), path(name), gammaCorrection(false)
+  {
+    GpuResourceOwner owner(path);
+    for (Mesh &mesh : this->meshes)
+      mesh.Upload();
+    computeBounds();
+    ready = true;
+  }
+  // the model owns its GL objects through its meshes and shares its textures, it can be moved but not copied
+  Model(Model &&) = default;
+  Model &operator=(Model &&) = default;
+  Model(const Model &) = delete;
+  Model &operator=(const Model &) = delete;
+
+  // reads the file (or builds the sphere), builds the meshes and decodes the textures. Touches neither GL nor the GPU
+  // resource registry, so it can run on any thread
+  void Import()
+  {
+    if (sphereSubdivisions > 0)
+      buildSphere();
+    else
+      loadModel(path);
+  }
+
+  // textures Import() left to the TextureCache were evicted before Upload() got them: DecodeTextures() has to run,
+  // off the GL thread, before the upload can go on
+  bool NeedsDecode() const
+  {
+    return needsDecode;
+  }
+
+  // decodes the textures still to upload that Import() left to the TextureCache and it no longer has. Any thread
+  void DecodeTextures()
+  {
+    for (size_t i = nextTexture; i < pendingTextures.size(); i++)
+      if (!pendingTextures[i].decoded && !TextureCache::Instance().Contains(pendingTextures[i].file))
+        decodeTexture(pendingTextures[i]);
+    needsDecode = false;
+  }
+
+  // Import() and Upload() at once, on the GL thread
+  void ImportAndUpload()
+  {
+    Import();
+    long unlimited = LONG_MAX;
+    while (!Upload(unlimited))
+      DecodeTextures();
+  }
 
-  // constructor, expects a filepath to a 3D model.
-  Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+  // GL thread, after Import(): creates the textures, then the buffers of the meshes, until everything is uploaded or
+  // budget (bytes, decremented) runs out. At least one texture or mesh is uploaded per call. Returns true once the
+  // model can be drawn, false when out of budget or when NeedsDecode()
+  bool Upload(long &budget)
   {
-    loadModel(path);
+    PROFILE_ZONE("upload model");
+    // every texture and buffer created for the model belongs to it
+    GpuResourceOwner owner(path);
+    bool first = true;
+    for (; nextTexture < pendingTextures.size() && (first || budget > 0); nextTexture++, first = false)
+    {
+      PendingTexture &pending = pendingTextures[nextTexture];
+      pending.texture = TextureCache::Instance().Find(pending.file);
+      if (!pending.texture)
+      {
+        // evicted since Import() found it, decoding it here would stall the frame
+        if (!pending.decoded)
+        {
+          needsDecode = true;
+          return false;
+        }
+        unsigned long bytes;
+        TextureHandle handle =
+            TextureFromPixels(pending.pixels.get(), pending.width, pending.height, pending.components, pending.file.path, &bytes);
+        pending.texture = TextureCache::Instance().Insert(pending.file, std::move(handle), bytes);
+        budget -= bytes;
+      }
+      // keep it alive as long as the model
+      if (std::find(textures_loaded.begin(), textures_loaded.end(), pending.texture) == textures_loaded.end())
+        textures_loaded.push_back(pending.texture);
+    }
+    if (nextTexture < pendingTextures.size())
+      return false;
+    // the meshes get their texture names once all of them exist
+    if (nextMesh == 0)
+      for (Mesh &mesh : meshes)
+        for (Texture &texture : mesh.textures)
+          for (const PendingTexture &pending : pendingTextures)
+            if (pending.materialPath == texture.path)
+              texture.id = pending.texture->handle.Id();
+    for (; nextMesh < meshes.size() && (first || budget > 0); nextMesh++, first = false)
+    {
+      meshes[nextMesh].Upload();
+      budget -= meshes[nextMesh].VertexBufferSize() + meshes[nextMesh].IndexBufferSize();
+    }
+    if (nextMesh < meshes.size())
+      return false;
+    pendingTextures.clear();
+    ready = true;
+    return true;
+  }
+
+  bool Ready() const
+  {
+    return ready;
   }
 
-  // draws the model, and thus all its meshes
-  void Draw(Shader &shader)
+  // draws the model, and thus all its meshes, instances times. Without bindTextures the meshes use the textures bound
+  // already, see MaterialLibrary
+  void Draw(Shader &shader, unsigned int instances = 1, bool bindTextures = true)
   {
     for (unsigned int i = 0; i < meshes.size(); i++)
-      meshes[i].Draw(shader);
+      meshes[i].Draw(shader, instances, bindTextures);
   }
 
 private:
+  // texture named by a material, read and decoded by Import() for Upload()
+  struct PendingTexture
+  {
+    string materialPath;
+    ImageFile file;
+    // decoded image, unless the texture cache already had it. Null with decoded if the image failed to load
+    bool decoded = false;
+    unique_ptr<unsigned char, void (*)(void *)> pixels{nullptr, stbi_image_free};
+    int width = 0, height = 0, components = 0;
+    SharedTexture texture;
+
+    PendingTexture(const string &materialPath, const string &path) : materialPath(materialPath), file(path) {}
+  };
+
+  vector<PendingTexture> pendingTextures;
+  size_t nextTexture = 0, nextMesh = 0;
+  bool ready = false, needsDecode = false;
+  // procedural sphere instead of a file
+  unsigned int sphereSubdivisions = 0;
+  vector<Texture> sphereTextures;
+
+  static string spherePath(unsigned int subdivisions, const vector<Texture> &textures)
+  {
+    string path = "sphere " + std::to_string(subdivisions);
+    for (const Texture &texture : textures)
+      path += " " + texture.path;
+    return path;
+  }
+
+  // the mesh of a procedural sphere, from the SphereCache
+  void buildSphere()
+  {
+    PROFILE_ZONE("build sphere");
+    shared_ptr<const SphereGeometry> sphere = SphereCache::Instance().Get(sphereSubdivisions);
+    for (const Texture &texture : sphereTextures)
+      readTexture(texture.path, texture.path);
+    meshes.emplace_back(sphere->vertices, sphere->indices, sphereTextures, false);
+    computeBounds();
+  }
+
   // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
   void loadModel(string const &path)
   {
+    PROFILE_ZONE("load model");
     // read file via ASSIMP
     Assimp::Importer importer;
     const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
     // check for errors
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
     {
-      cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+      printf("ERROR::ASSIMP:: %s\n", importer.GetErrorString());
+      fflush(stdout);
       return;
     }
     // retrieve the directory path of the filepath
     directory = path.substr(0, path.find_last_of('/'));
 
+    // scratch memory of the mesh optimizer, sized for the biggest mesh and reused for each of them
+    size_t maxVertices = 0, maxFaces = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+    {
+      maxVertices = std::max<size_t>(maxVertices, scene->mMeshes[i]->mNumVertices);
+      maxFaces = std::max<size_t>(maxFaces, scene->mMeshes[i]->mNumFaces);
+    }
+    Arena scratch(maxVertices * OPTIMIZER_SCRATCH_PER_VERTEX + maxFaces * OPTIMIZER_SCRATCH_PER_TRIANGLE);
+    ScratchScope scratchScope(scratch);
+
     // process ASSIMP's root node recursively
+    meshes.reserve(scene->mNumMeshes);
     processNode(scene->mRootNode, scene);
+    computeBounds();
+  }
+
+  // bounding sphere around the center of the bounding box, and the distance to the closest face plane
+  void computeBounds()
+  {
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (const Mesh &mesh : meshes)
+      for (const Vertex &vertex : mesh.vertices)
+      {
+        lo = glm::min(lo, vertex.Position);
+        hi = glm::max(hi, vertex.Position);
+      }
+    if (lo.x > hi.x)
+      return;
+    boundsCenter = (lo + hi) * 0.5f;
+    boundsRadius = 0.0f;
+    innerRadius = 1e30f;
+    for (const Mesh &mesh : meshes)
+    {
+      for (const Vertex &vertex : mesh.vertices)
+        boundsRadius = std::max(boundsRadius, glm::length(vertex.Position - boundsCenter));
+      for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+      {
+        const glm::vec3 &p0 = mesh.vertices[mesh.indices[i]].Position;
+        glm::vec3 n = glm::cross(mesh.vertices[mesh.indices[i + 1]].Position - p0, mesh.vertices[mesh.indices[i + 2]].Position - p0);
+        float length = glm::length(n);
+        if (length > 0.0f)
+          innerRadius = std::min(innerRadius, fabsf(glm::dot(p0 - boundsCenter, n / length)));
+      }
+    }
+    if (innerRadius > boundsRadius)
+      innerRadius = 0.0f;
   }
 
   // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -74,7 +305,7 @@ private:
       // the node object only contains indices to index the actual objects in the scene.
       // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
       aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-      meshes.push_back(processMesh(mesh, scene));
+      processMesh(mesh, scene);
     }
     // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
     for (unsigned int i = 0; i < node->mNumChildren; i++)
@@ -83,17 +314,22 @@ private:
     }
   }
 
-  Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+  // builds the mesh in place at the end of meshes
+  void processMesh(aiMesh *mesh, const aiScene *scene)
   {
-    // data to fill
+    // the working arrays of the previous mesh are gone
+    Arena::Scratch()->Reset();
+    // data to fill, the sizes are known up front
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
+    vertices.reserve(mesh->mNumVertices);
+    indices.reserve(mesh->mNumFaces * 3);
 
     // walk through each of the mesh's vertices
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
-      Vertex vertex;
+      Vertex vertex = {}; // zero unused attributes, vertices are compared bytewise when welding
       glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
       // positions
       vector.x = mesh->mVertices[i].x;
@@ -136,11 +372,25 @@ private:
     // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
     for (unsigned int i = 0; i < mesh->mNumFaces; i++)
     {
-      aiFace face = mesh->mFaces[i];
+      const aiFace &face = mesh->mFaces[i];
       // retrieve all indices of the face and store them in the indices vector
       for (unsigned int j = 0; j < face.mNumIndices; j++)
         indices.push_back(face.mIndices[j]);
     }
+    size_t vertexBytesBefore = vertices.size() * sizeof(Vertex);
+    size_t indexBytesBefore = indices.size() * sizeof(unsigned int);
+    // assimp gives one vertex per face corner, merge the identical ones so that triangles actually share vertices
+    WeldVertices(vertices, indices);
+    // reorder triangles for the post-transform cache and overdraw, then vertices for fetch locality
+    VertexCacheStats before = AnalyzeVertexCache(indices, vertices.size());
+    OptimizeVertexCache(indices, vertices.size());
+    OptimizeOverdraw(indices, vertices);
+    OptimizeVertexFetch(vertices, indices);
+    VertexCacheStats after = AnalyzeVertexCache(indices, vertices.size());
+    // the reports are built whole and written with one call, models import on several loader threads at once
+    std::ostringstream report;
+    report << "MESH::OPTIMIZE:: " << directory << " (" << mesh->mName.C_Str() << ") ACMR " << before.acmr << " -> " << after.acmr
+           << ", ATVR " << before.atvr << " -> " << after.atvr << "\n";
     // process materials
     aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
     // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -150,94 +400,159 @@ private:
     // specular: texture_specularN
     // normal: texture_normalN
 
+    textures.reserve(material->GetTextureCount(aiTextureType_DIFFUSE) + material->GetTextureCount(aiTextureType_SPECULAR) +
+                     material->GetTextureCount(aiTextureType_HEIGHT) + material->GetTextureCount(aiTextureType_AMBIENT));
     // 1. diffuse maps
-    vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+    loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
     // 2. specular maps
-    vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+    loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
     // 3. normal maps
-    std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+    loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
     // 4. height maps
-    std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+    loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", textures);
 
-    // return a mesh object created from the extracted mesh data
-    return Mesh(vertices, indices, textures);
+    // create the mesh from the extracted data, which it takes over
+    const Mesh &result = meshes.emplace_back(std::move(vertices), std::move(indices), std::move(textures), false);
+    report << "MESH::SIZE:: " << directory << " (" << mesh->mName.C_Str() << ") vertices " << vertexBytesBefore << " -> "
+           << result.VertexBufferSize() << " bytes, indices " << indexBytesBefore << " -> " << result.IndexBufferSize() << " bytes\n";
+    printf("%s", report.str().c_str());
+    fflush(stdout);
   }
 
-  // checks all material textures of a given type and loads the textures if they're not loaded yet.
-  // the required info is returned as a Texture struct.
-  vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+  // reads the image a material names unless it's read already, and decodes it unless the texture cache has it
+  void readTexture(const string &materialPath, const string &path)
+  {
+    for (const PendingTexture &pending : pendingTextures)
+      if (pending.materialPath == materialPath)
+        return;
+    PendingTexture &pending = pendingTextures.emplace_back(materialPath, path);
+    if (!TextureCache::Instance().Contains(pending.file))
+      decodeTexture(pending);
+  }
+
+  // decodes a texture's file, halved down to MAX_TEXTURE_SIZE
+  static void decodeTexture(PendingTexture &pending)
+  {
+    pending.decoded = true;
+    pending.pixels.reset(stbi_load_from_memory(pending.file.contents.data(), (int)pending.file.contents.size(), &pending.width,
+                                               &pending.height, &pending.components, 0));
+    // no two channel textures in GL 3.3 core without swizzles, use RGBA
+    if (pending.pixels && pending.components == 2)
+    {
+      pending.pixels.reset(stbi_load_from_memory(pending.file.contents.data(), (int)pending.file.contents.size(), &pending.width,
+                                                 &pending.height, &pending.components, 4));
+      pending.components = 4;
+    }
+    while (pending.pixels && std::max(pending.width, pending.height) > MAX_TEXTURE_SIZE)
+      halveImage(pending);
+  }
+
+  // 2x2 box filter of a decoded image, in place (an odd last row or column is dropped)
+  static void halveImage(PendingTexture &pending)
+  {
+    int width = std::max(1, pending.width / 2), height = std::max(1, pending.height / 2), components = pending.components;
+    int stepX = pending.width > 1 ? 1 : 0, stepY = pending.height > 1 ? 1 : 0;
+    unsigned char *pixels = pending.pixels.get();
+    for (int y = 0; y < height; y++)
+      for (int x = 0; x < width; x++)
+      {
+        const unsigned char *row0 = pixels + ((size_t)(y * 2) * pending.width + x * 2) * components;
+        const unsigned char *row1 = row0 + (size_t)stepY * pending.width * components;
+        unsigned char *out = pixels + ((size_t)y * width + x) * components;
+        for (int c = 0; c < components; c++)
+          out[c] = (unsigned char)((row0[c] + row0[stepX * components + c] + row1[c] + row1[stepX * components + c] + 2) / 4);
+      }
+    pending.width = width;
+    pending.height = height;
+  }
+
+  // checks all material textures of a given type and reads the ones not read yet, decoding those the texture cache
+  // doesn't have. The required info is appended to textures as Texture structs, named by Upload()
+  void loadMaterialTextures(aiMaterial *mat, aiTextureType type, const char *typeName, vector<Texture> &textures)
   {
-    vector<Texture> textures;
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
       aiString str;
       mat->GetTexture(type, i, &str);
-      // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-      bool skip = false;
-      for (unsigned int j = 0; j < textures_loaded.size(); j++)
-      {
-        if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-        {
-          textures.push_back(textures_loaded[j]);
-          skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-          break;
-        }
-      }
-      if (!skip)
-      { // if texture hasn't been loaded already, load it
-        Texture texture;
-        texture.id = TextureFromFile(str.C_Str(), this->directory);
-        texture.type = typeName;
-        texture.path = str.C_Str();
-        textures.push_back(texture);
-        textures_loaded.push_back(texture); // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-      }
+      readTexture(str.C_Str(), this->directory + '/' + str.C_Str());
+      Texture texture;
+      texture.id = 0;
+      texture.type = typeName;
+      texture.path = str.C_Str();
+      textures.push_back(std::move(texture));
     }
-    return textures;
   }
 };
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+TextureHandle TextureFromFile(const char *path, const string &directory, bool gamma)
 {
   string filename = string(path);
   filename = directory + '/' + filename;
 
-  unsigned int textureID;
-  glGenTextures(1, &textureID);
+  std::ifstream file(filename, std::ios::binary);
+  vector<unsigned char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  return TextureFromMemory(contents.data(), contents.size(), filename, gamma);
+}
 
+// decodes an image file read into memory and uploads it with mipmaps. gpuBytes receives the memory it takes
+TextureHandle TextureFromMemory(const unsigned char *bytes, size_t size, const string &filename, bool gamma, unsigned long *gpuBytes)
+{
   int width, height, nrComponents;
-  unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-  if (data)
+  unsigned char *data = stbi_load_from_memory(bytes, (int)size, &width, &height, &nrComponents, 0);
+  // no two channel textures in GL 3.3 core without swizzles, use RGBA
+  if (data && nrComponents == 2)
   {
-    GLenum format;
+    stbi_image_free(data);
+    data = stbi_load_from_memory(bytes, (int)size, &width, &height, &nrComponents, 4);
+    nrComponents = 4;
+  }
+  TextureHandle texture = TextureFromPixels(data, width, height, nrComponents, filename, gpuBytes);
+  stbi_image_free(data);
+  return texture;
+}
+
+// uploads a decoded image of 1, 3 or 4 components with mipmaps, an empty texture if pixels is null (the image failed to
+// load). Anything else is taken for RGBA, decode two channel images as such
+TextureHandle TextureFromPixels(const unsigned char *pixels, int width, int height, int nrComponents, const string &filename,
+                                unsigned long *gpuBytes)
+{
+  TextureHandle texture = TextureHandle::Generate();
+  unsigned int textureID = texture.Id();
+  if (gpuBytes)
+    *gpuBytes = 0;
+
+  if (pixels)
+  {
+    GLenum format = GL_RGBA;
     if (nrComponents == 1)
       format = GL_RED;
     else if (nrComponents == 3)
       format = GL_RGB;
-    else if (nrComponents == 4)
-      format = GL_RGBA;
+    else
+      nrComponents = 4;
 
     glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
     glGenerateMipmap(GL_TEXTURE_2D);
+    // the mip chain adds a third
+    unsigned long textureBytes = (unsigned long)width * height * nrComponents * 4 / 3;
+    if (gpuBytes)
+      *gpuBytes = textureBytes;
+    GpuResources::Instance().Register(GPU_TEXTURE, textureID, textureBytes,
+                                      string(nrComponents == 1 ? "R8 " : nrComponents == 3 ? "RGB8 " : "RGBA8 ") + std::to_string(width) +
+                                          "x" + std::to_string(height) + " +mips " + filename);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_image_free(data);
   }
   else
   {
-    std::cout << "Texture failed to load at path: " << path << std::endl;
-    stbi_image_free(data);
+    std::cout << "Texture failed to load at path: " << filename << std::endl;
+    GpuResources::Instance().Register(GPU_TEXTURE, textureID, 0, "empty " + filename);
   }
 
-  return textureID;
+  return texture;
 }
 #endif
@@ -0,0 +1,446 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "job_system.hpp"
+#include "model.hpp"
+#include "occlusion_rasterizer.hpp"
+#include "profiler.hpp"
+#include "shader.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Hi-Z pyramid base resolution, power of two so that every level halves exactly
+const int HIZ_WIDTH = 512;
+const int HIZ_HEIGHT = 256;
+// CPU depth buffer resolution
+const int SOFTWARE_DEPTH_WIDTH = 256;
+const int SOFTWARE_DEPTH_HEIGHT = 128;
+// most objects tested per frame on the GPU (width of the visibility target)
+const int MAX_OCCLUSION_OBJECTS = 4096;
+
+struct BoundingSphere
+{
+  glm::vec3 center;
+  float radius;
+};
+
+// something drawn this frame. Occluders hide what's behind them, they must be closed meshes around their bounds center
+struct OcclusionObject
+{
+  Model *model;
+  glm::mat4 transform;
+  bool occluder;
+};
+
+// bounding sphere of a model under a transform (radius scaled by the largest axis scale)
+BoundingSphere WorldBounds(const Model &model, const glm::mat4 &transform, bool inner = false)
+{
+  float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+  BoundingSphere sphere;
+  sphere.center = glm::vec3(transform * glm::vec4(model.boundsCenter, 1.0f));
+  sphere.radius = (inner ? model.innerRadius : model.boundsRadius) * scale;
+  return sphere;
+}
+
+// conservative screen rect (normalized [0,1] coordinates) and closest window depth of a sphere. Returns false if the
+// sphere touches the near plane, in which case nothing can be said about it
+bool ProjectSphere(const BoundingSphere &sphere, const glm::mat4 &view, const glm::mat4 &projection, glm::vec2 &lo, glm::vec2 &hi, float &nearestDepth)
+{
+  glm::vec3 c = glm::vec3(view * glm::vec4(sphere.center, 1.0f));
+  float r = sphere.radius;
+  float zNear = projection[3][2] / (projection[2][2] - 1.0f);
+  if (c.z + r > -zNear)
+    return false;
+  lo = glm::vec2(1.0f);
+  hi = glm::vec2(-1.0f);
+  for (int i = 0; i < 8; i++)
+  {
+    glm::vec3 p = c + glm::vec3(i & 1 ? r : -r, i & 2 ? r : -r, i & 4 ? r : -r);
+    glm::vec4 clip = projection * glm::vec4(p, 1.0f);
+    lo.x = std::min(lo.x, clip.x / clip.w);
+    lo.y = std::min(lo.y, clip.y / clip.w);
+    hi.x = std::max(hi.x, clip.x / clip.w);
+    hi.y = std::max(hi.y, clip.y / clip.w);
+  }
+  lo.x = glm::clamp(lo.x * 0.5f + 0.5f, 0.0f, 1.0f);
+  lo.y = glm::clamp(lo.y * 0.5f + 0.5f, 0.0f, 1.0f);
+  hi.x = glm::clamp(hi.x * 0.5f + 0.5f, 0.0f, 1.0f);
+  hi.y = glm::clamp(hi.y * 0.5f + 0.5f, 0.0f, 1.0f);
+  glm::vec4 nearest = projection * glm::vec4(0.0f, 0.0f, c.z + r, 1.0f);
+  nearestDepth = nearest.z / nearest.w * 0.5f + 0.5f;
+  return true;
+}
+
+// unit icosphere (one subdivision, 80 triangles, counterclockwise seen from outside). All its vertices lie on the
+// sphere, so scaled by a sphere's radius it is entirely inside that sphere, which makes it a conservative occluder proxy
+void OccluderProxy(vector<glm::vec3> &vertices, vector<unsigned int> &indices)
+{
+  const float t = (1.0f + sqrtf(5.0f)) / 2.0f;
+  vertices = {{-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0}, {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t}, {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}};
+  for (glm::vec3 &v : vertices)
+    v = glm::normalize(v);
+  vector<unsigned int> faces = {0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11, 1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+                                3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9, 4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1};
+  indices.clear();
+  for (size_t f = 0; f < faces.size(); f += 3)
+  {
+    // split every face in 4, new vertices pushed back onto the sphere
+    unsigned int a = faces[f], b = faces[f + 1], c = faces[f + 2];
+    unsigned int ab = vertices.size(), bc = ab + 1, ca = ab + 2;
+    vertices.push_back(glm::normalize(vertices[a] + vertices[b]));
+    vertices.push_back(glm::normalize(vertices[b] + vertices[c]));
+    vertices.push_back(glm::normalize(vertices[c] + vertices[a]));
+    unsigned int tris[] = {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca};
+    indices.insert(indices.end(), tris, tris + 12);
+  }
+}
+
+// simplified geometry a model occludes with, in model space
+struct OccluderMesh
+{
+  vector<glm::vec3> positions;
+  vector<unsigned int> indices;
+};
+
+// models up to this many triangles occlude with their own mesh, bigger ones with their inscribed icosphere
+const size_t OCCLUDER_TRIANGLE_BUDGET = 256;
+// occluders covering fewer pixels of the software depth buffer than this (bounding sphere diameter) are not drawn,
+// they hide next to nothing
+const float OCCLUDER_MIN_PIXELS = 4.0f;
+
+// Occlusion culling of whole objects against a few large occluders (the planets).
+// GPU: occluders are drawn depth only into a 512x256 target, reduced into a Hi-Z (max depth) mip pyramid, and every
+// object's bounding sphere is tested against the pyramid level where it covers at most 2x2 texels, one point per
+// object into a visibility row that is read back asynchronously: results are applied one frame late so that the CPU
+// never waits for the GPU.
+// CPU: simplified occluders (small meshes as is, inscribed icospheres of the others) are rasterized into a small
+// tiled depth buffer on the job system's threads, and the spheres are tested against it right away. Meant for
+// software GL, where the GPU path costs as much as drawing.
+class OcclusionCuller
+{
+public:
+  enum Mode
+  {
+    OFF,
+    GPU,
+    CPU
+  };
+  Mode mode = GPU;
+
+  OcclusionCuller(const string &shaderDirectory, JobSystem &jobs)
+      : depthShader((shaderDirectory + "/planets.vs").c_str(), (shaderDirectory + "/depth.fs").c_str()),
+        downsampleShader((shaderDirectory + "/fullscreen.vs").c_str(), (shaderDirectory + "/hiz_downsample.fs").c_str()),
+        testShader((shaderDirectory + "/hiz_test.vs").c_str(), (shaderDirectory + "/hiz_test.fs").c_str()),
+        jobs(jobs), rasterizer(SOFTWARE_DEPTH_WIDTH, SOFTWARE_DEPTH_HEIGHT, jobs)
+  {
+    // depth pyramid
+    levels = 1;
+    while ((HIZ_WIDTH >> levels) > 0 && (HIZ_HEIGHT >> levels) > 0)
+      levels++;
+    glGenTextures(1, &pyramid);
+    glBindTexture(GL_TEXTURE_2D, pyramid);
+    for (int level = 0; level < levels; level++)
+      glTexImage2D(GL_TEXTURE_2D, level, GL_DEPTH_COMPONENT32F, HIZ_WIDTH >> level, HIZ_HEIGHT >> level, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glGenFramebuffers(1, &pyramidFramebuffer);
+
+    // visibility row and its readback buffer
+    glGenTextures(1, &visibilityTexture);
+    glBindTexture(GL_TEXTURE_2D, visibilityTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, MAX_OCCLUSION_OBJECTS, 1, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &visibilityFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, visibilityFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, visibilityTexture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glGenBuffers(1, &readbackBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, MAX_OCCLUSION_OBJECTS, NULL, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // one vec4 sphere per object
+    glGenVertexArrays(1, &sphereVAO);
+    glGenBuffers(1, &sphereBuffer);
+    glBindVertexArray(sphereVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, sphereBuffer);
+    glBufferData(GL_ARRAY_BUFFER, MAX_OCCLUSION_OBJECTS * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void *)0);
+    glBindVertexArray(0);
+    glGenVertexArrays(1, &emptyVAO);
+  }
+  OcclusionCuller(const OcclusionCuller &) = delete;
+  OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+  ~OcclusionCuller()
+  {
+    if (fence)
+      glDeleteSync(fence);
+    unsigned int textures[] = {pyramid, visibilityTexture};
+    glDeleteTextures(2, textures);
+    unsigned int framebuffers[] = {pyramidFramebuffer, visibilityFramebuffer};
+    glDeleteFramebuffers(2, framebuffers);
+    unsigned int buffers[] = {readbackBuffer, sphereBuffer};
+    glDeleteBuffers(2, buffers);
+    unsigned int vaos[] = {sphereVAO, emptyVAO};
+    glDeleteVertexArrays(2, vaos);
+  }
+
+  // shaders to hot reload
+  vector<Shader *> Shaders()
+  {
+    return {&depthShader, &downsampleShader, &testShader};
+  }
+
+  // software rasterizer of the CPU path, for its stats
+  const OcclusionRasterizer &Rasterizer() const
+  {
+    return rasterizer;
+  }
+
+  // decides which of objectCount objects to draw, into visible[objectCount]. Leaves the default framebuffer bound with
+  // the viewport reset to width x height
+  void Cull(const OcclusionObject *objects, size_t objectCount, const glm::mat4 &view, const glm::mat4 &projection, int width, int height,
+            bool *visible)
+  {
+    PROFILE_ZONE("occlusion culling");
+    auto start = std::chrono::steady_clock::now();
+    // objects past the GPU's limit are always drawn
+    size_t count = mode == GPU ? std::min<size_t>(objectCount, MAX_OCCLUSION_OBJECTS) : objectCount;
+    std::fill(visible, visible + objectCount, true);
+    if (mode == GPU)
+      cullGPU(objects, count, view, projection, visible);
+    else if (mode == CPU)
+      cullCPU(objects, count, view, projection, visible);
+    if (mode != OFF)
+    {
+      frameStats.occlusionTested += count;
+      for (size_t i = 0; i < count; i++)
+        frameStats.occlusionCulled += !visible[i];
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
+    frameStats.cullingMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+private:
+  Shader depthShader, downsampleShader, testShader;
+  JobSystem &jobs;
+  OcclusionRasterizer rasterizer;
+  std::map<const Model *, OccluderMesh> occluderMeshes;
+  vector<glm::vec4> spheres;
+  int levels;
+  unsigned int pyramid, pyramidFramebuffer, visibilityTexture, visibilityFramebuffer, readbackBuffer, sphereVAO, sphereBuffer, emptyVAO;
+  // readback of the previous frame's test, and the models it tested: results only apply to the same object list
+  GLsync fence = 0;
+  size_t pendingCount = 0;
+  vector<const Model *> pendingModels, lastModels;
+  vector<bool> lastVisible;
+
+  // the objects are those the last results are for, one model per index
+  bool sameObjects(const OcclusionObject *objects, size_t count) const
+  {
+    if (lastModels.size() != count)
+      return false;
+    for (size_t i = 0; i < count; i++)
+      if (lastModels[i] != objects[i].model)
+        return false;
+    return true;
+  }
+
+  void cullGPU(const OcclusionObject *objects, size_t count, const glm::mat4 &view, const glm::mat4 &projection, bool *visible)
+  {
+    // collect last frame's results if the GPU is done with them, otherwise keep the ones before
+    if (fence && glClientWaitSync(fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+    {
+      glDeleteSync(fence);
+      fence = 0;
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+      const unsigned char *result = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pendingCount, GL_MAP_READ_BIT);
+      if (result)
+      {
+        lastVisible.assign(pendingCount, true);
+        for (size_t i = 0; i < pendingCount; i++)
+          lastVisible[i] = result[i] != 0;
+        lastModels.swap(pendingModels);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      }
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    // the list changed since (asteroids regenerated, placeholders swapped, impostors picked): everything is drawn
+    // until a test of the new list is back
+    if (!sameObjects(objects, count))
+    {
+      lastVisible.clear();
+      lastModels.clear();
+    }
+    for (size_t i = 0; i < lastVisible.size(); i++)
+      visible[i] = lastVisible[i];
+    // a test is still in flight, don't queue another one
+    if (fence)
+      return;
+
+    PROFILE_GPU_ZONE("hi-z occlusion");
+    // 1. depth pre-pass of the occluders
+    glBindTexture(GL_TEXTURE_2D, pyramid);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, pyramidFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, pyramid, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glViewport(0, 0, HIZ_WIDTH, HIZ_HEIGHT);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    depthShader.use();
+    depthShader.setMat4("view", view);
+    depthShader.setMat4("projection", projection);
+    for (size_t i = 0; i < count; i++)
+    {
+      if (!objects[i].occluder)
+        continue;
+      depthShader.setMat4("model", objects[i].transform);
+      depthShader.setMat4("InvTransModel", glm::transpose(glm::inverse(objects[i].transform)));
+      // depth only, no textures to bind
+      objects[i].model->Draw(depthShader, 1, false);
+    }
+
+    // 2. max depth pyramid, each level rendered from the one above it
+    glDepthFunc(GL_ALWAYS);
+    downsampleShader.use();
+    downsampleShader.setInt("depthPyramid", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, pyramid);
+    glBindVertexArray(emptyVAO);
+    for (int level = 1; level < levels; level++)
+    {
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, pyramid, level);
+      glViewport(0, 0, HIZ_WIDTH >> level, HIZ_HEIGHT >> level);
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glDepthFunc(GL_LESS);
+
+    // 3. one point per object into the visibility row
+    spheres.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      BoundingSphere sphere = WorldBounds(*objects[i].model, objects[i].transform);
+      spheres[i] = glm::vec4(sphere.center, sphere.radius);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, sphereBuffer);
+    glBufferData(GL_ARRAY_BUFFER, MAX_OCCLUSION_OBJECTS * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+    if (count > 0)
+      glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec4), &spheres[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, visibilityFramebuffer);
+    glViewport(0, 0, count, 1);
+    glDisable(GL_DEPTH_TEST);
+    testShader.use();
+    testShader.setMat4("view", view);
+    testShader.setMat4("projection", projection);
+    testShader.setInt("depthPyramid", 0);
+    testShader.setInt("levels", levels);
+    testShader.setInt("objectCount", count);
+    glBindVertexArray(sphereVAO);
+    glDrawArrays(GL_POINTS, 0, count);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // 4. asynchronous readback
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, count, 1, GL_RED, GL_UNSIGNED_BYTE, (void *)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pendingCount = count;
+    pendingModels.clear();
+    for (size_t i = 0; i < count; i++)
+      pendingModels.push_back(objects[i].model);
+  }
+
+  // occluder geometry of a model, built the first time it's needed
+  const OccluderMesh &occluderMesh(const Model &model)
+  {
+    auto found = occluderMeshes.find(&model);
+    if (found != occluderMeshes.end())
+      return found->second;
+    OccluderMesh &occluder = occluderMeshes[&model];
+    size_t triangles = 0;
+    for (const Mesh &mesh : model.meshes)
+      triangles += mesh.indices.size() / 3;
+    if (triangles <= OCCLUDER_TRIANGLE_BUDGET)
+    {
+      for (const Mesh &mesh : model.meshes)
+      {
+        unsigned int base = occluder.positions.size();
+        for (const Vertex &vertex : mesh.vertices)
+          occluder.positions.push_back(vertex.Position);
+        for (unsigned int index : mesh.indices)
+          occluder.indices.push_back(base + index);
+      }
+    }
+    else if (model.innerRadius > 0.0f)
+    {
+      OccluderProxy(occluder.positions, occluder.indices);
+      for (glm::vec3 &position : occluder.positions)
+        position = model.boundsCenter + position * model.innerRadius;
+    }
+    return occluder;
+  }
+
+  void cullCPU(const OcclusionObject *objects, size_t count, const glm::mat4 &view, const glm::mat4 &projection, bool *visible)
+  {
+    glm::mat4 viewProjection = projection * view;
+    rasterizer.Begin();
+    for (size_t i = 0; i < count; i++)
+    {
+      if (!objects[i].occluder)
+        continue;
+      // occluders touching the near plane are always drawn, only their triangles crossing it are dropped
+      glm::vec2 lo, hi;
+      float nearestDepth;
+      if (ProjectSphere(WorldBounds(*objects[i].model, objects[i].transform), view, projection, lo, hi, nearestDepth) &&
+          std::max((hi.x - lo.x) * rasterizer.Width(), (hi.y - lo.y) * rasterizer.Height()) < OCCLUDER_MIN_PIXELS)
+        continue;
+      const OccluderMesh &occluder = occluderMesh(*objects[i].model);
+      if (!occluder.indices.empty())
+        rasterizer.AddOccluder(occluder.positions, occluder.indices, viewProjection * objects[i].transform);
+    }
+    rasterizer.Render();
+
+    // tests in batches of 64 objects
+    jobs.ParallelFor((count + 63) / 64, [&](unsigned int batch)
+                     {
+                       PROFILE_ZONE("occlusion tests");
+                       for (size_t i = batch * 64; i < std::min<size_t>(count, batch * 64 + 64); i++)
+                       {
+                         glm::vec2 lo, hi;
+                         float nearestDepth;
+                         visible[i] = !ProjectSphere(WorldBounds(*objects[i].model, objects[i].transform), view, projection, lo, hi, nearestDepth) ||
+                                      rasterizer.Visible(lo, hi, nearestDepth);
+                       } });
+  }
+};
+#endif
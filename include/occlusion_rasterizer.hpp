@@ -0,0 +1,288 @@
+#ifndef OCCLUSION_RASTERIZER_H
+#define OCCLUSION_RASTERIZER_H
+
+#include <glm/glm.hpp>
+
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+// depth buffer tiles, 4KB each so that a tile stays in L1 while its triangles are rasterized. Widths are multiples of 4
+// for the SSE loops
+const int OCCLUSION_TILE_WIDTH = 32;
+const int OCCLUSION_TILE_HEIGHT = 32;
+
+// Coarse depth rasterizer for occlusion culling on the CPU. Occluders are queued with AddOccluder(), Render() then
+// transforms and bins their triangles into screen tiles in parallel, and rasterizes every tile in parallel, 4 pixels
+// at a time with SSE2 (scalar loop on other targets). Stores the closest window depth [0,1] per pixel and the farthest
+// depth per tile, which most Visible() tests stop at.
+class OcclusionRasterizer
+{
+public:
+  // rasterization stats of the last Render()
+  unsigned long TrianglesRasterized = 0;
+  float RenderMilliseconds = 0.0f;
+
+  // width and height are rounded up to whole tiles
+  OcclusionRasterizer(int width, int height, JobSystem &jobs) : jobs(jobs)
+  {
+    tilesX = (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+    tilesY = (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+    this->width = tilesX * OCCLUSION_TILE_WIDTH;
+    this->height = tilesY * OCCLUSION_TILE_HEIGHT;
+    depth.assign(this->width * this->height, 1.0f);
+    tileMax.assign(tilesX * tilesY, 1.0f);
+    // a few batches per thread to balance uneven occluders
+    batches.resize(jobs.ThreadCount() * 4);
+    for (Batch &batch : batches)
+      batch.bins.resize(tilesX * tilesY);
+  }
+
+  int Width() const
+  {
+    return width;
+  }
+  int Height() const
+  {
+    return height;
+  }
+
+  void Begin()
+  {
+    occluders.clear();
+  }
+
+  // queues a closed, counterclockwise wound mesh. The vectors must stay alive until Render()
+  void AddOccluder(const vector<glm::vec3> &positions, const vector<unsigned int> &indices, const glm::mat4 &modelViewProjection)
+  {
+    occluders.push_back({&positions, &indices, modelViewProjection});
+  }
+
+  void Render()
+  {
+    auto start = std::chrono::steady_clock::now();
+    // 1. transform, set up and bin the triangles of a contiguous range of occluders per batch
+    jobs.ParallelFor(batches.size(), [this](unsigned int b)
+                     { setupBatch(b); });
+    // 2. rasterize every tile with the triangles all batches binned to it
+    jobs.ParallelFor(tilesX * tilesY, [this](unsigned int tile)
+                     { rasterizeTile(tile); });
+    TrianglesRasterized = 0;
+    for (const Batch &batch : batches)
+      TrianglesRasterized += batch.triangles.size();
+    RenderMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // true if some part of the rect (normalized [0,1] coordinates) could be closer than the occluders
+  bool Visible(const glm::vec2 &lo, const glm::vec2 &hi, float nearestDepth) const
+  {
+    int x0 = std::min(int(lo.x * width), width - 1), x1 = std::min(int(hi.x * width), width - 1);
+    int y0 = std::min(int(lo.y * height), height - 1), y1 = std::min(int(hi.y * height), height - 1);
+    for (int ty = y0 / OCCLUSION_TILE_HEIGHT; ty <= y1 / OCCLUSION_TILE_HEIGHT; ty++)
+    {
+      for (int tx = x0 / OCCLUSION_TILE_WIDTH; tx <= x1 / OCCLUSION_TILE_WIDTH; tx++)
+      {
+        int tile = ty * tilesX + tx;
+        // everything in this tile is in front
+        if (nearestDepth > tileMax[tile])
+          continue;
+        const float *tileDepth = &depth[tile * OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT];
+        int px0 = std::max(x0 - tx * OCCLUSION_TILE_WIDTH, 0), px1 = std::min(x1 - tx * OCCLUSION_TILE_WIDTH, OCCLUSION_TILE_WIDTH - 1);
+        int py0 = std::max(y0 - ty * OCCLUSION_TILE_HEIGHT, 0), py1 = std::min(y1 - ty * OCCLUSION_TILE_HEIGHT, OCCLUSION_TILE_HEIGHT - 1);
+        for (int y = py0; y <= py1; y++)
+          for (int x = px0; x <= px1; x++)
+            if (nearestDepth <= tileDepth[y * OCCLUSION_TILE_WIDTH + x])
+              return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  struct Occluder
+  {
+    const vector<glm::vec3> *positions;
+    const vector<unsigned int> *indices;
+    glm::mat4 modelViewProjection;
+  };
+
+  // edge functions and depth plane in pixel coordinates: inside where all three edges are >= 0 at the pixel center,
+  // depth = depthA * x + depthB * y + depthC
+  struct ScreenTriangle
+  {
+    float edgeA[3], edgeB[3], edgeC[3];
+    float depthA, depthB, depthC;
+    int minX, minY, maxX, maxY;
+  };
+
+  struct Batch
+  {
+    vector<glm::vec4> clip;
+    vector<ScreenTriangle> triangles;
+    // triangle indices per tile
+    vector<vector<unsigned int>> bins;
+  };
+
+  JobSystem &jobs;
+  int width, height, tilesX, tilesY;
+  // tile major: the pixels of a tile are contiguous
+  vector<float> depth;
+  vector<float> tileMax;
+  vector<Occluder> occluders;
+  vector<Batch> batches;
+
+  void setupBatch(unsigned int b)
+  {
+    PROFILE_ZONE("occluder setup");
+    Batch &batch = batches[b];
+    batch.triangles.clear();
+    for (vector<unsigned int> &bin : batch.bins)
+      bin.clear();
+    size_t first = occluders.size() * b / batches.size(), last = occluders.size() * (b + 1) / batches.size();
+    for (size_t o = first; o < last; o++)
+    {
+      const Occluder &occluder = occluders[o];
+      const vector<glm::vec3> &positions = *occluder.positions;
+      batch.clip.resize(positions.size());
+      for (size_t v = 0; v < positions.size(); v++)
+        batch.clip[v] = occluder.modelViewProjection * glm::vec4(positions[v], 1.0f);
+      const vector<unsigned int> &indices = *occluder.indices;
+      for (size_t i = 0; i + 2 < indices.size(); i += 3)
+      {
+        ScreenTriangle triangle;
+        if (!setupTriangle(batch.clip[indices[i]], batch.clip[indices[i + 1]], batch.clip[indices[i + 2]], triangle))
+          continue;
+        unsigned int index = batch.triangles.size();
+        batch.triangles.push_back(triangle);
+        for (int ty = triangle.minY / OCCLUSION_TILE_HEIGHT; ty <= triangle.maxY / OCCLUSION_TILE_HEIGHT; ty++)
+          for (int tx = triangle.minX / OCCLUSION_TILE_WIDTH; tx <= triangle.maxX / OCCLUSION_TILE_WIDTH; tx++)
+            batch.bins[ty * tilesX + tx].push_back(index);
+      }
+    }
+  }
+
+  // false for triangles that are back facing, cover no pixel center or cross the near plane (skipping those only makes
+  // the occluder smaller)
+  bool setupTriangle(const glm::vec4 &c0, const glm::vec4 &c1, const glm::vec4 &c2, ScreenTriangle &t) const
+  {
+    if (c0.w <= 0.0f || c1.w <= 0.0f || c2.w <= 0.0f || c0.z < -c0.w || c1.z < -c1.w || c2.z < -c2.w)
+      return false;
+    glm::vec3 p[3];
+    const glm::vec4 *c[3] = {&c0, &c1, &c2};
+    for (int k = 0; k < 3; k++)
+      p[k] = glm::vec3((c[k]->x / c[k]->w * 0.5f + 0.5f) * width, (c[k]->y / c[k]->w * 0.5f + 0.5f) * height,
+                       c[k]->z / c[k]->w * 0.5f + 0.5f);
+    float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+    if (area <= 0.0f)
+      return false;
+    // pixels whose center is inside the bounding box, clamped before conversion since vertices close to the camera
+    // plane project very far
+    t.minX = (int)ceilf(glm::clamp(std::min(p[0].x, std::min(p[1].x, p[2].x)) - 0.5f, 0.0f, (float)width));
+    t.maxX = (int)floorf(glm::clamp(std::max(p[0].x, std::max(p[1].x, p[2].x)) - 0.5f, -1.0f, width - 1.0f));
+    t.minY = (int)ceilf(glm::clamp(std::min(p[0].y, std::min(p[1].y, p[2].y)) - 0.5f, 0.0f, (float)height));
+    t.maxY = (int)floorf(glm::clamp(std::max(p[0].y, std::max(p[1].y, p[2].y)) - 0.5f, -1.0f, height - 1.0f));
+    if (t.minX > t.maxX || t.minY > t.maxY)
+      return false;
+    // edge k goes from vertex k to the next one and weights the opposite vertex
+    for (int k = 0; k < 3; k++)
+    {
+      const glm::vec3 &a = p[k], &b = p[(k + 1) % 3];
+      t.edgeA[k] = a.y - b.y;
+      t.edgeB[k] = b.x - a.x;
+      t.edgeC[k] = -t.edgeA[k] * a.x - t.edgeB[k] * a.y;
+    }
+    float invArea = 1.0f / area;
+    t.depthA = (t.edgeA[1] * p[0].z + t.edgeA[2] * p[1].z + t.edgeA[0] * p[2].z) * invArea;
+    t.depthB = (t.edgeB[1] * p[0].z + t.edgeB[2] * p[1].z + t.edgeB[0] * p[2].z) * invArea;
+    t.depthC = (t.edgeC[1] * p[0].z + t.edgeC[2] * p[1].z + t.edgeC[0] * p[2].z) * invArea;
+    return true;
+  }
+
+  void rasterizeTile(unsigned int tile)
+  {
+    PROFILE_ZONE("occluder raster");
+    float *tileDepth = &depth[tile * OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT];
+    std::fill(tileDepth, tileDepth + OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT, 1.0f);
+    int tileX = (tile % tilesX) * OCCLUSION_TILE_WIDTH, tileY = (tile / tilesX) * OCCLUSION_TILE_HEIGHT;
+    for (const Batch &batch : batches)
+      for (unsigned int index : batch.bins[tile])
+        rasterizeTriangle(batch.triangles[index], tileDepth, tileX, tileY);
+
+    float farthest = 0.0f;
+#ifdef __SSE2__
+    __m128 farthest4 = _mm_setzero_ps();
+    for (int i = 0; i < OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT; i += 4)
+      farthest4 = _mm_max_ps(farthest4, _mm_loadu_ps(tileDepth + i));
+    float lanes[4];
+    _mm_storeu_ps(lanes, farthest4);
+    farthest = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#else
+    for (int i = 0; i < OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT; i++)
+      farthest = std::max(farthest, tileDepth[i]);
+#endif
+    tileMax[tile] = farthest;
+  }
+
+  void rasterizeTriangle(const ScreenTriangle &t, float *tileDepth, int tileX, int tileY) const
+  {
+    int x0 = std::max(t.minX, tileX), x1 = std::min(t.maxX, tileX + OCCLUSION_TILE_WIDTH - 1);
+    int y0 = std::max(t.minY, tileY), y1 = std::min(t.maxY, tileY + OCCLUSION_TILE_HEIGHT - 1);
+#ifdef __SSE2__
+    // groups of 4 pixels starting on a multiple of 4, which never cross the tile edge
+    x0 &= ~3;
+    __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 a0 = _mm_set1_ps(t.edgeA[0]), a1 = _mm_set1_ps(t.edgeA[1]), a2 = _mm_set1_ps(t.edgeA[2]), az = _mm_set1_ps(t.depthA);
+    __m128 step0 = _mm_set1_ps(t.edgeA[0] * 4.0f), step1 = _mm_set1_ps(t.edgeA[1] * 4.0f), step2 = _mm_set1_ps(t.edgeA[2] * 4.0f),
+           stepz = _mm_set1_ps(t.depthA * 4.0f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 px = _mm_add_ps(_mm_set1_ps((float)x0), offsets);
+    for (int y = y0; y <= y1; y++)
+    {
+      float py = y + 0.5f;
+      __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), _mm_set1_ps(t.edgeB[0] * py + t.edgeC[0]));
+      __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), _mm_set1_ps(t.edgeB[1] * py + t.edgeC[1]));
+      __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), _mm_set1_ps(t.edgeB[2] * py + t.edgeC[2]));
+      __m128 z = _mm_add_ps(_mm_mul_ps(az, px), _mm_set1_ps(t.depthB * py + t.depthC));
+      float *row = tileDepth + (y - tileY) * OCCLUSION_TILE_WIDTH;
+      for (int x = x0; x <= x1; x += 4)
+      {
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+        if (_mm_movemask_ps(inside))
+        {
+          __m128 old = _mm_loadu_ps(row + x - tileX);
+          __m128 closer = _mm_min_ps(old, z);
+          _mm_storeu_ps(row + x - tileX, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old)));
+        }
+        e0 = _mm_add_ps(e0, step0);
+        e1 = _mm_add_ps(e1, step1);
+        e2 = _mm_add_ps(e2, step2);
+        z = _mm_add_ps(z, stepz);
+      }
+    }
+#else
+    for (int y = y0; y <= y1; y++)
+    {
+      float py = y + 0.5f;
+      float *row = tileDepth + (y - tileY) * OCCLUSION_TILE_WIDTH;
+      for (int x = x0; x <= x1; x++)
+      {
+        float px = x + 0.5f;
+        if (t.edgeA[0] * px + t.edgeB[0] * py + t.edgeC[0] < 0.0f || t.edgeA[1] * px + t.edgeB[1] * py + t.edgeC[1] < 0.0f ||
+            t.edgeA[2] * px + t.edgeB[2] * py + t.edgeC[2] < 0.0f)
+          continue;
+        row[x - tileX] = std::min(row[x - tileX], t.depthA * px + t.depthB * py + t.depthC);
+      }
+    }
+#endif
+  }
+};
+#endif
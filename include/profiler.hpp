@@ -0,0 +1,256 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Frame profiler, compiled in with -DPLANETS_PROFILE (make PROFILE=1). Without it every PROFILE_* macro expands to
+// nothing, so instrumented code costs nothing.
+//
+//   PROFILE_ZONE("name")      times the enclosing scope on the CPU
+//   PROFILE_GPU_ZONE("name")  times the GL commands issued in the enclosing scope (GL thread only)
+//   PROFILE_THREAD("name")    names the calling thread in the trace
+//   PROFILE_FRAME()           once per frame on the GL thread, after the frame's GPU zones, collects old GPU results
+//
+// Names must be string literals (or live as long as the program). Profiler::Instance().WriteTrace(path) exports the
+// recorded zones to Chrome trace JSON, to open in chrome://tracing or ui.perfetto.dev.
+
+#ifdef PLANETS_PROFILE
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+// zones kept per thread, the oldest are overwritten
+const unsigned int PROFILER_RING_SIZE = 1 << 16;
+// frames a GPU zone waits before its queries are read, long enough for them to be available without stalling
+const unsigned int PROFILER_GPU_LATENCY = 4;
+
+struct ProfileEvent
+{
+  const char *name;
+  uint64_t begin, end; // steady clock nanoseconds
+};
+
+// Single producer ring: only the owning thread writes, the exporter reads up to the published head
+struct ProfileRing
+{
+  string threadName;
+  int threadId;
+  std::atomic<uint64_t> head{0};
+  unique_ptr<ProfileEvent[]> events{new ProfileEvent[PROFILER_RING_SIZE]};
+
+  void Push(const char *name, uint64_t begin, uint64_t end)
+  {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    events[h % PROFILER_RING_SIZE] = {name, begin, end};
+    head.store(h + 1, std::memory_order_release);
+  }
+};
+
+class Profiler
+{
+public:
+  static Profiler &Instance()
+  {
+    static Profiler profiler;
+    return profiler;
+  }
+
+  static uint64_t Now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // ring of the calling thread, registered the first time the thread records something
+  ProfileRing &ThreadRing()
+  {
+    thread_local ProfileRing *ring = nullptr;
+    if (!ring)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      rings.emplace_back(new ProfileRing());
+      ring = rings.back().get();
+      ring->threadId = rings.size();
+      ring->threadName = "thread " + std::to_string(ring->threadId);
+    }
+    return *ring;
+  }
+
+  void NameThread(const char *name)
+  {
+    ProfileRing &ring = ThreadRing();
+    std::lock_guard<std::mutex> lock(mutex);
+    ring.threadName = name;
+  }
+
+  unsigned int BeginGpuZone()
+  {
+    GpuFrame &frame = gpuFrames[gpuFrame % PROFILER_GPU_LATENCY];
+    unsigned int zone = frame.zones.size();
+    if (frame.queries.size() < 2 * (zone + 1))
+    {
+      frame.queries.resize(2 * (zone + 1));
+      glGenQueries(2, &frame.queries[2 * zone]);
+    }
+    frame.zones.push_back(nullptr);
+    glQueryCounter(frame.queries[2 * zone], GL_TIMESTAMP);
+    return zone;
+  }
+
+  void EndGpuZone(unsigned int zone, const char *name)
+  {
+    GpuFrame &frame = gpuFrames[gpuFrame % PROFILER_GPU_LATENCY];
+    frame.zones[zone] = name;
+    glQueryCounter(frame.queries[2 * zone + 1], GL_TIMESTAMP);
+  }
+
+  // reads the GPU zones of the oldest frame in flight and starts a new one
+  void EndFrame()
+  {
+    if (!gpuClockKnown)
+    {
+      // GPU timestamps are mapped onto the CPU clock with one sample of both
+      GLint64 gpuNow = 0;
+      glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+      gpuToCpu = (int64_t)Now() - gpuNow;
+      gpuClockKnown = true;
+    }
+    gpuFrame++;
+    GpuFrame &frame = gpuFrames[gpuFrame % PROFILER_GPU_LATENCY];
+    if (!frame.zones.empty())
+    {
+      // still not done after PROFILER_GPU_LATENCY frames: drop the frame rather than wait
+      GLint available = 0;
+      glGetQueryObjectiv(frame.queries[2 * frame.zones.size() - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (available)
+      {
+        ProfileRing &ring = gpuRing();
+        for (size_t zone = 0; zone < frame.zones.size(); zone++)
+        {
+          GLuint64 begin = 0, end = 0;
+          glGetQueryObjectui64v(frame.queries[2 * zone], GL_QUERY_RESULT, &begin);
+          glGetQueryObjectui64v(frame.queries[2 * zone + 1], GL_QUERY_RESULT, &end);
+          ring.Push(frame.zones[zone], begin + gpuToCpu, end + gpuToCpu);
+        }
+      }
+    }
+    frame.zones.clear();
+  }
+
+  // writes every zone still in the rings as Chrome trace JSON, returns false if the file can't be written
+  bool WriteTrace(const string &path)
+  {
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+      return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t origin = UINT64_MAX;
+    for (const unique_ptr<ProfileRing> &ring : rings)
+    {
+      uint64_t head = ring->head.load(std::memory_order_acquire);
+      for (uint64_t i = head > PROFILER_RING_SIZE ? head - PROFILER_RING_SIZE : 0; i < head; i++)
+        origin = std::min(origin, ring->events[i % PROFILER_RING_SIZE].begin);
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const unique_ptr<ProfileRing> &ring : rings)
+    {
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n",
+              ring->threadId, ring->threadName.c_str());
+      first = false;
+      uint64_t head = ring->head.load(std::memory_order_acquire);
+      for (uint64_t i = head > PROFILER_RING_SIZE ? head - PROFILER_RING_SIZE : 0; i < head; i++)
+      {
+        const ProfileEvent &event = ring->events[i % PROFILER_RING_SIZE];
+        fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", event.name, ring->threadId,
+                (event.begin - origin) / 1000.0, (event.end - event.begin) / 1000.0);
+      }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+  }
+
+private:
+  struct GpuFrame
+  {
+    vector<unsigned int> queries; // begin and end query per zone
+    vector<const char *> zones;
+  };
+
+  std::mutex mutex;
+  vector<unique_ptr<ProfileRing>> rings;
+  ProfileRing *gpu = nullptr;
+  GpuFrame gpuFrames[PROFILER_GPU_LATENCY];
+  unsigned long gpuFrame = 0;
+  bool gpuClockKnown = false;
+  int64_t gpuToCpu = 0;
+
+  Profiler() {}
+
+  // GPU zones get their own track, written by the GL thread only
+  ProfileRing &gpuRing()
+  {
+    if (!gpu)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      rings.emplace_back(new ProfileRing());
+      gpu = rings.back().get();
+      gpu->threadId = rings.size();
+      gpu->threadName = "GPU";
+    }
+    return *gpu;
+  }
+};
+
+class ProfileZone
+{
+public:
+  ProfileZone(const char *name) : name(name), begin(Profiler::Now()) {}
+  ~ProfileZone()
+  {
+    Profiler::Instance().ThreadRing().Push(name, begin, Profiler::Now());
+  }
+
+private:
+  const char *name;
+  uint64_t begin;
+};
+
+class GpuProfileZone
+{
+public:
+  GpuProfileZone(const char *name) : name(name), zone(Profiler::Instance().BeginGpuZone()) {}
+  ~GpuProfileZone()
+  {
+    Profiler::Instance().EndGpuZone(zone, name);
+  }
+
+private:
+  const char *name;
+  unsigned int zone;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) GpuProfileZone PROFILE_CONCAT(gpuProfileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::Instance().NameThread(name)
+#define PROFILE_FRAME() Profiler::Instance().EndFrame()
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_FRAME()
+
+#endif
+#endif
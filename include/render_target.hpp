@@ -0,0 +1,96 @@
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+
+#include <glad/glad.h>
+
+#include "gpu_resources.hpp"
+
+#include <iostream>
+#include <string>
+using namespace std;
+
+// Offscreen color and depth target the scene is rendered into instead of the window, at a size of its own, then
+// scaled to the window by Blit(). The depth is depth/stencil like the window's and the G-buffer's, so that the deferred
+// renderer can blit its depth into it
+class RenderTarget
+{
+public:
+  RenderTarget()
+  {
+    glGenFramebuffers(1, &framebuffer);
+  }
+  RenderTarget(const RenderTarget &) = delete;
+  RenderTarget &operator=(const RenderTarget &) = delete;
+  ~RenderTarget()
+  {
+    glDeleteFramebuffers(1, &framebuffer);
+  }
+
+  // (re)allocates the target when the size changed. name is its owner in the GPU resource registry
+  void Resize(int newWidth, int newHeight, const string &name)
+  {
+    if (newWidth == width && newHeight == height)
+      return;
+    width = newWidth;
+    height = newHeight;
+    GpuResourceOwner owner(name);
+    color = TextureHandle::Generate();
+    glBindTexture(GL_TEXTURE_2D, color.Id());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GpuResources::Instance().Register(GPU_TEXTURE, color.Id(), (unsigned long)width * height * 4,
+                                      "RGBA8 " + std::to_string(width) + "x" + std::to_string(height));
+    depth = RenderbufferHandle::Generate();
+    glBindRenderbuffer(GL_RENDERBUFFER, depth.Id());
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    GpuResources::Instance().Register(GPU_RENDERBUFFER, depth.Id(), (unsigned long)width * height * 4,
+                                      "D24S8 " + std::to_string(width) + "x" + std::to_string(height));
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color.Id(), 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth.Id());
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      cout << "ERROR::RENDER_TARGET:: " << name << " is not complete" << endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  // binds the target for drawing, with a viewport covering it
+  void Bind() const
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+  }
+
+  // scales the target into the window's framebuffer, which is left bound with a viewport covering it
+  void Blit(int windowWidth, int windowHeight) const
+  {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT,
+                      width == windowWidth && height == windowHeight ? GL_NEAREST : GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, windowWidth, windowHeight);
+  }
+
+  unsigned int Framebuffer() const
+  {
+    return framebuffer;
+  }
+  int Width() const
+  {
+    return width;
+  }
+  int Height() const
+  {
+    return height;
+  }
+
+private:
+  unsigned int framebuffer;
+  TextureHandle color;
+  RenderbufferHandle depth;
+  int width = 0, height = 0;
+};
+#endif
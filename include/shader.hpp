@@ -2,144 +2,149 @@
 #define SHADER_H
 
 #include <glad/glad.h>
+#include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
+#include <sys/inotify.h>
+#include <unistd.h>
 
+#include "profiler.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 class Shader
 {
 public:
   unsigned int ID;
+  // directory where linked program binaries are kept between runs, relative to the working directory. Empty disables the cache
+  static inline std::string CacheDirectory = "cache/shaders";
+  // names and values #defined after the #version line of every stage, for the sizes the shaders share with the C++
+  // side. Set before the shaders are constructed
+  static inline std::vector<std::pair<std::string, std::string>> Defines;
+
+  // finds out whether program binaries can be cached, once the context is current: GL 4.1, or ARB_get_program_binary on
+  // an older context. glad only loads the functions from 4.1 on, so for the extension they're fetched with load
+  static void LoadBinaryCache(GLADloadproc load)
+  {
+    binaryCache = GLAD_GL_VERSION_4_1;
+    if (!binaryCache)
+    {
+      int count = 0;
+      glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+      for (int i = 0; i < count && !binaryCache; i++)
+        binaryCache = strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_get_program_binary") == 0;
+      if (binaryCache)
+      {
+        glad_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        glad_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+        binaryCache = glad_glGetProgramBinary && glad_glProgramBinary && glad_glProgramParameteri;
+      }
+    }
+    if (binaryCache)
+    {
+      GLint formats = 0;
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+      binaryCache = formats > 0;
+    }
+    if (!binaryCache && !CacheDirectory.empty())
+      std::cout << "SHADER::CACHE:: needs OpenGL 4.1 or ARB_get_program_binary and a binary format, shaders are compiled "
+                   "at every start"
+                << std::endl;
+  }
+
   // constructor generates the shader on the fly
   // ------------------------------------------------------------------------
   Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr,
          const char *tessControlPath = nullptr, const char *tessEvalPath = nullptr)
   {
-    // 1. retrieve the vertex/fragment source code from filePath
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::string geometryCode;
-    std::string tessControlCode;
-    std::string tessEvalCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    std::ifstream gShaderFile;
-    std::ifstream tcShaderFile;
-    std::ifstream teShaderFile;
-    // ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    tcShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    teShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try
+    sourcePaths.push_back({GL_VERTEX_SHADER, vertexPath});
+    sourcePaths.push_back({GL_FRAGMENT_SHADER, fragmentPath});
+    if (geometryPath != nullptr)
+      sourcePaths.push_back({GL_GEOMETRY_SHADER, geometryPath});
+    if (tessControlPath != nullptr)
+      sourcePaths.push_back({GL_TESS_CONTROL_SHADER, tessControlPath});
+    if (tessEvalPath != nullptr)
+      sourcePaths.push_back({GL_TESS_EVALUATION_SHADER, tessEvalPath});
+    setup();
+  }
+  // compute shader program (GL 4.3)
+  // ------------------------------------------------------------------------
+  explicit Shader(const char *computePath)
+  {
+    sourcePaths.push_back({GL_COMPUTE_SHADER, computePath});
+    setup();
+  }
+
+  // the program and the inotify descriptor are owned by this object
+  Shader(const Shader &) = delete;
+  Shader &operator=(const Shader &) = delete;
+  ~Shader()
+  {
+    glDeleteProgram(ID);
+    if (pendingProgram != 0)
     {
-      // open files
-      vShaderFile.open(vertexPath);
-      fShaderFile.open(fragmentPath);
-      std::stringstream vShaderStream, fShaderStream;
-      // read file's buffer contents into streams
-      vShaderStream << vShaderFile.rdbuf();
-      fShaderStream << fShaderFile.rdbuf();
-      // close file handlers
-      vShaderFile.close();
-      fShaderFile.close();
-      // convert stream into string
-      vertexCode = vShaderStream.str();
-      fragmentCode = fShaderStream.str();
-      // if geometry shader path is present, also load a geometry shader
-      if (geometryPath != nullptr)
-      {
-        gShaderFile.open(geometryPath);
-        std::stringstream gShaderStream;
-        gShaderStream << gShaderFile.rdbuf();
-        gShaderFile.close();
-        geometryCode = gShaderStream.str();
-      }
-      if (tessControlPath != nullptr)
-      {
-        tcShaderFile.open(tessControlPath);
-        std::stringstream tcShaderStream;
-        tcShaderStream << tcShaderFile.rdbuf();
-        tcShaderFile.close();
-        tessControlCode = tcShaderStream.str();
-      }
-      if (tessEvalPath != nullptr)
-      {
-        teShaderFile.open(tessEvalPath);
-        std::stringstream teShaderStream;
-        teShaderStream << teShaderFile.rdbuf();
-        teShaderFile.close();
-        tessEvalCode = teShaderStream.str();
-      }
+      for (const std::pair<GLenum, unsigned int> &shader : pendingShaders)
+        glDeleteShader(shader.second);
+      glDeleteProgram(pendingProgram);
     }
-    catch (std::ifstream::failure &e)
+    if (watchFd >= 0)
+      close(watchFd);
+  }
+  // hot reload, call once per frame before the shader is used. When a source file changed on disk the program is
+  // rebuilt in the background (KHR_parallel_shader_compile, synchronously where that's missing) and swapped in once it
+  // linked. On errors the previous program is kept. Returns true if reload work happened during this call.
+  // ------------------------------------------------------------------------
+  bool Update()
+  {
+    if (pendingProgram == 0)
     {
-      std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-    }
-    const char *vShaderCode = vertexCode.c_str();
-    const char *fShaderCode = fragmentCode.c_str();
-    // 2. compile shaders
-    unsigned int vertex, fragment;
-    // vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
-    // fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
-    // if geometry shader is given, compile geometry shader
-    unsigned int geometry;
-    if (geometryPath != nullptr)
+      if (!sourcesChanged())
+        return false;
+      reloadStart = std::chrono::steady_clock::now();
+      pendingStages = readStages();
+      pendingProgram = startBuild(pendingStages, pendingShaders);
+    }
+
+    if (parallelCompileSupported())
     {
-      const char *gShaderCode = geometryCode.c_str();
-      geometry = glCreateShader(GL_GEOMETRY_SHADER);
-      glShaderSource(geometry, 1, &gShaderCode, NULL);
-      glCompileShader(geometry);
-      checkCompileErrors(geometry, "GEOMETRY");
+      GLint completed = GL_FALSE;
+      glGetProgramiv(pendingProgram, GL_COMPLETION_STATUS_KHR, &completed);
+      if (!completed)
+        return true;
     }
-    // if tessellation shader is given, compile tessellation shader
-    unsigned int tessControl;
-    if (tessControlPath != nullptr)
+
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - reloadStart).count();
+    if (finishBuild(pendingProgram, pendingShaders))
     {
-      const char *tcShaderCode = tessControlCode.c_str();
-      tessControl = glCreateShader(GL_TESS_CONTROL_SHADER);
-      glShaderSource(tessControl, 1, &tcShaderCode, NULL);
-      glCompileShader(tessControl);
-      checkCompileErrors(tessControl, "TESS_CONTROL");
+      // the old program may still be bound, GL defers its deletion until it isn't
+      glDeleteProgram(ID);
+      ID = pendingProgram;
+      std::string cachePath = binaryCachePath(pendingStages);
+      if (!cachePath.empty())
+        saveProgramBinary(cachePath);
+      std::cout << "SHADER::RELOAD:: " << sourcePaths.back().second << " swapped in after " << ms << " ms" << std::endl;
     }
-    unsigned int tessEval;
-    if (tessEvalPath != nullptr)
+    else
     {
-      const char *teShaderCode = tessEvalCode.c_str();
-      tessEval = glCreateShader(GL_TESS_EVALUATION_SHADER);
-      glShaderSource(tessEval, 1, &teShaderCode, NULL);
-      glCompileShader(tessEval);
-      checkCompileErrors(tessEval, "TESS_EVALUATION");
+      glDeleteProgram(pendingProgram);
+      std::cout << "SHADER::RELOAD:: " << sourcePaths.back().second << " failed, keeping the previous program" << std::endl;
     }
-    // shader Program
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    if (geometryPath != nullptr)
-      glAttachShader(ID, geometry);
-    if (tessControlPath != nullptr)
-      glAttachShader(ID, tessControl);
-    if (tessEvalPath != nullptr)
-      glAttachShader(ID, tessEval);
-    glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
-    // delete the shaders as they're linked into our program now and no longer necessery
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-    if (geometryPath != nullptr)
-      glDeleteShader(geometry);
+    pendingProgram = 0;
+    pendingStages.clear();
+    return true;
   }
   // activate the shader
   // ------------------------------------------------------------------------
@@ -147,69 +152,421 @@ public:
   {
     glUseProgram(ID);
   }
-  // utility uniform functions
+  // utility uniform functions, names are C strings so that setting a uniform never builds a std::string
   // ------------------------------------------------------------------------
-  void setBool(const std::string &name, bool value) const
+  void setBool(const char *name, bool value) const
   {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(glGetUniformLocation(ID, name), (int)value);
   }
   // ------------------------------------------------------------------------
-  void setInt(const std::string &name, int value) const
+  void setInt(const char *name, int value) const
   {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(glGetUniformLocation(ID, name), value);
   }
   // ------------------------------------------------------------------------
-  void setFloat(const std::string &name, float value) const
+  void setFloat(const char *name, float value) const
   {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(glGetUniformLocation(ID, name), value);
   }
   // ------------------------------------------------------------------------
-  void setVec2(const std::string &name, const glm::vec2 &value) const
+  void setVec2(const char *name, const glm::vec2 &value) const
   {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform2fv(glGetUniformLocation(ID, name), 1, &value[0]);
   }
-  void setVec2(const std::string &name, float x, float y) const
+  void setVec2(const char *name, float x, float y) const
   {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    glUniform2f(glGetUniformLocation(ID, name), x, y);
   }
   // ------------------------------------------------------------------------
-  void setVec3(const std::string &name, const glm::vec3 &value) const
+  void setVec3(const char *name, const glm::vec3 &value) const
   {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform3fv(glGetUniformLocation(ID, name), 1, &value[0]);
   }
-  void setVec3(const std::string &name, float x, float y, float z) const
+  void setVec3(const char *name, float x, float y, float z) const
   {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    glUniform3f(glGetUniformLocation(ID, name), x, y, z);
   }
   // ------------------------------------------------------------------------
-  void setVec4(const std::string &name, const glm::vec4 &value) const
+  void setVec4(const char *name, const glm::vec4 &value) const
   {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform4fv(glGetUniformLocation(ID, name), 1, &value[0]);
   }
-  void setVec4(const std::string &name, float x, float y, float z, float w)
+  void setVec4(const char *name, float x, float y, float z, float w)
   {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    glUniform4f(glGetUniformLocation(ID, name), x, y, z, w);
   }
   // ------------------------------------------------------------------------
-  void setMat2(const std::string &name, const glm::mat2 &mat) const
+  void setMat2(const char *name, const glm::mat2 &mat) const
   {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix2fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
   }
   // ------------------------------------------------------------------------
-  void setMat3(const std::string &name, const glm::mat3 &mat) const
+  void setMat3(const char *name, const glm::mat3 &mat) const
   {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix3fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
   }
   // ------------------------------------------------------------------------
-  void setMat4(const std::string &name, const glm::mat4 &mat) const
+  void setMat4(const char *name, const glm::mat4 &mat) const
   {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, &mat[0][0]);
   }
 
 private:
+  // stage types and source paths, for hot reload
+  std::vector<std::pair<GLenum, std::string>> sourcePaths;
+  // files the stages #include, also watched
+  std::vector<std::string> includePaths;
+  int watchFd = -1;
+  // reload in flight
+  unsigned int pendingProgram = 0;
+  std::vector<std::pair<GLenum, unsigned int>> pendingShaders;
+  std::vector<std::pair<GLenum, std::string>> pendingStages;
+  std::chrono::steady_clock::time_point reloadStart;
+
+  // builds the program from sourcePaths: binary cache first, then compile from source
+  // ------------------------------------------------------------------------
+  void setup()
+  {
+    PROFILE_ZONE("shader setup");
+    auto start = std::chrono::steady_clock::now();
+    // 1. retrieve the source code of every stage from filePath
+    std::vector<std::pair<GLenum, std::string>> stages = readStages();
+
+    // 2. reuse the program binary of a previous run if neither the sources nor the driver changed
+    std::string cachePath = binaryCachePath(stages);
+    bool cached = !cachePath.empty() && loadProgramBinary(cachePath);
+
+    // 3. otherwise compile and link from source, and cache the result for the next start
+    if (!cached)
+    {
+      std::vector<std::pair<GLenum, unsigned int>> shaders;
+      ID = startBuild(stages, shaders);
+      finishBuild(ID, shaders);
+      if (!cachePath.empty())
+        saveProgramBinary(cachePath);
+    }
+
+    // 4. watch the sources so that edits are picked up by Update()
+    watchSources();
+
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "SHADER::SETUP:: " << sourcePaths.back().second << " " << ms << " ms (" << (cached ? "binary cache" : "compiled") << ")" << std::endl;
+  }
+
+  // sources of every stage with their includes expanded, which are watched along with the stages' own files
+  std::vector<std::pair<GLenum, std::string>> readStages()
+  {
+    std::vector<std::pair<GLenum, std::string>> stages;
+    includePaths.clear();
+    for (const auto &source : sourcePaths)
+      stages.push_back({source.first, insertDefines(expandIncludes(source.second, 0))});
+    return stages;
+  }
+
+  // source with Defines after its #version line, numbered so that the next line is still line 2
+  // ------------------------------------------------------------------------
+  static std::string insertDefines(const std::string &source)
+  {
+    size_t version = source.find("#version");
+    if (Defines.empty() || version == std::string::npos)
+      return source;
+    size_t next = source.find('\n', version);
+    if (next == std::string::npos)
+      return source;
+    std::string defines;
+    for (const auto &define : Defines)
+      defines += "#define " + define.first + " " + define.second + "\n";
+    return source.substr(0, next + 1) + defines + "#line 2 0\n" + source.substr(next + 1);
+  }
+
+  // source of path with every line #include "file" replaced by file, found next to path, so that the functions shared
+  // by several shaders live in one place. #line directives keep the compile errors pointing at the right file (its
+  // source string number is its index in includePaths plus one) and line
+  // ------------------------------------------------------------------------
+  std::string expandIncludes(const std::string &path, int depth)
+  {
+    std::string source = readFile(path.c_str());
+    if (source.find("#include") == std::string::npos)
+      return source;
+    int file = 0;
+    for (size_t i = 0; i < includePaths.size(); i++)
+      if (includePaths[i] == path)
+        file = (int)i + 1;
+    std::istringstream lines(source);
+    std::string expanded, line;
+    for (int number = 1; std::getline(lines, line); number++)
+    {
+      size_t open = line.find('"');
+      size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+      if (line.compare(0, 8, "#include") != 0 || close == std::string::npos)
+      {
+        expanded += line + "\n";
+        continue;
+      }
+      std::string included = (std::filesystem::path(path).parent_path() / line.substr(open + 1, close - open - 1)).string();
+      if (depth >= 8)
+      {
+        std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP: " << included << std::endl;
+        continue;
+      }
+      includePaths.push_back(included);
+      expanded += "#line 1 " + std::to_string(includePaths.size()) + "\n";
+      expanded += expandIncludes(included, depth + 1);
+      expanded += "#line " + std::to_string(number + 1) + " " + std::to_string(file) + "\n";
+    }
+    return expanded;
+  }
+
+  // watches the directories of the sources rather than the files, editors often save by replacing the file
+  // ------------------------------------------------------------------------
+  void watchSources()
+  {
+    watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd < 0)
+    {
+      std::cout << "SHADER::WATCH:: inotify unavailable, hot reload disabled" << std::endl;
+      return;
+    }
+    std::vector<std::string> paths = includePaths;
+    for (const auto &source : sourcePaths)
+      paths.push_back(source.second);
+    for (const std::string &path : paths)
+    {
+      std::filesystem::path directory = std::filesystem::path(path).parent_path();
+      inotify_add_watch(watchFd, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    }
+  }
+
+  // drains pending inotify events, true if any of them touched one of our sources
+  // ------------------------------------------------------------------------
+  bool sourcesChanged()
+  {
+    if (watchFd < 0)
+      return false;
+    bool changed = false;
+    alignas(struct inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(watchFd, buffer, sizeof(buffer))) > 0)
+    {
+      for (char *ptr = buffer; ptr < buffer + length;)
+      {
+        const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+        if (event->len > 0)
+        {
+          for (const auto &source : sourcePaths)
+            if (std::filesystem::path(source.second).filename() == event->name)
+              changed = true;
+          for (const std::string &include : includePaths)
+            if (std::filesystem::path(include).filename() == event->name)
+              changed = true;
+        }
+        ptr += sizeof(struct inotify_event) + event->len;
+      }
+    }
+    return changed;
+  }
+
+  // KHR_parallel_shader_compile (or its ARB twin) lets the driver compile on its own threads, so that compile and link
+  // return immediately and GL_COMPLETION_STATUS_KHR can be polled without blocking
+  // ------------------------------------------------------------------------
+  static bool parallelCompileSupported()
+  {
+    static int supported = -1;
+    if (supported < 0)
+    {
+      typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+      PFNGLMAXSHADERCOMPILERTHREADSPROC maxThreads = nullptr;
+      if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+        maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+      else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+        maxThreads = (PFNGLMAXSHADERCOMPILERTHREADSPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+      // let the driver pick how many threads to use
+      if (maxThreads)
+        maxThreads(0xFFFFFFFF);
+      supported = maxThreads != nullptr;
+    }
+    return supported;
+  }
+
+  // reads a whole source file, empty on failure
+  // ------------------------------------------------------------------------
+  static std::string readFile(const char *path)
+  {
+    std::ifstream file;
+    // ensure ifstream objects can throw exceptions:
+    file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try
+    {
+      file.open(path);
+      std::stringstream stream;
+      stream << file.rdbuf();
+      file.close();
+      return stream.str();
+    }
+    catch (std::ifstream::failure &e)
+    {
+      std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+    }
+    return "";
+  }
+
+  static const char *stageName(GLenum type)
+  {
+    switch (type)
+    {
+    case GL_VERTEX_SHADER:
+      return "VERTEX";
+    case GL_FRAGMENT_SHADER:
+      return "FRAGMENT";
+    case GL_GEOMETRY_SHADER:
+      return "GEOMETRY";
+    case GL_TESS_CONTROL_SHADER:
+      return "TESS_CONTROL";
+    case GL_TESS_EVALUATION_SHADER:
+      return "TESS_EVALUATION";
+    case GL_COMPUTE_SHADER:
+      return "COMPUTE";
+    }
+    return "UNKNOWN";
+  }
+
+  // compiles every stage and links them into a new program. Status is only checked in finishBuild() so that with
+  // parallel compilation nothing here waits for the driver.
+  // ------------------------------------------------------------------------
+  unsigned int startBuild(const std::vector<std::pair<GLenum, std::string>> &stages, std::vector<std::pair<GLenum, unsigned int>> &shaders)
+  {
+    unsigned int program = glCreateProgram();
+    for (const auto &stage : stages)
+    {
+      const char *code = stage.second.c_str();
+      unsigned int shader = glCreateShader(stage.first);
+      glShaderSource(shader, 1, &code, NULL);
+      glCompileShader(shader);
+      glAttachShader(program, shader);
+      shaders.push_back({stage.first, shader});
+    }
+    if (binaryCacheSupported())
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    return program;
+  }
+
+  // reports compile/link errors and releases the shader objects, true if the program is usable
+  // ------------------------------------------------------------------------
+  bool finishBuild(unsigned int program, std::vector<std::pair<GLenum, unsigned int>> &shaders)
+  {
+    bool success = true;
+    for (const auto &shader : shaders)
+      success = checkCompileErrors(shader.second, stageName(shader.first)) && success;
+    success = checkCompileErrors(program, "PROGRAM") && success;
+    // delete the shaders as they're linked into our program now and no longer necessery
+    for (const auto &shader : shaders)
+      glDeleteShader(shader.second);
+    shaders.clear();
+    return success;
+  }
+
+  // program binaries need GL 4.1 (or ARB_get_program_binary) and a driver that exposes at least one binary format,
+  // see LoadBinaryCache()
+  // ------------------------------------------------------------------------
+  static inline bool binaryCache = false;
+  static bool binaryCacheSupported()
+  {
+    return binaryCache;
+  }
+
+  // cache file name: FNV-1a hash of every stage source plus the driver identification, since binaries are only valid
+  // for the exact driver that produced them. Empty if the cache is disabled or unsupported.
+  // ------------------------------------------------------------------------
+  static std::string binaryCachePath(const std::vector<std::pair<GLenum, std::string>> &stages)
+  {
+    if (CacheDirectory.empty() || !binaryCacheSupported())
+      return "";
+
+    uint64_t hash = 14695981039346656037ull;
+    auto hashString = [&hash](const std::string &str)
+    {
+      // include the terminating zero so that stage boundaries are part of the key
+      for (size_t i = 0; i <= str.size(); i++)
+      {
+        hash ^= (unsigned char)str.c_str()[i];
+        hash *= 1099511628211ull;
+      }
+    };
+    for (const auto &stage : stages)
+    {
+      hashString(std::to_string(stage.first));
+      hashString(stage.second);
+    }
+    const GLenum driverStrings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    for (GLenum name : driverStrings)
+    {
+      const GLubyte *value = glGetString(name);
+      hashString(value ? (const char *)value : "");
+    }
+
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "%016llx.bin", (unsigned long long)hash);
+    return CacheDirectory + "/" + fileName;
+  }
+
+  // loads a cached binary into a new program. Returns false (and leaves ID unset) if there is no cache entry or the
+  // driver rejects it, e.g. after a driver update that kept the same version string
+  // ------------------------------------------------------------------------
+  bool loadProgramBinary(const std::string &path)
+  {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      return false;
+    GLenum format = 0;
+    file.read(reinterpret_cast<char *>(&format), sizeof(format));
+    if (!file)
+      return false;
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty())
+      return false;
+
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+      glDeleteProgram(program);
+      std::cout << "SHADER::CACHE:: binary rejected by the driver, recompiling " << path << std::endl;
+      return false;
+    }
+    ID = program;
+    return true;
+  }
+
+  void saveProgramBinary(const std::string &path)
+  {
+    GLint success = GL_FALSE, length = 0;
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (!success || length <= 0)
+      return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(ID, length, NULL, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(CacheDirectory, error);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+      std::cout << "SHADER::CACHE:: cannot write " << path << std::endl;
+      return;
+    }
+    file.write(reinterpret_cast<const char *>(&format), sizeof(format));
+    file.write(binary.data(), binary.size());
+  }
+
   // utility function for checking shader compilation/linking errors.
   // ------------------------------------------------------------------------
-  void checkCompileErrors(GLuint shader, std::string type)
+  bool checkCompileErrors(GLuint shader, std::string type)
   {
     GLint success;
     GLchar infoLog[1024];
@@ -233,6 +590,7 @@ private:
                   << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
       }
     }
+    return success;
   }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,152 @@
+#ifndef SPHERE_H
+#define SPHERE_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+
+#include <climits>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+// unit sphere made by GenerateSphere()
+struct SphereGeometry
+{
+  vector<Vertex> vertices;
+  vector<unsigned int> indices;
+};
+
+// cube faces: normal and two axes across the face, a x b = normal
+const glm::vec3 CUBE_FACE_NORMALS[6] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+const glm::vec3 CUBE_FACE_AXES_A[6] = {{0, 1, 0}, {0, 0, 1}, {0, 0, 1}, {1, 0, 0}, {1, 0, 0}, {0, 1, 0}};
+const glm::vec3 CUBE_FACE_AXES_B[6] = {{0, 0, 1}, {0, 1, 0}, {1, 0, 0}, {0, 0, 1}, {0, 1, 0}, {1, 0, 0}};
+
+// point (s, t in [0, 1] along the axes) of a cube face pushed onto the unit sphere with the spherified cube mapping,
+// which spreads points more evenly than normalizing
+glm::vec3 CubeSpherePoint(int face, float s, float t)
+{
+  glm::vec3 c = CUBE_FACE_NORMALS[face] + (2.0f * s - 1.0f) * CUBE_FACE_AXES_A[face] + (2.0f * t - 1.0f) * CUBE_FACE_AXES_B[face];
+  glm::vec3 c2 = c * c;
+  return glm::vec3(c.x * sqrtf(1.0f - c2.y / 2.0f - c2.z / 2.0f + c2.y * c2.z / 3.0f),
+                   c.y * sqrtf(1.0f - c2.z / 2.0f - c2.x / 2.0f + c2.z * c2.x / 3.0f),
+                   c.z * sqrtf(1.0f - c2.x / 2.0f - c2.y / 2.0f + c2.x * c2.y / 3.0f));
+}
+
+// equirectangular texture coordinates of a point of the unit sphere: u in [0, 1] along the longitude, v = 0 at the
+// north pole
+float SphereU(const glm::vec3 &p)
+{
+  return atan2f(-p.z, p.x) / 6.2831853f + 0.5f;
+}
+float SphereV(const glm::vec3 &p)
+{
+  return acosf(glm::clamp(p.y, -1.0f, 1.0f)) / 3.14159265f;
+}
+
+// u shifted by whole turns to within half a turn of reference, so that a patch straddling the date line doesn't wrap
+float UnwrapU(float u, float reference)
+{
+  return u - reference > 0.5f ? u - 1.0f : u - reference < -0.5f ? u + 1.0f : u;
+}
+
+// subdivisions giving about as many triangles as a mesh, to compare a procedural body with a loaded one
+unsigned int SphereSubdivisions(unsigned long triangles)
+{
+  return std::max(1u, (unsigned int)roundf(sqrtf(triangles / 12.0f)));
+}
+
+// Cube-sphere: each face of a cube is split in subdivisions x subdivisions quads (12 * subdivisions^2 triangles)
+// and its points pushed onto the unit sphere with CubeSpherePoint(). Normals, tangents and bitangents are analytic.
+// Texture coordinates are equirectangular, as the loaded models with flipped UVs: where a quad straddles the date
+// line its vertices get u beyond [0, 1] rather than wrapping, which repeating textures show seamlessly, and the pole
+// vertices are duplicated per quad with the u of that quad. Triangles are counterclockwise seen from outside.
+void GenerateSphere(unsigned int subdivisions, SphereGeometry &sphere)
+{
+  const unsigned int n = std::max(1u, subdivisions);
+  const float pi = 3.14159265f;
+  vector<Vertex> &vertices = sphere.vertices;
+  vector<unsigned int> &indices = sphere.indices;
+  vertices.clear();
+  indices.clear();
+  vertices.reserve(6 * (n + 1) * (n + 1) + 4 * n);
+  indices.reserve(36 * n * n);
+  // output vertex of each grid point of the current face with its u unchanged, one turn less or one turn more
+  vector<unsigned int> emitted((n + 1) * (n + 1) * 3);
+
+  auto vertex = [&](const glm::vec3 &p, float u)
+  {
+    Vertex vertex = {};
+    float v = SphereV(p), lon = (u - 0.5f) * 2.0f * pi, lat = v * pi;
+    vertex.Position = p;
+    vertex.Normal = p;
+    vertex.TexCoords = glm::vec2(u, v);
+    vertex.Tangent = glm::vec3(-sinf(lon), 0.0f, -cosf(lon));
+    vertex.Bitangent = glm::vec3(cosf(lat) * cosf(lon), -sinf(lat), -cosf(lat) * sinf(lon));
+    vertices.push_back(vertex);
+    return (unsigned int)vertices.size() - 1;
+  };
+
+  for (int face = 0; face < 6; face++)
+  {
+    std::fill(emitted.begin(), emitted.end(), UINT_MAX);
+    for (unsigned int t = 0; t < n; t++)
+      for (unsigned int s = 0; s < n; s++)
+      {
+        // the corners take the u closest to the quad's center
+        float center = SphereU(CubeSpherePoint(face, (s + 0.5f) / n, (t + 0.5f) / n));
+        unsigned int corners[4];
+        const unsigned int cornerS[4] = {s, s + 1, s + 1, s}, cornerT[4] = {t, t, t + 1, t + 1};
+        for (int k = 0; k < 4; k++)
+        {
+          glm::vec3 p = CubeSpherePoint(face, (float)cornerS[k] / n, (float)cornerT[k] / n);
+          if (p.x * p.x + p.z * p.z < 1e-12f)
+          {
+            corners[k] = vertex(p, center);
+            continue;
+          }
+          float u = SphereU(p), unwrapped = UnwrapU(u, center);
+          int shift = (int)roundf(unwrapped - u);
+          unsigned int &index = emitted[(cornerT[k] * (n + 1) + cornerS[k]) * 3 + shift + 1];
+          if (index == UINT_MAX)
+            index = vertex(p, unwrapped);
+          corners[k] = index;
+        }
+        unsigned int quad[6] = {corners[0], corners[1], corners[2], corners[0], corners[2], corners[3]};
+        indices.insert(indices.end(), quad, quad + 6);
+      }
+  }
+}
+
+// Unit spheres by subdivisions, generated once and shared by every body using them. Thread safe
+class SphereCache
+{
+public:
+  static SphereCache &Instance()
+  {
+    static SphereCache cache;
+    return cache;
+  }
+
+  shared_ptr<const SphereGeometry> Get(unsigned int subdivisions)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shared_ptr<SphereGeometry> &sphere = spheres[subdivisions];
+    if (!sphere)
+    {
+      sphere = make_shared<SphereGeometry>();
+      GenerateSphere(subdivisions, *sphere);
+    }
+    return sphere;
+  }
+
+private:
+  std::mutex mutex;
+  std::map<unsigned int, shared_ptr<SphereGeometry>> spheres;
+
+  SphereCache() {}
+};
+#endif
@@ -0,0 +1,82 @@
+#ifndef STARFIELD_H
+#define STARFIELD_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "gpu_timer.hpp"
+#include "profiler.hpp"
+#include "shader.hpp"
+
+#include <string>
+using namespace std;
+
+// stars per cube face side of the starfield grid, at most one star per cell
+const int STARFIELD_CELLS = 512;
+
+// Procedural background: stars placed by hashing the cells of a grid on the cube around the camera, and a faint band
+// of the galaxy, computed per pixel in one fullscreen triangle. It's drawn after the opaque geometry at the far plane
+// with the depth test on and depth writes off, so the early depth test skips every pixel the scene covered and only
+// the visible sky is shaded. Nothing is stored, the stars cost no memory and no loading. Draw() can time itself with
+// GPU timestamps, read back a few draws late like the benchmark's queries.
+class Starfield
+{
+public:
+  Shader StarShader;
+
+  Starfield(const string &shaderDirectory)
+      : StarShader((shaderDirectory + "/starfield.vs").c_str(), (shaderDirectory + "/starfield.fs").c_str())
+  {
+    // the fullscreen triangle has no attributes, but core profile still wants a VAO bound
+    glGenVertexArrays(1, &emptyVAO);
+  }
+  Starfield(const Starfield &) = delete;
+  Starfield &operator=(const Starfield &) = delete;
+  ~Starfield()
+  {
+    glDeleteVertexArrays(1, &emptyVAO);
+  }
+
+  // draws the sky behind what the bound framebuffer's depth holds already. With timed, the pass's GPU time is added
+  // to Milliseconds once it's known
+  void Draw(const glm::mat4 &view, const glm::mat4 &projection, bool timed = false)
+  {
+    PROFILE_GPU_ZONE("starfield");
+    if (timed)
+      timer.Begin([this](float milliseconds, int) {
+        Milliseconds += milliseconds;
+        TimedDraws++;
+      });
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    StarShader.use();
+    // directions only: the stars are infinitely far, the camera's position doesn't move them
+    StarShader.setMat4("invViewProjection", glm::inverse(projection * glm::mat4(glm::mat3(view))));
+    StarShader.setFloat("cells", (float)STARFIELD_CELLS);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    if (timed)
+      timer.End();
+  }
+
+  // GPU time of the timed draws read back so far, and how many they were
+  float Milliseconds = 0.0f;
+  int TimedDraws = 0;
+
+  // forgets the timings and the draws in flight, for a new measurement
+  void ResetTiming()
+  {
+    timer.Reset();
+    Milliseconds = 0.0f;
+    TimedDraws = 0;
+  }
+
+private:
+  unsigned int emptyVAO;
+  GpuTimer timer;
+};
+#endif
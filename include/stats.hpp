@@ -0,0 +1,82 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// counters of the frame being rendered, reset by StatsPrinter::EndFrame()
+struct RenderStats
+{
+  unsigned int drawCalls = 0;
+  unsigned int textureBinds = 0;
+  unsigned long triangles = 0;
+  unsigned int objectsDrawn = 0;
+  unsigned int occlusionTested = 0;
+  unsigned int occlusionCulled = 0;
+  // point light entries clustered shading left out of full cluster lists
+  unsigned int lightsDropped = 0;
+  float simulationMs = 0.0f;
+  float cullingMs = 0.0f;
+};
+
+inline RenderStats frameStats;
+
+// GPU memory allocated by the loaders so far
+struct ResourceStats
+{
+  unsigned int textures = 0;
+  unsigned long textureBytes = 0;
+  unsigned long meshBytes = 0;
+};
+
+inline ResourceStats resourceStats;
+
+// accumulates frame stats and prints their averages once per interval, and the standard deviation of the frame time
+class StatsPrinter
+{
+public:
+  bool enabled = false;
+
+  StatsPrinter(float interval = 1.0f) : interval(interval) {}
+
+  // frameTime in seconds
+  void EndFrame(float frameTime)
+  {
+    if (enabled)
+    {
+      frames++;
+      elapsed += frameTime;
+      squares += (double)frameTime * frameTime;
+      sum.drawCalls += frameStats.drawCalls;
+      sum.textureBinds += frameStats.textureBinds;
+      sum.triangles += frameStats.triangles;
+      sum.objectsDrawn += frameStats.objectsDrawn;
+      sum.occlusionTested += frameStats.occlusionTested;
+      sum.occlusionCulled += frameStats.occlusionCulled;
+      sum.lightsDropped += frameStats.lightsDropped;
+      if (elapsed >= interval)
+      {
+        double mean = elapsed / frames, deviation = std::sqrt(std::max(0.0, squares / frames - mean * mean));
+        printf("STATS:: %.1f fps %.2f ms +-%.2f ms | draw calls %u | texture binds %u | triangles %lu | objects drawn %u | occlusion culled %u/%u | lights dropped %u\n",
+               frames / elapsed, elapsed * 1000.0f / frames, deviation * 1000.0, sum.drawCalls / frames, sum.textureBinds / frames, sum.triangles / frames,
+               sum.objectsDrawn / frames, sum.occlusionCulled / frames, sum.occlusionTested / frames,
+               sum.lightsDropped / frames);
+        fflush(stdout);
+        sum = RenderStats();
+        frames = 0;
+        elapsed = 0.0f;
+        squares = 0.0;
+      }
+    }
+    frameStats = RenderStats();
+  }
+
+private:
+  float interval;
+  float elapsed = 0.0f;
+  double squares = 0.0;
+  unsigned int frames = 0;
+  RenderStats sum;
+};
+#endif
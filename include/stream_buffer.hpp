@@ -0,0 +1,250 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "gpu_resources.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// texture unit reserved for the transform buffer, between the mesh textures and TEXTURE_ARRAY_UNIT
+const int TRANSFORM_BUFFER_UNIT = 6;
+
+// regions of a StreamBuffer: the CPU writes one while the GPU may still be reading the others
+const int STREAM_BUFFER_REGIONS = 3;
+
+// Buffer for data the CPU rewrites every frame (transforms), read by the shaders through a samplerBuffer of RGBA32F
+// texels. The buffer is a ring of STREAM_BUFFER_REGIONS regions used in turn, each fenced after the draws reading it
+// so that it's only written again once the GPU is done with it, and the CPU writes straight into buffer memory:
+//   PERSISTENT      immutable storage mapped once, persistently and coherently (GL 4.4)
+//   UNSYNCHRONIZED  the region is mapped unsynchronized and invalidated each frame, the fences do the waiting (GL 3.3)
+//   ORPHAN          glBufferData orphaning then glBufferSubData from a staging copy, the old way, for comparison
+// A texture buffer only reaches GL_MAX_TEXTURE_BUFFER_SIZE texels (65536 at the least), so on GL 4.3 every region gets
+// a view of its own (glTexBufferRange) and the limit applies to a frame rather than the ring. Callers keep a frame
+// within MaxFrameBytes(), Begin() clamps anything bigger and logs an error.
+class StreamBuffer
+{
+public:
+  enum Mode
+  {
+    PERSISTENT,
+    UNSYNCHRONIZED,
+    ORPHAN
+  };
+
+  static bool PersistentSupported()
+  {
+    return GLAD_GL_VERSION_4_4;
+  }
+
+  // the best mode the driver supports
+  static Mode DefaultMode()
+  {
+    return PersistentSupported() ? PERSISTENT : UNSYNCHRONIZED;
+  }
+
+  // texels a texture buffer view reaches, GL_MAX_TEXTURE_BUFFER_SIZE
+  static size_t MaxTexels()
+  {
+    static size_t texels = 0;
+    if (texels == 0)
+    {
+      GLint size = 0;
+      glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &size);
+      texels = std::max(size, 65536);
+    }
+    return texels;
+  }
+
+  // views of a region each instead of one of the whole ring (GL 4.3)
+  static bool RegionViewsSupported()
+  {
+    return GLAD_GL_VERSION_4_3;
+  }
+
+  static const char *ModeName(Mode mode)
+  {
+    return mode == PERSISTENT ? "persistent" : mode == UNSYNCHRONIZED ? "unsynchronized" : "orphan";
+  }
+
+  StreamBuffer(Mode mode, size_t regionBytes = 64 * 1024) : mode(mode), regionViews(mode != ORPHAN && RegionViewsSupported())
+  {
+    allocate(regionBytes);
+  }
+  StreamBuffer(const StreamBuffer &) = delete;
+  StreamBuffer &operator=(const StreamBuffer &) = delete;
+  ~StreamBuffer()
+  {
+    release();
+  }
+
+  // the most bytes of a frame the shaders can read, the texels of a view in whole regions
+  size_t MaxFrameBytes() const
+  {
+    size_t viewBytes = MaxTexels() * 16;
+    return (regionViews || mode == ORPHAN ? viewBytes : viewBytes / STREAM_BUFFER_REGIONS) & ~(size_t)255;
+  }
+
+  // memory for bytes of this frame's data, valid until End(). Moves on to the next region, waiting for the GPU if it
+  // still reads it; a frame bigger than a region reallocates the ring. Frames past MaxFrameBytes() are cut short
+  void *Begin(size_t bytes)
+  {
+    if (bytes > MaxFrameBytes())
+    {
+      if (!clampLogged)
+        std::cout << "ERROR::STREAM_BUFFER:: " << bytes << " bytes in a frame, the shaders only reach " << MaxFrameBytes()
+                  << " (GL_MAX_TEXTURE_BUFFER_SIZE " << MaxTexels() << " texels)" << std::endl;
+      clampLogged = true;
+      bytes = MaxFrameBytes();
+    }
+    if (bytes > regionBytes)
+    {
+      release();
+      allocate(std::min(std::max(bytes, regionBytes * 2), MaxFrameBytes()));
+    }
+    region = (region + 1) % STREAM_BUFFER_REGIONS;
+    written = bytes;
+    if (mode == ORPHAN)
+      return staging.data();
+    if (fences[region])
+    {
+      auto start = std::chrono::steady_clock::now();
+      while (glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+        ;
+      WaitMilliseconds += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+      glDeleteSync(fences[region]);
+      fences[region] = 0;
+    }
+    if (mode == PERSISTENT)
+      return mapped + Offset();
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer.Id());
+    void *memory = glMapBufferRange(GL_TEXTURE_BUFFER, Offset(), std::max<size_t>(bytes, 16),
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    return memory;
+  }
+
+  // hands the data written since Begin() over to the GPU
+  void End()
+  {
+    if (mode == PERSISTENT)
+      return;
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer.Id());
+    if (mode == UNSYNCHRONIZED)
+      glUnmapBuffer(GL_TEXTURE_BUFFER);
+    else
+    {
+      glBufferData(GL_TEXTURE_BUFFER, regionBytes, NULL, GL_STREAM_DRAW);
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, written, staging.data());
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+
+  // after the last draw reading this frame's data
+  void Fence()
+  {
+    if (mode != ORPHAN)
+      fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  // offset of this frame's data in the buffer, in bytes and in texels of the view BindTexture() binds
+  size_t Offset() const
+  {
+    return mode == ORPHAN ? 0 : region * regionBytes;
+  }
+  int TexelOffset() const
+  {
+    return regionViews ? 0 : (int)(Offset() / 16);
+  }
+
+  // binds the view of this frame's data
+  void BindTexture(int unit)
+  {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, textures[regionViews ? region : 0].Id());
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  Mode GetMode() const
+  {
+    return mode;
+  }
+
+  // time Begin() spent waiting for the GPU, accumulated
+  float WaitMilliseconds = 0.0f;
+
+private:
+  Mode mode;
+  bool regionViews;
+  bool clampLogged = false;
+  BufferHandle buffer;
+  // one view of the whole buffer, or one per region
+  TextureHandle textures[STREAM_BUFFER_REGIONS];
+  size_t regionBytes = 0;
+  int region = 0;
+  size_t written = 0;
+  unsigned char *mapped = nullptr;
+  GLsync fences[STREAM_BUFFER_REGIONS] = {};
+  vector<unsigned char> staging;
+
+  // regions of at least bytes (at most MaxFrameBytes()), rounded up to 256 so that every region starts on a whole texel
+  // and matrix
+  void allocate(size_t bytes)
+  {
+    regionBytes = (std::min(bytes, MaxFrameBytes()) + 255) & ~(size_t)255;
+    size_t total = mode == ORPHAN ? regionBytes : regionBytes * STREAM_BUFFER_REGIONS;
+    GpuResourceOwner owner(string("stream buffer (") + ModeName(mode) + ")");
+    buffer = BufferHandle::Generate();
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer.Id());
+    if (mode == PERSISTENT)
+    {
+      GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_TEXTURE_BUFFER, total, NULL, flags);
+      mapped = (unsigned char *)glMapBufferRange(GL_TEXTURE_BUFFER, 0, total, flags);
+    }
+    else
+      glBufferData(GL_TEXTURE_BUFFER, total, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    if (mode == ORPHAN)
+      staging.resize(regionBytes);
+    GpuResources::Instance().Register(GPU_BUFFER, buffer.Id(), total,
+                                      std::to_string(mode == ORPHAN ? 1 : STREAM_BUFFER_REGIONS) + " x " + std::to_string(regionBytes) + " bytes");
+    // regions start on multiples of 256 bytes, the largest GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT allowed
+    for (int view = 0; view < (regionViews ? STREAM_BUFFER_REGIONS : 1); view++)
+    {
+      textures[view] = TextureHandle::Generate();
+      glBindTexture(GL_TEXTURE_BUFFER, textures[view].Id());
+      if (regionViews)
+        glTexBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer.Id(), view * regionBytes, regionBytes);
+      else
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer.Id());
+      glBindTexture(GL_TEXTURE_BUFFER, 0);
+      GpuResources::Instance().Register(GPU_TEXTURE, textures[view].Id(), 0, "texture buffer view");
+    }
+  }
+
+  void release()
+  {
+    for (GLsync &fence : fences)
+      if (fence)
+      {
+        glDeleteSync(fence);
+        fence = 0;
+      }
+    if (mapped)
+    {
+      glBindBuffer(GL_TEXTURE_BUFFER, buffer.Id());
+      glUnmapBuffer(GL_TEXTURE_BUFFER);
+      glBindBuffer(GL_TEXTURE_BUFFER, 0);
+      mapped = nullptr;
+    }
+    for (TextureHandle &texture : textures)
+      texture.Reset();
+    buffer.Reset();
+  }
+};
+#endif
@@ -0,0 +1,540 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <stb_image.hpp>
+
+#include "gpu_resources.hpp"
+#include "profiler.hpp"
+#include "shader.hpp"
+#include "sphere.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// quads along the edge of a terrain patch
+const int TERRAIN_PATCH_QUADS = 16;
+// deepest patch level: a root patch is a whole cube face, split in 4 at each level. The heightmap is kept with a texel
+// per quad of this level around the equator at most, finer levels would only split its bilinear slopes
+const int TERRAIN_MAX_LEVEL = 7;
+// patches are split while their quads look bigger than this on screen
+const float TERRAIN_QUAD_PIXELS = 12.0f;
+// patch meshes queued for the builders, and uploaded, per frame at most
+const int TERRAIN_PATCHES_PER_FRAME = 8;
+// frames the children of a patch are kept after the last frame they were used
+const int TERRAIN_KEEP_FRAMES = 120;
+
+struct TerrainVertex
+{
+  glm::vec3 Position;
+  glm::vec3 Normal;
+  glm::vec2 TexCoords;
+};
+
+// Level of detail for the surface of a planet (model space: the unit sphere, displaced outwards by a heightmap): a
+// quadtree of patches on each face of a cube-sphere. Every frame the tree is walked from the six faces and a patch
+// is split while its quads would cover more than TERRAIN_QUAD_PIXELS on screen; patches outside the view or beyond
+// the horizon are skipped. A patch is only replaced by its children once all four have a mesh: builder threads generate
+// the vertices of the patches queued, at most PatchesPerFrame per frame, and Update() uploads those done on later
+// frames, as AssetManager does with models, so approaching the surface refines gradually instead of hitching. Cracks
+// between patches of different levels are hidden by skirts, strips hanging from the patch edges towards the center.
+// Children no longer used are freed after TERRAIN_KEEP_FRAMES, once none of their patches is being built.
+class PlanetTerrain
+{
+public:
+  // patches queued and uploaded per frame at most, TERRAIN_PATCHES_PER_FRAME by default
+  int PatchesPerFrame = TERRAIN_PATCHES_PER_FRAME;
+  // last Update(): patches drawn, deepest level drawn, patches uploaded and the time the GL thread spent on them
+  unsigned int PatchesDrawn = 0, DeepestLevel = 0, PatchesGenerated = 0;
+  float GenerateMilliseconds = 0.0f;
+
+  // heightPath: grayscale equirectangular image, read and decoded on a thread. Black is raised by height (relative to
+  // the radius), white stays at the surface, which suits an ocean mask. threads build the patch meshes
+  PlanetTerrain(const string &heightPath, float height, int threads = 2) : height(height)
+  {
+    heightLoader = std::thread([this, heightPath]
+                               {
+                                 PROFILE_THREAD("terrain heights");
+                                 loadHeights(heightPath);
+                                 heightsLoaded = true; });
+    for (int i = 0; i < threads; i++)
+      builders.emplace_back(&PlanetTerrain::builderLoop, this);
+    // the same indices for every patch: the grid, then the skirts
+    const int n = TERRAIN_PATCH_QUADS, side = n + 1;
+    vector<unsigned short> indices;
+    for (int t = 0; t < n; t++)
+      for (int s = 0; s < n; s++)
+      {
+        unsigned short a = t * side + s;
+        unsigned short quad[6] = {a, (unsigned short)(a + 1), (unsigned short)(a + side + 1), a, (unsigned short)(a + side + 1), (unsigned short)(a + side)};
+        indices.insert(indices.end(), quad, quad + 6);
+      }
+    for (int edge = 0; edge < 4; edge++)
+      for (int k = 0; k < n; k++)
+      {
+        unsigned short a = edgeVertex(edge, k), b = edgeVertex(edge, k + 1);
+        unsigned short skirtA = side * side + edge * side + k, skirtB = skirtA + 1;
+        unsigned short quad[6] = {a, b, skirtB, a, skirtB, skirtA};
+        indices.insert(indices.end(), quad, quad + 6);
+      }
+    indexCount = indices.size();
+    GpuResourceOwner owner("terrain");
+    indexBuffer = BufferHandle::Generate();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.Id());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    GpuResources::Instance().Register(GPU_BUFFER, indexBuffer.Id(), indices.size() * sizeof(unsigned short),
+                                      std::to_string(indices.size()) + " 16-bit indices, shared by the patches");
+  }
+  PlanetTerrain(const PlanetTerrain &) = delete;
+  PlanetTerrain &operator=(const PlanetTerrain &) = delete;
+  // a patch still being built is finished first
+  ~PlanetTerrain()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    wake.notify_all();
+    for (std::thread &builder : builders)
+      builder.join();
+    heightLoader.join();
+  }
+
+  // the heightmap is read and the six faces have their meshes
+  bool Ready() const
+  {
+    for (const unique_ptr<Patch> &root : roots)
+      if (!root || root->vertexArray.Id() == 0)
+        return false;
+    return true;
+  }
+
+  // blocks until the heightmap is read
+  void WaitForHeights()
+  {
+    while (!heightsLoaded)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // drops every patch below the faces, the next frames refine again from scratch. Waits for the builds under way
+  void Reset()
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      for (Patch *patch : queue)
+        patch->queued = false;
+      queue.clear();
+      idle.wait(lock, [this]
+                { return building == 0; });
+      for (Patch *patch : built)
+        patch->queued = false;
+      built.clear();
+    }
+    for (Patch *patch : finished)
+      patch->queued = false;
+    finished.clear();
+    for (unique_ptr<Patch> &root : roots)
+      if (root)
+        for (unique_ptr<Patch> &child : root->children)
+          child.reset();
+  }
+
+  // GL thread, once per frame: uploads some of the patches built, picks the patches to draw for a camera and queues
+  // some of the missing ones. transform places the planet in the world, viewportHeight (pixels) and fovY (radians)
+  // size things on screen
+  void Update(const glm::mat4 &transform, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &cameraPosition,
+              int viewportHeight, float fovY)
+  {
+    PROFILE_ZONE("terrain");
+    frame++;
+    drawList.clear();
+    wanted.clear();
+    PatchesDrawn = PatchesGenerated = DeepestLevel = 0;
+    GenerateMilliseconds = 0.0f;
+    if (!heightsLoaded)
+      return;
+    uploadBuilt();
+    if (!roots[0])
+      for (int face = 0; face < 6; face++)
+        roots[face].reset(new Patch(face, 0, 0, 0));
+    if (!Ready())
+    {
+      for (unique_ptr<Patch> &root : roots)
+        if (root->vertexArray.Id() == 0)
+          wanted.push_back(root.get());
+      enqueue(wanted.size());
+      return;
+    }
+
+    // in model space
+    glm::mat4 toModel = glm::inverse(transform);
+    camera = glm::vec3(toModel * glm::vec4(cameraPosition, 1.0f));
+    glm::mat4 clip = projection * view * transform;
+    for (int i = 0; i < 3; i++)
+    {
+      planes[i * 2] = glm::vec4(clip[0][3] + clip[0][i], clip[1][3] + clip[1][i], clip[2][3] + clip[2][i], clip[3][3] + clip[3][i]);
+      planes[i * 2 + 1] = glm::vec4(clip[0][3] - clip[0][i], clip[1][3] - clip[1][i], clip[2][3] - clip[2][i], clip[3][3] - clip[3][i]);
+    }
+    pixelsPerRadian = viewportHeight / (2.0f * tanf(fovY / 2.0f));
+    for (unique_ptr<Patch> &root : roots)
+      select(*root);
+
+    // coarse patches first, they unlock the most refinement
+    std::sort(wanted.begin(), wanted.end(), [](const Patch *a, const Patch *b)
+              { return a->level < b->level; });
+    enqueue(PatchesPerFrame);
+    for (unique_ptr<Patch> &root : roots)
+      prune(*root);
+    PatchesDrawn = drawList.size();
+  }
+
+  // draws the patches picked by Update() with shader, which has its model transform set already, and the textures of
+  // textured (the sphere the terrain stands in for) unless that's null and they're bound already
+  void Draw(Shader &shader, const Mesh *textured)
+  {
+    if (textured)
+      textured->BindTextures(shader);
+    for (const Patch *patch : drawList)
+    {
+      glBindVertexArray(patch->vertexArray.Id());
+      glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, 0);
+      frameStats.drawCalls++;
+      frameStats.triangles += indexCount / 3;
+    }
+    glBindVertexArray(0);
+  }
+
+private:
+  struct Patch
+  {
+    int face, level;
+    unsigned int x, y; // position in the face, in patches of this level
+    // bounding sphere in model space, valid once generated
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+    unsigned int lastUsed = 0;
+    bool queued = false;            // from enqueue() until uploaded, GL thread only
+    vector<TerrainVertex> vertices; // built, not uploaded yet
+    VertexArrayHandle vertexArray;
+    BufferHandle vertexBuffer;
+    unique_ptr<Patch> children[4];
+
+    Patch(int face, int level, unsigned int x, unsigned int y) : face(face), level(level), x(x), y(y) {}
+  };
+
+  float height;
+  std::thread heightLoader;
+  std::atomic<bool> heightsLoaded{false};
+  vector<unsigned char> heights;
+  int heightWidth = 0, heightHeight = 0;
+
+  vector<std::thread> builders;
+  // guards queue, built, building and stop
+  std::mutex mutex;
+  std::condition_variable wake, idle;
+  std::deque<Patch *> queue;
+  vector<Patch *> built;
+  unsigned int building = 0;
+  bool stop = false;
+  // built patches waiting for their upload, GL thread only
+  std::deque<Patch *> finished;
+
+  BufferHandle indexBuffer;
+  unsigned int indexCount;
+  unique_ptr<Patch> roots[6];
+  vector<const Patch *> drawList;
+  vector<Patch *> wanted;
+  unsigned int frame = 0;
+  // per Update(): camera in model space, frustum planes in model space, screen scale
+  glm::vec3 camera;
+  glm::vec4 planes[6];
+  float pixelsPerRadian = 1.0f;
+
+  static unsigned short edgeVertex(int edge, int k)
+  {
+    const int side = TERRAIN_PATCH_QUADS + 1;
+    return edge == 0 ? k : edge == 1 ? k * side + TERRAIN_PATCH_QUADS : edge == 2 ? TERRAIN_PATCH_QUADS * side + k : k * side;
+  }
+
+  // angle along the edge of one of the patch's quads
+  static float quadAngle(const Patch &patch)
+  {
+    return 1.5707963f / (1 << patch.level) / TERRAIN_PATCH_QUADS;
+  }
+
+  void select(Patch &patch)
+  {
+    patch.lastUsed = frame;
+    if (!visible(patch))
+      return;
+    float distance = std::max(glm::length(camera - patch.center) - patch.radius, 1e-4f);
+    if (patch.level < TERRAIN_MAX_LEVEL && quadAngle(patch) / distance * pixelsPerRadian > TERRAIN_QUAD_PIXELS)
+    {
+      bool split = true;
+      for (int i = 0; i < 4; i++)
+      {
+        if (!patch.children[i])
+          patch.children[i].reset(new Patch(patch.face, patch.level + 1, patch.x * 2 + (i & 1), patch.y * 2 + (i >> 1)));
+        patch.children[i]->lastUsed = frame;
+        if (patch.children[i]->vertexArray.Id() == 0)
+        {
+          wanted.push_back(patch.children[i].get());
+          split = false;
+        }
+      }
+      if (split)
+      {
+        for (unique_ptr<Patch> &child : patch.children)
+          select(*child);
+        return;
+      }
+    }
+    drawList.push_back(&patch);
+    DeepestLevel = std::max<unsigned int>(DeepestLevel, patch.level);
+  }
+
+  // inside the frustum and not entirely beyond the horizon
+  bool visible(const Patch &patch) const
+  {
+    for (const glm::vec4 &plane : planes)
+      if (glm::dot(glm::vec3(plane), patch.center) + plane.w < -patch.radius * glm::length(glm::vec3(plane)))
+        return false;
+    float cameraDistance = glm::length(camera);
+    if (cameraDistance <= 1.0f)
+      return true;
+    // angles from the planet's center: of the camera's horizon, of the horizon of the highest peak and of the patch
+    float centerDistance = glm::length(patch.center);
+    float horizon = acosf(1.0f / cameraDistance) + acosf(1.0f / (1.0f + height));
+    float extent = asinf(std::min(1.0f, patch.radius / std::max(centerDistance, 1e-4f)));
+    float angle = acosf(glm::clamp(glm::dot(camera / cameraDistance, patch.center / std::max(centerDistance, 1e-4f)), -1.0f, 1.0f));
+    return angle < horizon + extent;
+  }
+
+  // a patch of the tree is queued, being built or waiting for its upload
+  static bool inFlight(const Patch &patch)
+  {
+    if (patch.queued)
+      return true;
+    for (const unique_ptr<Patch> &child : patch.children)
+      if (child && inFlight(*child))
+        return true;
+    return false;
+  }
+
+  // frees the children of patches that haven't used them for a while
+  void prune(Patch &patch)
+  {
+    if (!patch.children[0])
+      return;
+    bool used = false;
+    for (unique_ptr<Patch> &child : patch.children)
+      used = used || frame - child->lastUsed < (unsigned int)TERRAIN_KEEP_FRAMES || inFlight(*child);
+    if (!used)
+    {
+      for (unique_ptr<Patch> &child : patch.children)
+        child.reset();
+      return;
+    }
+    for (unique_ptr<Patch> &child : patch.children)
+      prune(*child);
+  }
+
+  // queues up to count of the wanted patches not queued yet for the builders, in order
+  void enqueue(size_t count)
+  {
+    size_t queued = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (size_t i = 0; i < wanted.size() && queued < count; i++)
+        if (!wanted[i]->queued)
+        {
+          wanted[i]->queued = true;
+          queue.push_back(wanted[i]);
+          queued++;
+        }
+    }
+    if (queued == 1)
+      wake.notify_one();
+    else if (queued > 1)
+      wake.notify_all();
+  }
+
+  // uploads up to PatchesPerFrame of the patches the builders are done with, in the order they were done
+  void uploadBuilt()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      finished.insert(finished.end(), built.begin(), built.end());
+      built.clear();
+    }
+    if (finished.empty())
+      return;
+    auto start = std::chrono::steady_clock::now();
+    GpuResourceOwner owner("terrain");
+    for (; !finished.empty() && PatchesGenerated < (unsigned int)PatchesPerFrame; PatchesGenerated++)
+    {
+      upload(*finished.front());
+      finished.front()->queued = false;
+      finished.pop_front();
+    }
+    GenerateMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  void builderLoop()
+  {
+    PROFILE_THREAD("terrain builder");
+    for (;;)
+    {
+      Patch *patch;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]
+                  { return stop || !queue.empty(); });
+        if (stop)
+          return;
+        patch = queue.front();
+        queue.pop_front();
+        building++;
+      }
+      build(*patch);
+      std::lock_guard<std::mutex> lock(mutex);
+      built.push_back(patch);
+      if (--building == 0)
+        idle.notify_all();
+    }
+  }
+
+  // height loader thread: reads the heightmap and box filters it down to a texel per quad of the deepest level around
+  // the equator, the most the patches sample (the Earth's 10800 x 5400 ocean mask would otherwise keep 58 MB)
+  void loadHeights(const string &path)
+  {
+    int width, rows, components;
+    unsigned char *image = stbi_load(path.c_str(), &width, &rows, &components, 1);
+    if (!image)
+    {
+      std::cout << "Texture failed to load at path: " << path << std::endl;
+      return;
+    }
+    heightWidth = std::min(width, 4 * TERRAIN_PATCH_QUADS << TERRAIN_MAX_LEVEL);
+    heightHeight = std::max(2, (int)((long)rows * heightWidth / width));
+    heights.resize((size_t)heightWidth * heightHeight);
+    for (int y = 0; y < heightHeight; y++)
+    {
+      int y0 = (long)y * rows / heightHeight, y1 = std::max(y0 + 1, (int)((long)(y + 1) * rows / heightHeight));
+      for (int x = 0; x < heightWidth; x++)
+      {
+        int x0 = (long)x * width / heightWidth, x1 = std::max(x0 + 1, (int)((long)(x + 1) * width / heightWidth));
+        unsigned int sum = 0;
+        for (int sy = y0; sy < y1; sy++)
+          for (int sx = x0; sx < x1; sx++)
+            sum += image[(size_t)sy * width + sx];
+        heights[(size_t)y * heightWidth + x] = (sum + (x1 - x0) * (y1 - y0) / 2) / ((x1 - x0) * (y1 - y0));
+      }
+    }
+    stbi_image_free(image);
+  }
+
+  // height above the unit sphere at texture coordinates, bilinear
+  float heightAt(float u, float v) const
+  {
+    if (heights.empty())
+      return 0.0f;
+    float x = (u - floorf(u)) * heightWidth - 0.5f, y = glm::clamp(v, 0.0f, 1.0f) * (heightHeight - 1);
+    int x0 = (int)floorf(x), y0 = std::min((int)y, heightHeight - 2);
+    float fx = x - x0, fy = y - y0;
+    int xa = (x0 + heightWidth) % heightWidth, xb = (x0 + 1) % heightWidth;
+    const unsigned char *row0 = heights.data() + (size_t)y0 * heightWidth, *row1 = row0 + heightWidth;
+    float value = (row0[xa] * (1 - fx) + row0[xb] * fx) * (1 - fy) + (row1[xa] * (1 - fx) + row1[xb] * fx) * fy;
+    return (1.0f - value / 255.0f) * height;
+  }
+
+  // displaced surface point at (s, t) of the patch's face
+  glm::vec3 surface(const Patch &patch, float s, float t, float referenceU, glm::vec2 *texCoords = nullptr) const
+  {
+    float scale = 1.0f / (1 << patch.level);
+    glm::vec3 p = CubeSpherePoint(patch.face, (patch.x + s) * scale, (patch.y + t) * scale);
+    float u = UnwrapU(SphereU(p), referenceU), v = SphereV(p);
+    if (p.x * p.x + p.z * p.z < 1e-12f)
+      u = referenceU;
+    if (texCoords)
+      *texCoords = glm::vec2(u, v);
+    return p * (1.0f + heightAt(u, v));
+  }
+
+  // builder thread: vertices and bounds of a patch
+  void build(Patch &patch) const
+  {
+    const int n = TERRAIN_PATCH_QUADS, side = n + 1;
+    const float step = 1.0f / n;
+    float referenceU = SphereU(CubeSpherePoint(patch.face, (patch.x + 0.5f) / (1 << patch.level), (patch.y + 0.5f) / (1 << patch.level)));
+    patch.vertices.resize(side * side + 4 * side);
+    for (int t = 0; t < side; t++)
+      for (int s = 0; s < side; s++)
+      {
+        TerrainVertex &vertex = patch.vertices[t * side + s];
+        vertex.Position = surface(patch, s * step, t * step, referenceU, &vertex.TexCoords);
+        // central differences, across the patch's edges too
+        glm::vec3 ds = surface(patch, (s + 1) * step, t * step, referenceU) - surface(patch, (s - 1) * step, t * step, referenceU);
+        glm::vec3 dt = surface(patch, s * step, (t + 1) * step, referenceU) - surface(patch, s * step, (t - 1) * step, referenceU);
+        glm::vec3 normal = glm::cross(ds, dt);
+        vertex.Normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::normalize(vertex.Position);
+      }
+    // skirts deep enough to cover the gap to a coarser neighbour, which is about a quad of this level on smooth ground
+    // and at most the whole height at a cliff
+    float skirt = quadAngle(patch) + std::min(height, 4.0f * quadAngle(patch));
+    for (int edge = 0; edge < 4; edge++)
+      for (int k = 0; k < side; k++)
+      {
+        TerrainVertex &vertex = patch.vertices[side * side + edge * side + k];
+        vertex = patch.vertices[edgeVertex(edge, k)];
+        vertex.Position -= glm::normalize(vertex.Position) * skirt;
+      }
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (const TerrainVertex &vertex : patch.vertices)
+    {
+      lo = glm::min(lo, vertex.Position);
+      hi = glm::max(hi, vertex.Position);
+    }
+    patch.center = (lo + hi) * 0.5f;
+    patch.radius = 0.0f;
+    for (const TerrainVertex &vertex : patch.vertices)
+      patch.radius = std::max(patch.radius, glm::length(vertex.Position - patch.center));
+  }
+
+  void upload(Patch &patch)
+  {
+    patch.vertexArray = VertexArrayHandle::Generate();
+    patch.vertexBuffer = BufferHandle::Generate();
+    glBindVertexArray(patch.vertexArray.Id());
+    glBindBuffer(GL_ARRAY_BUFFER, patch.vertexBuffer.Id());
+    glBufferData(GL_ARRAY_BUFFER, patch.vertices.size() * sizeof(TerrainVertex), &patch.vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.Id());
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void *)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void *)offsetof(TerrainVertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void *)offsetof(TerrainVertex, TexCoords));
+    glBindVertexArray(0);
+    GpuResources::Instance().Register(GPU_VERTEX_ARRAY, patch.vertexArray.Id(), 0, "vertex array");
+    GpuResources::Instance().Register(GPU_BUFFER, patch.vertexBuffer.Id(), patch.vertices.size() * sizeof(TerrainVertex),
+                                      "patch level " + std::to_string(patch.level));
+    vector<TerrainVertex>().swap(patch.vertices);
+  }
+};
+#endif
@@ -0,0 +1,137 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include "gpu_resources.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+// texture unit of the shaders' texture_array sampler. No sampler2D uses it, samplers of different types must not share
+// a unit
+const int TEXTURE_ARRAY_UNIT = 7;
+
+// where a packed texture went: which of the packer's arrays and which layer of it
+struct TextureLayer
+{
+  int array = -1;
+  int layer = 0;
+};
+
+// Packs textures of the same size and format into GL_TEXTURE_2D_ARRAYs, a layer each, so that draws using any of
+// them share one bind and pick their texture by layer (the shaders take the layer from the instance data, see
+// planets.vs). Images are collected with Add() and packed all at once by Pack(), since an array's layer count is
+// fixed when it's allocated. A group larger than GL_MAX_ARRAY_TEXTURE_LAYERS (at least 256) is split over several
+// arrays, filled in the order the images were added. GL thread only
+class TextureArrayPacker
+{
+public:
+  // copies a decoded image for packing, returns its index for Layer()
+  int Add(const unsigned char *pixels, int width, int height, int components)
+  {
+    Image &image = images.emplace_back();
+    image.pixels.assign(pixels, pixels + (size_t)width * height * components);
+    image.width = width;
+    image.height = height;
+    image.components = components;
+    return (int)images.size() - 1;
+  }
+
+  // creates the arrays of the images added so far, with mipmaps, and frees the copies. name is their owner in the
+  // GPU resource registry
+  void Pack(const string &name)
+  {
+    GpuResourceOwner owner(name);
+    int maxLayers = 256;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    // images by size and format, in the order they were added
+    std::map<std::tuple<int, int, int>, vector<int>> groups;
+    for (int i = 0; i < (int)images.size(); i++)
+      groups[std::make_tuple(images[i].width, images[i].height, images[i].components)].push_back(i);
+    layers.assign(images.size(), TextureLayer());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const auto &group : groups)
+    {
+      int width, height, components;
+      std::tie(width, height, components) = group.first;
+      GLenum format = components == 1 ? GL_RED : components == 3 ? GL_RGB : GL_RGBA;
+      GLenum internalFormat = components == 1 ? GL_R8 : components == 3 ? GL_RGB8 : GL_RGBA8;
+      const vector<int> &members = group.second;
+      for (size_t first = 0; first < members.size(); first += maxLayers)
+      {
+        int count = (int)std::min<size_t>(maxLayers, members.size() - first);
+        TextureHandle array = TextureHandle::Generate();
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.Id());
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, width, height, count, 0, format, GL_UNSIGNED_BYTE, NULL);
+        for (int layer = 0; layer < count; layer++)
+        {
+          int image = members[first + layer];
+          glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE, images[image].pixels.data());
+          layers[image].array = (int)arrays.size();
+          layers[image].layer = layer;
+        }
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // the mip chain adds a third
+        unsigned long arrayBytes = (unsigned long)width * height * components * count * 4 / 3;
+        bytes += arrayBytes;
+        GpuResources::Instance().Register(GPU_TEXTURE, array.Id(), arrayBytes,
+                                          string(components == 1 ? "R8 " : components == 3 ? "RGB8 " : "RGBA8 ") + std::to_string(width) + "x" +
+                                              std::to_string(height) + "x" + std::to_string(count) + " array +mips");
+        arrays.push_back(std::move(array));
+      }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    images.clear();
+    images.shrink_to_fit();
+  }
+
+  // where image index (returned by Add()) went, once packed
+  const TextureLayer &Layer(int index) const
+  {
+    return layers[index];
+  }
+
+  unsigned int ArrayCount() const
+  {
+    return arrays.size();
+  }
+
+  // binds array (TextureLayer::array) to unit
+  void Bind(int array, int unit = TEXTURE_ARRAY_UNIT) const
+  {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[array].Id());
+    glActiveTexture(GL_TEXTURE0);
+    frameStats.textureBinds++;
+  }
+
+  // GPU memory of the arrays
+  unsigned long Bytes() const
+  {
+    return bytes;
+  }
+
+private:
+  struct Image
+  {
+    vector<unsigned char> pixels;
+    int width = 0, height = 0, components = 0;
+  };
+
+  vector<Image> images;
+  vector<TextureLayer> layers;
+  vector<TextureHandle> arrays;
+  unsigned long bytes = 0;
+};
+#endif
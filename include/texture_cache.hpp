@@ -0,0 +1,199 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "gpu_resources.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// defined in model.hpp
+TextureHandle TextureFromMemory(const unsigned char *bytes, size_t size, const string &filename, bool gamma = false,
+                                unsigned long *gpuBytes = nullptr);
+
+// an image file read and hashed, for lookups in the TextureCache
+struct ImageFile
+{
+  string path; // canonical
+  vector<unsigned char> contents;
+  uint64_t hash = 0; // 0 when the file is empty, missing or unreadable
+
+  // any thread
+  explicit ImageFile(const string &path)
+  {
+    std::error_code error;
+    this->path = std::filesystem::weakly_canonical(path, error).string();
+    if (error)
+      this->path = path;
+    std::ifstream file(this->path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (contents.empty())
+      return;
+    // FNV-1a
+    hash = 14695981039346656037ull;
+    for (unsigned char byte : contents)
+    {
+      hash ^= byte;
+      hash *= 1099511628211ull;
+    }
+  }
+};
+
+struct CachedTexture
+{
+  TextureHandle handle;
+  string path;      // canonical path of the file it was decoded from
+  uint64_t hash;    // FNV-1a of the file contents
+  size_t fileSize;
+  unsigned long bytes; // GPU memory
+};
+
+// a texture is freed when the last of these goes away
+typedef shared_ptr<CachedTexture> SharedTexture;
+
+// Process wide texture cache, GL thread only but for Contains(). Textures are found by canonical path first, then by
+// content so that the same image under another name (a copy, a different relative path) is still decoded and uploaded
+// once: a hash narrows the search, the bytes are compared before a texture is shared. Empty files (missing, unreadable)
+// are never cached. The cache only holds weak references: a texture is evicted as soon as no model uses it anymore.
+class TextureCache
+{
+public:
+  static TextureCache &Instance()
+  {
+    static TextureCache cache;
+    return cache;
+  }
+
+  // the texture of an image file, decoded and uploaded unless it's already loaded
+  SharedTexture Acquire(const string &path)
+  {
+    ImageFile image(path);
+    if (SharedTexture texture = Find(image))
+      return texture;
+    unsigned long bytes;
+    TextureHandle handle = TextureFromMemory(image.contents.data(), image.contents.size(), image.path, false, &bytes);
+    return Insert(image, std::move(handle), bytes);
+  }
+
+  // whether an image file is loaded, from any thread. It may still be evicted before Find() is called
+  bool Contains(const ImageFile &image)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto byPathFound = byPath.find(image.path);
+      if (byPathFound != byPath.end() && !byPathFound->second.expired())
+        return true;
+    }
+    return sameContents(image);
+  }
+
+  // the loaded texture of an image file if there is one, counts a request
+  SharedTexture Find(const ImageFile &image)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      requests++;
+      auto byPathFound = byPath.find(image.path);
+      if (byPathFound != byPath.end())
+        if (SharedTexture texture = byPathFound->second.lock())
+        {
+          pathHits++;
+          bytesSaved += texture->bytes;
+          return texture;
+        }
+    }
+    if (!sameContents(image))
+      return nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto byHashFound = byHash.find(image.hash);
+    if (byHashFound != byHash.end())
+      if (SharedTexture texture = byHashFound->second.texture.lock())
+      {
+        contentHits++;
+        bytesSaved += texture->bytes;
+        byPath[image.path] = texture;
+        return texture;
+      }
+    return nullptr;
+  }
+
+  // adds the texture uploaded from an image that Find() didn't know
+  SharedTexture Insert(const ImageFile &image, TextureHandle handle, unsigned long bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    decoded++;
+    SharedTexture texture(new CachedTexture{std::move(handle), image.path, image.hash, image.contents.size(), bytes}, [](CachedTexture *texture)
+                          {
+                            delete texture;
+                            TextureCache::Instance().evict(); });
+    if (image.contents.empty())
+      return texture;
+    byPath[image.path] = texture;
+    byHash[image.hash] = {texture, image.path, image.contents.size()};
+    return texture;
+  }
+
+  void PrintStats() const
+  {
+    unsigned long hits = pathHits + contentHits;
+    printf("TEXTURE_CACHE:: %lu requests, %lu hits (%lu by path, %lu by content), hit rate %.1f%%, %lu decoded, %.2f MB saved, %lu evicted\n",
+           requests, hits, pathHits, contentHits, requests ? 100.0 * hits / requests : 0.0, decoded, bytesSaved / 1048576.0, evicted);
+    fflush(stdout);
+  }
+
+private:
+  // the file a texture was decoded from, kept by the hash entry so that Contains() never holds a texture: the last
+  // reference going away on a loader thread would free it there
+  struct HashEntry
+  {
+    weak_ptr<CachedTexture> texture;
+    string path;
+    size_t fileSize;
+  };
+
+  // guards the maps, which Contains() reads from loader threads
+  std::mutex mutex;
+  std::unordered_map<string, weak_ptr<CachedTexture>> byPath;
+  std::unordered_map<uint64_t, HashEntry> byHash;
+  unsigned long requests = 0, pathHits = 0, contentHits = 0, decoded = 0, evicted = 0;
+  unsigned long bytesSaved = 0;
+
+  TextureCache() {}
+
+  // the texture cached under the image's hash was decoded from the same bytes, read again from its file. Any thread
+  bool sameContents(const ImageFile &image)
+  {
+    string path;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto found = byHash.find(image.hash);
+      if (image.contents.empty() || found == byHash.end() || found->second.texture.expired() ||
+          found->second.fileSize != image.contents.size())
+        return false;
+      path = found->second.path;
+    }
+    std::ifstream file(path, std::ios::binary);
+    vector<unsigned char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return contents == image.contents;
+  }
+
+  // drops the entries of textures that were just freed
+  void evict()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    evicted++;
+    for (auto it = byPath.begin(); it != byPath.end();)
+      it = it->second.expired() ? byPath.erase(it) : std::next(it);
+    for (auto it = byHash.begin(); it != byHash.end();)
+      it = it->second.texture.expired() ? byHash.erase(it) : std::next(it);
+  }
+};
+#endif
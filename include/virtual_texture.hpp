@@ -0,0 +1,743 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glm/glm.hpp>
+#include <stb_image.hpp>
+
+#include "gpu_resources.hpp"
+#include "profiler.hpp"
+#include "shader.hpp"
+#include "stats.hpp"
+#include "texture_cache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// texels along the edge of a tile, and the border copied from the neighbouring texels around it so that bilinear
+// filtering doesn't bleed into the next tile of the cache
+const int VT_TILE_SIZE = 128;
+const int VT_TILE_BORDER = 1;
+const int VT_TILE_PADDED = VT_TILE_SIZE + 2 * VT_TILE_BORDER;
+// tiles along the edge of the physical cache: 144 tiles, a 1280x720 view at one texel per pixel needs about 60 of
+// them plus their coarser levels
+const int VT_CACHE_TILES = 12;
+// tiles uploaded into the cache per frame at most
+const int VT_UPLOADS_PER_FRAME = 16;
+// tiles not asked for by the last few feedbacks are dropped from the upload queue, the view moved on
+const unsigned int VT_STALE_FEEDBACKS = 4;
+// the feedback pass renders at 1/VT_FEEDBACK_SCALE of the framebuffer size
+const int VT_FEEDBACK_SCALE = 8;
+// texture units of the tile cache and the indirection texture
+const int VT_CACHE_UNIT = 11;
+const int VT_INDIRECTION_UNIT = 12;
+// texture unit of the whole image, drawn while the virtual texture isn't, see BindWhole()
+const int VT_WHOLE_UNIT = 5;
+
+// Page file: this header, padded to VT_PAGE_ALIGNMENT bytes, then the tiles of every level, level 0 first, row by
+// row, VT_TILE_PADDED x VT_TILE_PADDED texels of components bytes each. Level 0 is the source image resampled to a
+// power of two number of tiles each way, each level halves it until it is one tile
+struct PageFileHeader
+{
+  char magic[8];
+  uint64_t sourceHash; // FNV-1a of the source image file
+  uint32_t tileSize, tileBorder;
+  uint32_t sourceWidth, sourceHeight;
+  uint32_t pagesX, pagesY; // tiles of level 0
+  uint32_t levels;
+  uint32_t components;
+};
+const char VT_PAGE_MAGIC[8] = "PLNTVT1";
+const size_t VT_PAGE_ALIGNMENT = 4096;
+
+// Virtual texture: an image too big to keep on the GPU whole is cut into tiles of its mip chain, stored once in a page
+// file under PageDirectory and memory mapped. A feedback pass (VirtualTextureFeedback) tells which tiles the view
+// needs, a loader thread pages them in, and Update() copies them into a fixed cache texture of VT_CACHE_TILES^2
+// tiles, evicting the least recently needed ones. The indirection texture has a texel per tile of every level with
+// the cache slot of the finest resident tile covering it, so a missing tile is drawn from a coarser one meanwhile
+// and the coarsest level, one tile, is always resident. The shaders sample it with sampleVirtual(). The model drawing
+// the image doesn't load it: BindWhole() uploads the whole image only for the frames the virtual texture can't be
+// drawn, and ReleaseWhole() lets it go again, so that the image isn't resident twice.
+class VirtualTexture
+{
+public:
+  // directory of the page files, relative to the working directory
+  static inline string PageDirectory = "cache/pages";
+
+  // since the last Reset(): tiles uploaded, and the time from the feedback asking for them to their upload
+  unsigned long TilesLoaded = 0;
+  float MissMilliseconds = 0.0f, WorstMissMilliseconds = 0.0f;
+
+  // the page file is built from imagePath, if it isn't already, on the loader thread
+  VirtualTexture(const string &imagePath) : imagePath(imagePath)
+  {
+    loader = std::thread(&VirtualTexture::loaderLoop, this);
+  }
+  VirtualTexture(const VirtualTexture &) = delete;
+  VirtualTexture &operator=(const VirtualTexture &) = delete;
+  ~VirtualTexture()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    wake.notify_all();
+    loader.join();
+    if (mapped)
+      munmap(mapped, mappedBytes);
+    if (fd >= 0)
+      close(fd);
+  }
+
+  // the textures exist and the coarsest level is resident
+  bool Ready() const
+  {
+    return cache.Id() != 0;
+  }
+
+  // blocks until the page file is open (or failed to)
+  void WaitForPages()
+  {
+    while (!opened)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // GL thread, once per frame: creates the textures once the page file is open, then uploads up to
+  // VT_UPLOADS_PER_FRAME of the tiles paged in by the loader
+  void Update()
+  {
+    if (!cache.Id())
+    {
+      if (!opened || !mapped)
+        return;
+      createTextures();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      uploadQueue.insert(uploadQueue.end(), loaded.begin(), loaded.end());
+      loaded.clear();
+    }
+    int uploads = 0;
+    size_t done = 0;
+    auto now = std::chrono::steady_clock::now();
+    for (; done < uploadQueue.size() && uploads < VT_UPLOADS_PER_FRAME; done++)
+    {
+      unsigned int tile = uploadQueue[done];
+      tileQueued[tile] = false;
+      if (tileSlot[tile] >= 0 || feedbacks - tileSeen[tile] > VT_STALE_FEEDBACKS)
+        continue;
+      int slot = evictionSlot();
+      // everything resident is in view, the tile will be asked for again
+      if (slot < 0)
+        continue;
+      upload(tile, slot);
+      uploads++;
+      float ms = std::chrono::duration<float, std::milli>(now - requestTimes[tile]).count();
+      TilesLoaded++;
+      MissMilliseconds += ms;
+      WorstMissMilliseconds = std::max(WorstMissMilliseconds, ms);
+    }
+    uploadQueue.erase(uploadQueue.begin(), uploadQueue.begin() + done);
+    if (uploads > 0)
+      updateIndirection();
+  }
+
+  // tiles asked for by a feedback pass, see vt_feedback.fs: RGBA16 texels of texture coordinates and the log2 of
+  // their footprint along u and v, rendered at 1/scale of the resolution. Asks the loader for the tiles, and their
+  // coarser ancestors, that aren't resident
+  void Request(const unsigned short *texels, size_t count, int scale)
+  {
+    if (!cache.Id())
+      return;
+    feedbacks++;
+    wanted.clear();
+    auto now = std::chrono::steady_clock::now();
+    float bias = -log2f((float)scale);
+    float logWidth = log2f((float)header.pagesX * VT_TILE_SIZE), logHeight = log2f((float)header.pagesY * VT_TILE_SIZE);
+    for (size_t i = 0; i < count; i++, texels += 4)
+    {
+      // cleared, nothing virtual textured there
+      if (texels[2] == 0)
+        continue;
+      float u = texels[0] / 65535.0f, v = texels[1] / 65535.0f;
+      float footprintU = texels[2] / 65535.0f * 32.0f - 32.0f + bias, footprintV = texels[3] / 65535.0f * 32.0f - 32.0f + bias;
+      float lod = std::max(footprintU + logWidth, footprintV + logHeight);
+      int level = std::min(std::max((int)floorf(lod), 0), (int)header.levels - 1);
+      unsigned int x = std::min((unsigned int)(u * pagesX(level)), pagesX(level) - 1);
+      unsigned int y = std::min((unsigned int)(v * pagesY(level)), pagesY(level) - 1);
+      // the tile and its ancestors, up to one seen already with its own ancestors
+      for (; level < (int)header.levels; level++, x >>= 1, y >>= 1)
+      {
+        unsigned int tile = tileIndex(level, x, y);
+        if (tileSeen[tile] == feedbacks)
+          break;
+        tileSeen[tile] = feedbacks;
+        if (tileSlot[tile] < 0 && !tileQueued[tile])
+        {
+          tileQueued[tile] = true;
+          requestTimes[tile] = now;
+          wanted.push_back(tile);
+        }
+      }
+    }
+    if (wanted.empty())
+      return;
+    // coarse levels first, they have the highest indices and stand in for the most tiles
+    std::sort(wanted.begin(), wanted.end(), [](unsigned int a, unsigned int b)
+              { return a > b; });
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.insert(pending.end(), wanted.begin(), wanted.end());
+    }
+    wake.notify_one();
+  }
+
+  // evicts every tile but the coarsest level and clears the statistics
+  void Reset()
+  {
+    if (!cache.Id())
+      return;
+    for (size_t slot = 0; slot < slotTiles.size(); slot++)
+      if (slotTiles[slot] >= 0 && slotTiles[slot] != (int)tileCount - 1)
+      {
+        tileSlot[slotTiles[slot]] = -1;
+        slotTiles[slot] = -1;
+      }
+    updateIndirection();
+    TilesLoaded = 0;
+    MissMilliseconds = WorstMissMilliseconds = 0.0f;
+  }
+
+  // binds the textures and sets the uniforms of sampleVirtual() in shader, which is in use
+  void Bind(Shader &shader)
+  {
+    glActiveTexture(GL_TEXTURE0 + VT_CACHE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, cache.Id());
+    glActiveTexture(GL_TEXTURE0 + VT_INDIRECTION_UNIT);
+    glBindTexture(GL_TEXTURE_2D, indirection.Id());
+    glActiveTexture(GL_TEXTURE0);
+    frameStats.textureBinds += 2;
+    float cacheSize = (float)VT_CACHE_TILES * VT_TILE_PADDED;
+    shader.setBool("virtualTexture", true);
+    shader.setInt("vtCache", VT_CACHE_UNIT);
+    shader.setInt("vtIndirection", VT_INDIRECTION_UNIT);
+    shader.setVec2("vtSize", glm::vec2(header.pagesX * VT_TILE_SIZE, header.pagesY * VT_TILE_SIZE));
+    shader.setInt("vtLevels", header.levels);
+    shader.setVec3("vtCacheLayout", glm::vec3(VT_TILE_PADDED, VT_TILE_BORDER, VT_TILE_SIZE) / cacheSize);
+  }
+
+  // binds the whole image as an ordinary texture for the draws with shader, which is in use, instead of the virtual
+  // texture: before it's Ready() or when it's turned off. Uploaded (through the TextureCache) the first time
+  void BindWhole(Shader &shader)
+  {
+    if (!whole)
+      whole = TextureCache::Instance().Acquire(imagePath);
+    glActiveTexture(GL_TEXTURE0 + VT_WHOLE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, whole->handle.Id());
+    glActiveTexture(GL_TEXTURE0);
+    frameStats.textureBinds++;
+    shader.setBool("virtualTexture", false);
+    shader.setInt("texture_diffuse1", VT_WHOLE_UNIT);
+  }
+
+  // frees the whole image once the virtual texture is drawn
+  void ReleaseWhole()
+  {
+    whole.reset();
+  }
+
+  // GPU memory of the cache and indirection textures (and of the whole image while it's bound instead), and what the
+  // whole image would take with its mip chain
+  unsigned long ResidentBytes() const
+  {
+    return cacheBytes + indirectionBytes + (whole ? whole->bytes : 0);
+  }
+  unsigned long FullBytes() const
+  {
+    return (unsigned long)header.sourceWidth * header.sourceHeight * header.components * 4 / 3;
+  }
+
+  void PrintStats(const string &name) const
+  {
+    unsigned int resident = 0;
+    for (int tile : slotTiles)
+      resident += tile >= 0;
+    printf("VIRTUAL_TEXTURE:: %s: %.2f MB resident (%u of %u tiles) vs %.2f MB for the whole texture, %lu tiles loaded, "
+           "miss latency %.1f ms mean %.1f ms worst\n",
+           name.c_str(), ResidentBytes() / 1048576.0, resident, tileCount, FullBytes() / 1048576.0, TilesLoaded,
+           TilesLoaded ? MissMilliseconds / TilesLoaded : 0.0f, WorstMissMilliseconds);
+    fflush(stdout);
+  }
+
+private:
+  string imagePath;
+  SharedTexture whole;
+  PageFileHeader header = {};
+  unsigned int tileCount = 0;
+  size_t tileBytes = 0;
+  vector<unsigned int> levelStart; // index of the first tile of each level
+  int fd = -1;
+  unsigned char *mapped = nullptr;
+  size_t mappedBytes = 0;
+  std::atomic<bool> opened{false};
+
+  TextureHandle cache, indirection;
+  unsigned long cacheBytes = 0, indirectionBytes = 0;
+  // per tile: cache slot or -1, last feedback asking for it, waiting for the loader or an upload, when it was asked for
+  vector<int> tileSlot;
+  vector<unsigned int> tileSeen;
+  vector<bool> tileQueued;
+  vector<std::chrono::steady_clock::time_point> requestTimes;
+  // per cache slot: tile or -1
+  vector<int> slotTiles;
+  // indirection texels (slot x, slot y, resident level, 255) of every tile, laid out as the tiles
+  vector<uint32_t> entries;
+  unsigned int feedbacks = 0;
+  vector<unsigned int> wanted, uploadQueue;
+
+  std::thread loader;
+  // guards pending, loaded and stop. Sized for every tile up front, a tile is in at most one of them
+  std::mutex mutex;
+  std::condition_variable wake;
+  vector<unsigned int> pending, loaded, paging;
+  bool stop = false;
+
+  unsigned int pagesX(int level) const
+  {
+    return std::max(1u, header.pagesX >> level);
+  }
+  unsigned int pagesY(int level) const
+  {
+    return std::max(1u, header.pagesY >> level);
+  }
+  unsigned int tileIndex(int level, unsigned int x, unsigned int y) const
+  {
+    return levelStart[level] + y * pagesX(level) + x;
+  }
+  const unsigned char *tileData(unsigned int tile) const
+  {
+    return mapped + VT_PAGE_ALIGNMENT + tile * tileBytes;
+  }
+
+  void loaderLoop()
+  {
+    PROFILE_THREAD("virtual texture");
+    openPageFile();
+    opened = true;
+    for (;;)
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]
+                  { return stop || !pending.empty(); });
+        if (stop)
+          return;
+        paging.swap(pending);
+      }
+      // touching every page of the tile faults it in here rather than in the upload on the GL thread
+      for (unsigned int tile : paging)
+      {
+        const volatile unsigned char *bytes = tileData(tile);
+        unsigned char sum = 0;
+        for (size_t offset = 0; offset < tileBytes; offset += 4096)
+          sum += bytes[offset];
+        (void)sum;
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      loaded.insert(loaded.end(), paging.begin(), paging.end());
+      paging.clear();
+    }
+  }
+
+  // maps the page file, building it first if it's missing or stale
+  void openPageFile()
+  {
+    ImageFile image(imagePath);
+    string pagePath = PageDirectory + "/" + std::filesystem::path(imagePath).filename().string() + ".pages";
+    if (!validPageFile(pagePath, image.hash) && !buildPageFile(image, pagePath))
+      return;
+    fd = open(pagePath.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+      return;
+    void *memory = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED)
+      return;
+    memcpy(&header, memory, sizeof(header));
+    tileBytes = (size_t)VT_TILE_PADDED * VT_TILE_PADDED * header.components;
+    for (unsigned int level = 0; level < header.levels; level++)
+    {
+      levelStart.push_back(tileCount);
+      tileCount += pagesX(level) * pagesY(level);
+    }
+    tileSlot.assign(tileCount, -1);
+    tileSeen.assign(tileCount, 0);
+    tileQueued.assign(tileCount, false);
+    requestTimes.resize(tileCount);
+    entries.assign(tileCount, 0);
+    for (vector<unsigned int> *queue : {&wanted, &uploadQueue, &pending, &loaded, &paging})
+      queue->reserve(tileCount);
+    mappedBytes = info.st_size;
+    mapped = (unsigned char *)memory;
+  }
+
+  bool validPageFile(const string &path, uint64_t hash) const
+  {
+    std::ifstream file(path, std::ios::binary);
+    PageFileHeader existing;
+    if (!file.read(reinterpret_cast<char *>(&existing), sizeof(existing)))
+      return false;
+    return memcmp(existing.magic, VT_PAGE_MAGIC, sizeof(VT_PAGE_MAGIC)) == 0 && existing.sourceHash == hash &&
+           existing.tileSize == VT_TILE_SIZE && existing.tileBorder == VT_TILE_BORDER;
+  }
+
+  // decodes the image, resamples it to whole tiles and writes every level's tiles. Written to a temporary file then
+  // renamed, so that an interrupted build is never mistaken for a page file
+  bool buildPageFile(const ImageFile &image, const string &path) const
+  {
+    PROFILE_ZONE("build page file");
+    auto start = std::chrono::steady_clock::now();
+    int width, height, components;
+    unsigned char *pixels = stbi_load_from_memory(image.contents.data(), (int)image.contents.size(), &width, &height, &components, 0);
+    // no two channel textures in GL 3.3 core without swizzles, use RGBA
+    if (pixels && components == 2)
+    {
+      stbi_image_free(pixels);
+      pixels = stbi_load_from_memory(image.contents.data(), (int)image.contents.size(), &width, &height, &components, 4);
+      components = 4;
+    }
+    if (!pixels)
+    {
+      std::cout << "Texture failed to load at path: " << imagePath << std::endl;
+      return false;
+    }
+
+    PageFileHeader built = {};
+    memcpy(built.magic, VT_PAGE_MAGIC, sizeof(VT_PAGE_MAGIC));
+    built.sourceHash = image.hash;
+    built.tileSize = VT_TILE_SIZE;
+    built.tileBorder = VT_TILE_BORDER;
+    built.sourceWidth = width;
+    built.sourceHeight = height;
+    built.pagesX = built.pagesY = 1;
+    while (built.pagesX * VT_TILE_SIZE < (unsigned int)width)
+      built.pagesX *= 2;
+    while (built.pagesY * VT_TILE_SIZE < (unsigned int)height)
+      built.pagesY *= 2;
+    built.levels = 1;
+    while ((std::max(built.pagesX, built.pagesY) >> (built.levels - 1)) > 1)
+      built.levels++;
+    built.components = components;
+
+    // level 0, bilinear, wrapping around in u like the sphere's texture coordinates and clamped in v
+    int levelWidth = built.pagesX * VT_TILE_SIZE, levelHeight = built.pagesY * VT_TILE_SIZE;
+    vector<unsigned char> level((size_t)levelWidth * levelHeight * components);
+    for (int y = 0; y < levelHeight; y++)
+    {
+      float sy = std::min(std::max((y + 0.5f) * height / levelHeight - 0.5f, 0.0f), height - 1.0f);
+      int y0 = (int)sy, y1 = std::min(y0 + 1, height - 1);
+      float fy = sy - y0;
+      for (int x = 0; x < levelWidth; x++)
+      {
+        float sx = (x + 0.5f) * width / levelWidth - 0.5f;
+        int x0 = (int)floorf(sx);
+        float fx = sx - x0;
+        int xa = (x0 + width) % width, xb = (x0 + 1) % width;
+        for (int c = 0; c < components; c++)
+        {
+          auto at = [&](int px, int py)
+          { return (float)pixels[((size_t)py * width + px) * components + c]; };
+          float value = (at(xa, y0) * (1 - fx) + at(xb, y0) * fx) * (1 - fy) + (at(xa, y1) * (1 - fx) + at(xb, y1) * fx) * fy;
+          level[((size_t)y * levelWidth + x) * components + c] = (unsigned char)(value + 0.5f);
+        }
+      }
+    }
+    stbi_image_free(pixels);
+
+    std::error_code error;
+    std::filesystem::create_directories(PageDirectory, error);
+    string temporary = path + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+      std::cout << "VIRTUAL_TEXTURE:: cannot write " << temporary << std::endl;
+      return false;
+    }
+    vector<char> padding(VT_PAGE_ALIGNMENT - sizeof(built), 0);
+    file.write(reinterpret_cast<const char *>(&built), sizeof(built));
+    file.write(padding.data(), padding.size());
+    vector<unsigned char> tile((size_t)VT_TILE_PADDED * VT_TILE_PADDED * components);
+    unsigned long tiles = 0;
+    for (unsigned int l = 0; l < built.levels; l++)
+    {
+      int tilesX = levelWidth / VT_TILE_SIZE, tilesY = levelHeight / VT_TILE_SIZE;
+      for (int ty = 0; ty < tilesY; ty++)
+        for (int tx = 0; tx < tilesX; tx++, tiles++)
+        {
+          for (int y = 0; y < VT_TILE_PADDED; y++)
+          {
+            int sy = std::min(std::max(ty * VT_TILE_SIZE + y - VT_TILE_BORDER, 0), levelHeight - 1);
+            for (int x = 0; x < VT_TILE_PADDED; x++)
+            {
+              int sx = (tx * VT_TILE_SIZE + x - VT_TILE_BORDER + levelWidth) % levelWidth;
+              memcpy(&tile[((size_t)y * VT_TILE_PADDED + x) * components], &level[((size_t)sy * levelWidth + sx) * components], components);
+            }
+          }
+          file.write(reinterpret_cast<const char *>(tile.data()), tile.size());
+        }
+      // the next level halves each way that is still more than a tile, 2x2 or 2x1 box filter
+      int nextWidth = std::max(VT_TILE_SIZE, levelWidth / 2), nextHeight = std::max(VT_TILE_SIZE, levelHeight / 2);
+      int stepX = levelWidth / nextWidth, stepY = levelHeight / nextHeight;
+      vector<unsigned char> next((size_t)nextWidth * nextHeight * components);
+      for (int y = 0; y < nextHeight; y++)
+        for (int x = 0; x < nextWidth; x++)
+          for (int c = 0; c < components; c++)
+          {
+            unsigned int sum = 0;
+            for (int dy = 0; dy < stepY; dy++)
+              for (int dx = 0; dx < stepX; dx++)
+                sum += level[((size_t)(y * stepY + dy) * levelWidth + x * stepX + dx) * components + c];
+            next[((size_t)y * nextWidth + x) * components + c] = (unsigned char)((sum + stepX * stepY / 2) / (stepX * stepY));
+          }
+      level.swap(next);
+      levelWidth = nextWidth;
+      levelHeight = nextHeight;
+    }
+    file.close();
+    if (!file)
+    {
+      std::cout << "VIRTUAL_TEXTURE:: cannot write " << temporary << std::endl;
+      return false;
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+      return false;
+    printf("VIRTUAL_TEXTURE:: built %s: %ux%u tiles, %u levels, %lu tiles in %.1f ms\n", path.c_str(), built.pagesX, built.pagesY,
+           built.levels, tiles, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return true;
+  }
+
+  // GL thread: the cache, the indirection texture with a mip level per tile level, and the coarsest tile
+  void createTextures()
+  {
+    GpuResourceOwner owner("virtual texture " + std::filesystem::path(imagePath).filename().string());
+    GLenum format = header.components == 1 ? GL_RED : header.components == 3 ? GL_RGB : GL_RGBA;
+    GLenum internalFormat = header.components == 1 ? GL_R8 : header.components == 3 ? GL_RGB8 : GL_RGBA8;
+    int cacheSize = VT_CACHE_TILES * VT_TILE_PADDED;
+    cache = TextureHandle::Generate();
+    glBindTexture(GL_TEXTURE_2D, cache.Id());
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, cacheSize, cacheSize, 0, format, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    cacheBytes = (unsigned long)cacheSize * cacheSize * header.components;
+    GpuResources::Instance().Register(GPU_TEXTURE, cache.Id(), cacheBytes,
+                                      std::to_string(VT_CACHE_TILES * VT_CACHE_TILES) + " tile cache " + std::to_string(cacheSize) + "x" +
+                                          std::to_string(cacheSize));
+
+    indirection = TextureHandle::Generate();
+    glBindTexture(GL_TEXTURE_2D, indirection.Id());
+    indirectionBytes = 0;
+    for (unsigned int level = 0; level < header.levels; level++)
+    {
+      glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, pagesX(level), pagesY(level), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+      indirectionBytes += pagesX(level) * pagesY(level) * 4;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levels - 1);
+    GpuResources::Instance().Register(GPU_TEXTURE, indirection.Id(), indirectionBytes,
+                                      "indirection " + std::to_string(header.pagesX) + "x" + std::to_string(header.pagesY) + " +mips");
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    slotTiles.assign(VT_CACHE_TILES * VT_CACHE_TILES, -1);
+    upload(tileCount - 1, 0);
+    updateIndirection();
+  }
+
+  // a free slot, or the one whose tile was needed longest ago. The coarsest tile and tiles in view stay
+  int evictionSlot() const
+  {
+    int best = -1;
+    for (int slot = 0; slot < (int)slotTiles.size(); slot++)
+    {
+      int tile = slotTiles[slot];
+      if (tile < 0)
+        return slot;
+      if (tile == (int)tileCount - 1 || tileSeen[tile] == feedbacks)
+        continue;
+      if (best < 0 || tileSeen[tile] < tileSeen[slotTiles[best]])
+        best = slot;
+    }
+    return best;
+  }
+
+  void upload(unsigned int tile, int slot)
+  {
+    if (slotTiles[slot] >= 0)
+      tileSlot[slotTiles[slot]] = -1;
+    slotTiles[slot] = tile;
+    tileSlot[tile] = slot;
+    GLenum format = header.components == 1 ? GL_RED : header.components == 3 ? GL_RGB : GL_RGBA;
+    glBindTexture(GL_TEXTURE_2D, cache.Id());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % VT_CACHE_TILES) * VT_TILE_PADDED, (slot / VT_CACHE_TILES) * VT_TILE_PADDED, VT_TILE_PADDED,
+                    VT_TILE_PADDED, format, GL_UNSIGNED_BYTE, tileData(tile));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+
+  // coarsest level first: a tile points at its own slot if resident, at its parent's entry otherwise
+  void updateIndirection()
+  {
+    glBindTexture(GL_TEXTURE_2D, indirection.Id());
+    for (int level = header.levels - 1; level >= 0; level--)
+    {
+      for (unsigned int y = 0; y < pagesY(level); y++)
+        for (unsigned int x = 0; x < pagesX(level); x++)
+        {
+          unsigned int tile = tileIndex(level, x, y);
+          int slot = tileSlot[tile];
+          if (slot >= 0)
+            entries[tile] = (uint32_t)(slot % VT_CACHE_TILES) | (uint32_t)(slot / VT_CACHE_TILES) << 8 | (uint32_t)level << 16 | 255u << 24;
+          else
+            entries[tile] = entries[tileIndex(level + 1, x >> 1, y >> 1)];
+        }
+      glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, pagesX(level), pagesY(level), GL_RGBA, GL_UNSIGNED_BYTE, &entries[levelStart[level]]);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+};
+
+// Feedback pass for virtual textures: the virtual textured geometry drawn with FeedbackShader into a small RGBA16
+// target, read back asynchronously and handed to the VirtualTextures a frame or more later. One pass serves every
+// virtual texture sampled with the same texture coordinates
+class VirtualTextureFeedback
+{
+public:
+  Shader FeedbackShader;
+
+  VirtualTextureFeedback(const string &shaderDirectory)
+      : FeedbackShader((shaderDirectory + "/planets.vs").c_str(), (shaderDirectory + "/vt_feedback.fs").c_str())
+  {
+    glGenFramebuffers(1, &framebuffer);
+  }
+  VirtualTextureFeedback(const VirtualTextureFeedback &) = delete;
+  VirtualTextureFeedback &operator=(const VirtualTextureFeedback &) = delete;
+  ~VirtualTextureFeedback()
+  {
+    if (fence)
+      glDeleteSync(fence);
+    glDeleteFramebuffers(1, &framebuffer);
+  }
+
+  // hands the last feedback to textures once the GPU is done with it
+  void Resolve(VirtualTexture *const *textures, size_t count)
+  {
+    if (!fence || glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+      return;
+    glDeleteSync(fence);
+    fence = 0;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer.Id());
+    const unsigned short *texels = (const unsigned short *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width * height * 8, GL_MAP_READ_BIT);
+    if (texels)
+    {
+      for (size_t i = 0; i < count; i++)
+        textures[i]->Request(texels, width * height, VT_FEEDBACK_SCALE);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  // binds and clears the feedback target for a framebuffer of that size, and FeedbackShader. Returns false while the
+  // previous feedback is still being read back, there's nothing to draw then
+  bool Begin(int framebufferWidth, int framebufferHeight)
+  {
+    if (fence)
+      return false;
+    resize(std::max(1, framebufferWidth / VT_FEEDBACK_SCALE), std::max(1, framebufferHeight / VT_FEEDBACK_SCALE));
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+    // zero marks pixels without virtual texturing; the clear color is left alone
+    const float cleared[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, cleared);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    FeedbackShader.use();
+    return true;
+  }
+
+  // starts the readback and binds the default framebuffer again
+  void End(int framebufferWidth, int framebufferHeight)
+  {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer.Id());
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_SHORT, (void *)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
+  }
+
+private:
+  unsigned int framebuffer;
+  TextureHandle target;
+  RenderbufferHandle depth;
+  BufferHandle readbackBuffer;
+  int width = 0, height = 0;
+  GLsync fence = 0;
+
+  void resize(int newWidth, int newHeight)
+  {
+    if (newWidth == width && newHeight == height)
+      return;
+    width = newWidth;
+    height = newHeight;
+    GpuResourceOwner owner("virtual texture feedback");
+    target = TextureHandle::Generate();
+    glBindTexture(GL_TEXTURE_2D, target.Id());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, width, height, 0, GL_RGBA, GL_UNSIGNED_SHORT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GpuResources::Instance().Register(GPU_TEXTURE, target.Id(), (unsigned long)width * height * 8,
+                                      "RGBA16 " + std::to_string(width) + "x" + std::to_string(height));
+    depth = RenderbufferHandle::Generate();
+    glBindRenderbuffer(GL_RENDERBUFFER, depth.Id());
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    GpuResources::Instance().Register(GPU_RENDERBUFFER, depth.Id(), (unsigned long)width * height * 4,
+                                      "D24 " + std::to_string(width) + "x" + std::to_string(height));
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.Id(), 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth.Id());
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      cout << "ERROR::VIRTUAL_TEXTURE:: feedback target is not complete" << endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    readbackBuffer = BufferHandle::Generate();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer.Id());
+    glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 8, NULL, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GpuResources::Instance().Register(GPU_BUFFER, readbackBuffer.Id(), (unsigned long)width * height * 8, "feedback readback");
+  }
+};
+#endif
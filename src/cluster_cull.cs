@@ -0,0 +1,94 @@
+#version 430 core
+// one work group per cluster, its invocations test the lights in parallel
+layout(local_size_x = 128) in;
+
+struct PointLight {
+  vec4 positionRadius;
+  vec4 color;
+};
+layout(std430, binding = 0) readonly buffer Lights { PointLight pointLights[]; };
+// per cluster: offset and count into lightIndices
+layout(std430, binding = 1) writeonly buffer ClusterGrid { uvec2 clusters[]; };
+layout(std430, binding = 2) buffer ClusterIndices {
+  uint indexCount; // reset to zero before every dispatch, counts the indices wanted even past maxIndices
+  uint droppedLights; // reset to zero before every dispatch, light entries left out of full cluster lists
+  uint lightIndices[];
+};
+
+uniform mat4 view;
+uniform mat4 invProjection;
+uniform uvec3 gridSize;
+uniform float zNear;
+uniform float zFar;
+uniform int numLights;
+uniform uint maxIndices;
+
+const uint MAX_CLUSTER_LIGHTS = 512u;
+shared uint clusterCount;
+shared uint clusterOffset;
+shared uint clusterLights[MAX_CLUSTER_LIGHTS];
+shared vec3 aabbMin;
+shared vec3 aabbMax;
+
+// view space point on the near plane for a NDC xy
+vec3 nearPoint(vec2 ndc) {
+  vec4 p = invProjection * vec4(ndc, -1.0, 1.0);
+  return p.xyz / p.w;
+}
+
+void main() {
+  uint cluster = gl_WorkGroupID.x + gl_WorkGroupID.y * gridSize.x + gl_WorkGroupID.z * gridSize.x * gridSize.y;
+
+  if (gl_LocalInvocationIndex == 0u) {
+    clusterCount = 0u;
+    // view space bounds: the rays through the tile corners cut at the depth slice's near and far distance
+    // (slices are exponential, so that clusters stay roughly cubic)
+    float sliceNear = zNear * pow(zFar / zNear, float(gl_WorkGroupID.z) / float(gridSize.z));
+    float sliceFar = zNear * pow(zFar / zNear, float(gl_WorkGroupID.z + 1u) / float(gridSize.z));
+    vec2 tileMin = vec2(gl_WorkGroupID.xy) / vec2(gridSize.xy) * 2.0 - 1.0;
+    vec2 tileMax = vec2(gl_WorkGroupID.xy + 1u) / vec2(gridSize.xy) * 2.0 - 1.0;
+    vec3 corners[4] = vec3[](nearPoint(tileMin), nearPoint(vec2(tileMax.x, tileMin.y)),
+                             nearPoint(vec2(tileMin.x, tileMax.y)), nearPoint(tileMax));
+    vec3 lo = vec3(1e30);
+    vec3 hi = vec3(-1e30);
+    for (int i = 0; i < 4; i++) {
+      vec3 a = corners[i] * (sliceNear / -corners[i].z);
+      vec3 b = corners[i] * (sliceFar / -corners[i].z);
+      lo = min(lo, min(a, b));
+      hi = max(hi, max(a, b));
+    }
+    aabbMin = lo;
+    aabbMax = hi;
+  }
+  barrier();
+
+  // sphere vs box
+  for (uint i = gl_LocalInvocationIndex; i < uint(numLights); i += gl_WorkGroupSize.x) {
+    vec4 light = pointLights[i].positionRadius;
+    vec3 center = vec3(view * vec4(light.xyz, 1.0));
+    vec3 d = clamp(center, aabbMin, aabbMax) - center;
+    if (dot(d, d) <= light.w * light.w) {
+      uint slot = atomicAdd(clusterCount, 1u);
+      if (slot < MAX_CLUSTER_LIGHTS)
+        clusterLights[slot] = i;
+    }
+  }
+  barrier();
+
+  // reserve a compact range of the global index list
+  if (gl_LocalInvocationIndex == 0u) {
+    uint count = min(clusterCount, MAX_CLUSTER_LIGHTS);
+    uint offset = atomicAdd(indexCount, count);
+    if (offset + count > maxIndices)
+      count = offset < maxIndices ? maxIndices - offset : 0u;
+    if (count < clusterCount)
+      atomicAdd(droppedLights, clusterCount - count);
+    clusters[cluster] = uvec2(offset, count);
+    clusterOffset = offset;
+    clusterCount = count;
+  }
+  barrier();
+
+  for (uint i = gl_LocalInvocationIndex; i < clusterCount; i += gl_WorkGroupSize.x)
+    lightIndices[clusterOffset + i] = clusterLights[i];
+}
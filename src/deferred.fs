@@ -0,0 +1,72 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 ScreenUV;
+
+// G-buffer
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gSpecular; // strength, exponent / 128
+uniform sampler2D gDepth;
+uniform mat4 invViewProjection;
+
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+uniform vec3 viewPos;
+
+// point lights, two texels each: position/radius, color
+uniform samplerBuffer pointLights;
+// per screen tile: offset and count into lightIndices
+uniform usamplerBuffer tileLights;
+uniform usamplerBuffer lightIndices;
+uniform int tileSize;
+uniform int tilesX;
+
+vec3 octDecode(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0)
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return normalize(n);
+}
+
+void main() {
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  float depth = texelFetch(gDepth, pixel, 0).r;
+  // nothing was drawn here, keep the clear color
+  if (depth == 1.0)
+    discard;
+
+  vec4 albedo = texelFetch(gAlbedo, pixel, 0);
+  vec3 norm = octDecode(texelFetch(gNormal, pixel, 0).xy);
+  vec2 material = texelFetch(gSpecular, pixel, 0).xy * vec2(1.0, 128.0);
+  vec4 world = invViewProjection * vec4(ScreenUV * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+  vec3 FragPos = world.xyz / world.w;
+
+  // same phong model as planets.fs
+  float ambientStrength = 0.02;
+  vec3 ambient = ambientStrength * lightColor;
+
+  vec3 lightDir = normalize(lightPos - FragPos);
+  vec3 diffuse = max(dot(norm, lightDir), 0.0) * lightColor;
+
+  float specularStrength = material.x;
+  vec3 viewDir = normalize(viewPos - FragPos);
+  vec3 specular = specularStrength * pow(max(dot(viewDir, reflect(-lightDir, norm)), 0.0), material.y) * lightColor;
+
+  // only the point lights whose screen rect overlaps this tile
+  ivec2 tile = pixel / tileSize;
+  uvec2 range = texelFetch(tileLights, tile.y * tilesX + tile.x).xy;
+  for (uint i = 0u; i < range.y; i++) {
+    int light = int(texelFetch(lightIndices, int(range.x + i)).r);
+    vec4 posRadius = texelFetch(pointLights, light * 2);
+    vec3 color = texelFetch(pointLights, light * 2 + 1).rgb;
+    vec3 toLight = posRadius.xyz - FragPos;
+    float attenuation = clamp(1.0 - dot(toLight, toLight) / (posRadius.w * posRadius.w), 0.0, 1.0);
+    attenuation *= attenuation;
+    vec3 dir = normalize(toLight);
+    diffuse += max(dot(norm, dir), 0.0) * attenuation * color;
+    specular += specularStrength * pow(max(dot(viewDir, reflect(-dir, norm)), 0.0), material.y) * attenuation * color;
+  }
+
+  FragColor = vec4(diffuse + ambient + specular, 1.0) * albedo;
+}
@@ -0,0 +1,4 @@
+#version 330 core
+
+// depth only pass, there is no color attachment
+void main() {}
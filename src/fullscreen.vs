@@ -0,0 +1,9 @@
+#version 330 core
+out vec2 ScreenUV;
+
+// a single triangle covering the whole screen, generated from gl_VertexID (draw 3 vertices with an empty VAO)
+void main() {
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  ScreenUV = p;
+  gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,26 @@
+#version 330 core
+layout(location = 0) out vec4 gAlbedo;
+layout(location = 1) out vec2 gNormal;
+layout(location = 2) out vec2 gSpecular;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+
+#include "surface.glsl"
+
+// octahedral normal encoding: two channels instead of three, with an almost uniform error over the sphere
+vec2 octEncode(vec3 n) {
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  if (n.z < 0.0)
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return n.xy;
+}
+
+void main() {
+  vec2 material;
+  gAlbedo = shadeMaterial(TexCoords, sampleAlbedo(TexCoords), material);
+  gNormal = octEncode(normalize(Normal));
+  // the exponent in [0, 128], to fit the RG8 target
+  gSpecular = vec2(material.x, material.y / 128.0);
+}
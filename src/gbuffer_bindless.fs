@@ -0,0 +1,29 @@
+#version 430 core
+#extension GL_ARB_bindless_texture : require
+layout(location = 0) out vec4 gAlbedo;
+layout(location = 1) out vec2 gNormal;
+layout(location = 2) out vec2 gSpecular;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+// index of the instance's texture handle
+flat in int Layer;
+
+// handles of the resident textures, see bindless.hpp
+layout(std430, binding = 3) readonly buffer TextureHandles { uvec2 textureHandles[]; };
+
+// octahedral normal encoding: two channels instead of three, with an almost uniform error over the sphere
+vec2 octEncode(vec3 n) {
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  if (n.z < 0.0)
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return n.xy;
+}
+
+void main() {
+  gAlbedo = texture(sampler2D(textureHandles[Layer]), TexCoords);
+  gNormal = octEncode(normalize(Normal));
+  // the asteroids have no material, the default one's specular strength and exponent in [0, 128]
+  gSpecular = vec2(0.3, 2.0 / 128.0);
+}
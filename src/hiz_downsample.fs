@@ -0,0 +1,14 @@
+#version 330 core
+
+// one level of the Hi-Z pyramid: the farthest depth of each 2x2 block of the level above. The base level of
+// depthPyramid is set to that level while this level is being rendered, so lod 0 reads it
+uniform sampler2D depthPyramid;
+
+void main() {
+  ivec2 p = ivec2(gl_FragCoord.xy) * 2;
+  float d0 = texelFetch(depthPyramid, p, 0).r;
+  float d1 = texelFetch(depthPyramid, p + ivec2(1, 0), 0).r;
+  float d2 = texelFetch(depthPyramid, p + ivec2(0, 1), 0).r;
+  float d3 = texelFetch(depthPyramid, p + ivec2(1, 1), 0).r;
+  gl_FragDepth = max(max(d0, d1), max(d2, d3));
+}
@@ -0,0 +1,6 @@
+#version 330 core
+out vec4 Visibility;
+
+flat in float visible;
+
+void main() { Visibility = vec4(visible); }
@@ -0,0 +1,48 @@
+#version 330 core
+// one point per object, written to texel gl_VertexID of a one row visibility target
+layout(location = 0) in vec4 sphere; // world space center and radius
+
+flat out float visible;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform sampler2D depthPyramid;
+uniform int levels;
+uniform int objectCount;
+
+void main() {
+  gl_Position = vec4((float(gl_VertexID) + 0.5) / float(objectCount) * 2.0 - 1.0, 0.0, 0.0, 1.0);
+  visible = 1.0;
+
+  vec3 c = vec3(view * vec4(sphere.xyz, 1.0));
+  float r = sphere.w;
+  float zNear = projection[3][2] / (projection[2][2] - 1.0);
+  // touching the near plane, can't be behind anything
+  if (c.z + r > -zNear)
+    return;
+
+  // conservative screen rect: projected corners of the view space bounding box
+  vec2 lo = vec2(1.0);
+  vec2 hi = vec2(-1.0);
+  for (int i = 0; i < 8; i++) {
+    vec3 p = c + vec3((i & 1) != 0 ? r : -r, (i & 2) != 0 ? r : -r, (i & 4) != 0 ? r : -r);
+    vec4 clip = projection * vec4(p, 1.0);
+    lo = min(lo, clip.xy / clip.w);
+    hi = max(hi, clip.xy / clip.w);
+  }
+  lo = clamp(lo * 0.5 + 0.5, 0.0, 1.0);
+  hi = clamp(hi * 0.5 + 0.5, 0.0, 1.0);
+
+  // the level where the rect spans at most 2x2 texels, whose farthest depth bounds all occluders in front of it
+  vec2 size = (hi - lo) * vec2(textureSize(depthPyramid, 0));
+  int level = int(clamp(ceil(log2(max(max(size.x, size.y), 1.0))), 0.0, float(levels - 1)));
+  ivec2 levelSize = textureSize(depthPyramid, level);
+  ivec2 a = min(ivec2(lo * vec2(levelSize)), levelSize - 1);
+  ivec2 b = min(ivec2(hi * vec2(levelSize)), levelSize - 1);
+  float maxDepth = max(max(texelFetch(depthPyramid, a, level).r, texelFetch(depthPyramid, ivec2(b.x, a.y), level).r),
+                       max(texelFetch(depthPyramid, ivec2(a.x, b.y), level).r, texelFetch(depthPyramid, b, level).r));
+
+  // depth of the sphere point closest to the camera
+  vec4 nearest = projection * vec4(0.0, 0.0, c.z + r, 1.0);
+  visible = nearest.z / nearest.w * 0.5 + 0.5 <= maxDepth ? 1.0 : 0.0;
+}
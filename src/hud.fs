@@ -0,0 +1,10 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec4 Color;
+
+// font atlas, coverage in the red channel
+uniform sampler2D font;
+
+void main() { FragColor = vec4(Color.rgb, Color.a * texture(font, TexCoords).r); }
@@ -0,0 +1,65 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 BillboardPos;
+flat in vec4 Sphere;
+flat in vec3 Albedo;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+uniform vec3 viewPos;
+
+// additional point lights, two texels each: position/radius, color
+uniform samplerBuffer pointLights;
+uniform int numPointLights;
+
+void main() {
+  // the camera ray through the pixel against the sphere
+  vec3 rayDir = normalize(BillboardPos - viewPos);
+  vec3 oc = viewPos - Sphere.xyz;
+  float b = dot(oc, rayDir);
+  float h = b * b - dot(oc, oc) + Sphere.w * Sphere.w;
+  if (h < 0.0)
+    discard;
+  vec3 FragPos = viewPos + (-b - sqrt(h)) * rayDir;
+  vec3 norm = (FragPos - Sphere.xyz) / Sphere.w;
+  // the hit point's depth rather than the billboard's
+  vec4 clip = projection * view * vec4(FragPos, 1.0);
+  gl_FragDepth = (clip.z / clip.w) * 0.5 + 0.5;
+
+  // the planets' phong terms with the default material
+  vec2 material = vec2(0.3, 2.0);
+
+  // ambient
+  float ambientStrength = 0.02;
+  vec3 ambient = ambientStrength * lightColor;
+
+  // diffuse
+  vec3 lightDir = normalize(lightPos - FragPos);
+  float diff = max(dot(norm, lightDir), 0.0);
+  vec3 diffuse = diff * lightColor;
+
+  // specular
+  float specularStrength = material.x;
+  vec3 viewDir = -rayDir;
+  vec3 reflectDir = reflect(-lightDir, norm);
+  float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.y);
+  vec3 specular = specularStrength * spec * lightColor;
+
+  // point lights, same phong terms with a smooth falloff to zero at the light radius
+  for (int i = 0; i < numPointLights; i++) {
+    vec4 posRadius = texelFetch(pointLights, i * 2);
+    vec3 color = texelFetch(pointLights, i * 2 + 1).rgb;
+    vec3 toLight = posRadius.xyz - FragPos;
+    float attenuation = clamp(1.0 - dot(toLight, toLight) / (posRadius.w * posRadius.w), 0.0, 1.0);
+    attenuation *= attenuation;
+    vec3 dir = normalize(toLight);
+    diffuse += max(dot(norm, dir), 0.0) * attenuation * color;
+    specular += specularStrength * pow(max(dot(viewDir, reflect(-dir, norm)), 0.0), material.y) * attenuation * color;
+  }
+
+  // result (phong)
+  FragColor = vec4((diffuse + ambient + specular) * Albedo, 1.0);
+}
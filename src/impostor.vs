@@ -0,0 +1,30 @@
+#version 330 core
+out vec3 BillboardPos;
+flat out vec4 Sphere;
+flat out vec3 Albedo;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPos;
+// impostors in the transform buffer, two texels each from texel impostorBase: center and radius, albedo
+uniform int impostorBase;
+uniform samplerBuffer transforms;
+
+void main() {
+  Sphere = texelFetch(transforms, impostorBase + 2 * gl_InstanceID);
+  Albedo = texelFetch(transforms, impostorBase + 2 * gl_InstanceID + 1).rgb;
+  // corners of a triangle strip quad
+  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+
+  // the billboard is perpendicular to the line to the camera, on the sphere's near side, and just as large as the cone
+  // of rays tangent to the sphere is there, so that it covers the silhouette exactly however far off-axis
+  vec3 toCamera = viewPos - Sphere.xyz;
+  float d = max(length(toCamera), Sphere.w * 1.001);
+  vec3 forward = toCamera / d;
+  vec3 cameraUp = vec3(view[0][1], view[1][1], view[2][1]);
+  vec3 right = normalize(cross(cameraUp, forward));
+  vec3 up = cross(forward, right);
+  float size = (d - Sphere.w) * Sphere.w / sqrt(d * d - Sphere.w * Sphere.w);
+  BillboardPos = Sphere.xyz + forward * Sphere.w + (corner.x * right + corner.y * up) * size;
+  gl_Position = projection * view * vec4(BillboardPos, 1.0);
+}
@@ -1,13 +1,42 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
+#include "alloc_counter.hpp"
+#include "arena.hpp"
+#include "asset_manager.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <string>
 #include <unistd.h>
 #include <stdlib.h>
 #include <limits.h>
 #include "shader.hpp"
 #include "camera.hpp"
 #include "model.hpp"
+#include "lights.hpp"
+#include "deferred.hpp"
+#include "frame_pacer.hpp"
+#include "gpu_resources.hpp"
+#include "hud.hpp"
+#include "impostor.hpp"
+#include "clustered.hpp"
+#include "benchmark.hpp"
+#include "bindless.hpp"
+#include "job_system.hpp"
+#include "material.hpp"
+#include "occlusion.hpp"
+#include "profiler.hpp"
+#include "render_target.hpp"
+#include "starfield.hpp"
+#include "stats.hpp"
+#include "stream_buffer.hpp"
+#include "terrain.hpp"
+#include "texture_array.hpp"
+#include "virtual_texture.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.hpp"
@@ -17,6 +46,7 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow *window);
+int run_scene(GLFWwindow *window);
 
 // settings
 const unsigned int SCR_WIDTH = 1280;
@@ -35,14 +65,345 @@ float lastFrameTime = 0.0f;
 // control movement with space key
 bool begin_movement = false;
 
-int main()
+// Shading paths for the planets, cycled with the G key
+enum Render_Path
 {
+  FORWARD_SHADING,
+  DEFERRED_SHADING,
+  CLUSTERED_SHADING
+};
+const char *render_path_names[] = {"forward", "deferred", "clustered"};
+const char *occlusion_mode_names[] = {"off", "gpu", "cpu"};
+
+// Textures of the asteroids: the rock texture shared by all of them, or a texture of their own each, bound before
+// drawing each asteroid, packed into texture arrays and drawn in one instanced draw per array, or made resident with
+// bindless textures and drawn in one instanced draw
+enum Asteroid_Textures
+{
+  ASTEROID_TEXTURES_SHARED,
+  ASTEROID_TEXTURES_BIND,
+  ASTEROID_TEXTURES_ARRAY,
+  ASTEROID_TEXTURES_BINDLESS
+};
+const char *asteroid_textures_names[] = {"shared", "bind", "array", "bindless"};
+
+// rendering options (command line, toggled with keys)
+Render_Path render_path = FORWARD_SHADING;
+bool clustered_supported = false;
+int num_lights = 0;
+int num_asteroids = 0;
+std::string bench; // name of the benchmark to run, empty for none
+std::string occlusion; // occlusion culling mode, empty to pick one for the driver
+OcclusionCuller *occlusion_culler = NULL;
+bool show_hud = false;
+std::string trace_path; // Chrome trace written at exit, needs a PROFILE=1 build
+StatsPrinter stats;
+bool print_memory = false;
+bool check_allocs = false; // fail if the render loop allocates once warmed up
+bool check_textures = false; // fail if the asteroid texture paths render differently
+bool sync_loading = false; // load the models before the first frame instead of streaming them in
+bool use_terrain = true; // draw the Earth with the quadtree terrain rather than a fixed sphere
+bool use_virtual_texture = true; // page the Earth's albedo in as the view needs it rather than loading it whole
+bool use_materials = true; // bind the textures once per material batch rather than once per mesh
+bool use_starfield = true; // draw the stars behind the scene rather than the clear color
+float impostor_pixels = IMPOSTOR_PIXELS; // asteroids projected smaller than this radius are drawn as impostors, 0 for none
+float target_frame_ms = 0.0f; // frame time to pace the frames to, 0 to swap as soon as a frame is done
+bool use_dynamic_resolution = true; // scale the resolution of paced frames to fit the GPU time in the frame time
+Asteroid_Textures asteroid_textures = ASTEROID_TEXTURES_SHARED;
+// for the time to the first frame
+const auto program_start = std::chrono::steady_clock::now();
+
+// --check-allocs: frames rendered before counting, then frames counted
+const int CHECK_ALLOCS_WARMUP = 60;
+const int CHECK_ALLOCS_FRAMES = 300;
+// --check-textures: frames rendered with each path before reading the image back, asteroids drawn, a pixel differing
+// from the reference when a channel is further off than the tolerance, and the share of differing pixels failing
+const int CHECK_TEXTURES_FRAMES = 3;
+const int CHECK_TEXTURES_ASTEROIDS = 500;
+const int CHECK_TEXTURES_TOLERANCE = 8;
+const double CHECK_TEXTURES_FAIL_SHARE = 0.001;
+// procedural bodies: cube-sphere subdivisions shared by the Sun and the Earth, and their radii (those of the OBJ models
+// they replace)
+const unsigned int PLANET_SUBDIVISIONS = 32;
+const float SUN_RADIUS = 2.6f;
+const float EARTH_RADIUS = 10.0f;
+// land raised above the oceans of the Earth's terrain, relative to its radius
+const float TERRAIN_HEIGHT = 0.004f;
+
+// --bench-streaming: transforms written to the transform buffer per frame
+const int BENCH_STREAM_TRANSFORMS = 100000;
+// --bench-terrain: frames of the flight from orbit down to the surface, and its start and end altitudes
+const int BENCH_FLIGHT_FRAMES = 400;
+const float BENCH_FLIGHT_FROM = 40.0f, BENCH_FLIGHT_TO = 0.3f;
+// --bench-materials: asteroids drawn with the planets
+const int BENCH_MATERIAL_ASTEROIDS = 1000;
+// side of the asteroids' own textures (--asteroid-textures), and how many of them --bench-texture-arrays draws
+const int BODY_TEXTURE_SIZE = 128;
+const int BENCH_DISTINCT_BODIES = 1000;
+// --bench-pacing: the loaded scene, and the frame time it's paced to without --frame-time
+const int BENCH_PACING_ASTEROIDS = 20000;
+const int BENCH_PACING_LIGHTS = 256;
+const float BENCH_PACING_FRAME_TIME = 1000.0f / 60.0f;
+
+void print_usage()
+{
+  std::cout << "usage: planets [--deferred | --clustered] [--lights N] [--asteroids N] [--occlusion gpu|cpu|off] [--hud]\n"
+            << "               [--stats] [--memory] [--check-allocs] [--check-textures] [--sync-loading] [--no-terrain]\n"
+            << "               [--no-virtual-texture] [--no-materials] [--no-starfield] [--impostor-pixels N]\n"
+            << "               [--frame-time MS] [--no-dynamic-resolution]\n"
+            << "               [--asteroid-textures shared|bind|array|bindless] [--trace FILE]\n"
+            << "               [--bench-lights | --bench-clustered | --bench-occlusion | --bench-loading | --bench-streaming |\n"
+            << "                --bench-terrain | --bench-virtual-texture | --bench-materials | --bench-texture-arrays |\n"
+            << "                --bench-starfield | --bench-impostors | --bench-pacing]\n"
+            << "  --deferred         start with the deferred renderer (cycle renderers with G)\n"
+            << "  --clustered        start with clustered forward shading (GL 4.3)\n"
+            << "  --lights N         add N point lights orbiting the Sun\n"
+            << "  --asteroids N      add a belt of N asteroids around the Sun\n"
+            << "  --occlusion MODE   occlusion culling against the planets: Hi-Z on the GPU, software depth buffer on the\n"
+            << "                     CPU or off (default gpu, cpu on software GL; cycle with O)\n"
+            << "  --hud              start with the performance overlay shown (toggle with H)\n"
+            << "  --stats            print frame time, draw calls and culling counters every second\n"
+            << "  --memory           print the GPU memory used by each model once loaded\n"
+            << "  --sync-loading     load the models before the first frame instead of streaming them in\n"
+            << "  --no-terrain       draw the Earth as a fixed sphere instead of a level of detail terrain\n"
+            << "  --no-virtual-texture  load the Earth's albedo whole instead of paging in the tiles in view\n"
+            << "  --no-materials     bind the textures of every mesh when drawing it instead of once per material batch\n"
+            << "  --no-starfield     leave the background the clear color instead of drawing the stars\n"
+            << "  --impostor-pixels N  draw the asteroids projected smaller than N pixels of radius as ray traced spheres on\n"
+            << "                     billboards instead of meshes, 0 for none (default " << IMPOSTOR_PIXELS << ")\n"
+            << "  --frame-time MS    pace the frames to MS milliseconds each, in place of vsync, rendering the scene at a\n"
+            << "                     lower resolution when the GPU can't keep up\n"
+            << "  --no-dynamic-resolution  pace the frames at the window's resolution\n"
+            << "  --asteroid-textures MODE  one rock texture for all asteroids, or one each bound per asteroid drawn,\n"
+            << "                     packed into texture arrays or made resident as bindless textures (ARB_bindless_texture,\n"
+            << "                     texture arrays without it) (default shared)\n"
+            << "  --check-allocs     render " << CHECK_ALLOCS_FRAMES << " frames after " << CHECK_ALLOCS_WARMUP
+            << " warm-up frames and exit with an error if any of them allocated\n"
+            << "  --check-textures   render " << CHECK_TEXTURES_ASTEROIDS << " asteroids with a texture each through every texture path the driver\n"
+            << "                     has and exit with an error if any image differs from the one with bound textures\n"
+            << "  --trace FILE       write a Chrome trace of the CPU and GPU zones at exit (make PROFILE=1 builds)\n"
+            << "  --bench-lights     time forward vs deferred shading with 1, 16 and 256 lights and exit\n"
+            << "  --bench-clustered  time clustered shading with 1 to 4096 lights and exit\n"
+            << "  --bench-occlusion  time occlusion culling of 1000 and 4000 asteroids and exit\n"
+            << "  --bench-loading    count the heap allocations and time of loading each model, and of generating a sphere\n"
+            << "                     with as many triangles as each planet, and exit\n"
+            << "  --bench-streaming  time writing " << BENCH_STREAM_TRANSFORMS << " transforms per frame to the transform buffer, mapped\n"
+            << "                     persistently, mapped unsynchronized and orphaned, and exit\n"
+            << "  --bench-terrain    time a flight from orbit down to the Earth's surface, queuing and uploading terrain patches\n"
+            << "                     with and without a per-frame budget, and exit\n"
+            << "  --bench-virtual-texture  time the same flight with the Earth's albedo loaded whole and virtual textured,\n"
+            << "                     print the resident memory and tile miss latency, and exit\n"
+            << "  --bench-materials  time drawing " << BENCH_MATERIAL_ASTEROIDS << " asteroids and the planets binding textures per mesh and per\n"
+            << "                     material batch, print the texture binds per frame, and exit\n"
+            << "  --bench-texture-arrays  time drawing " << BENCH_DISTINCT_BODIES << " asteroids with a texture each, bound per asteroid,\n"
+            << "                     packed into texture arrays and bindless where supported, print the texture binds and draw\n"
+            << "                     calls per frame, and exit\n"
+            << "  --bench-starfield  time frames rendered offscreen at 1920x1080 and 3840x2160 with the clear color and with\n"
+            << "                     the starfield, print the GPU time of the starfield pass, and exit\n"
+            << "  --bench-impostors  time 10000 to 1000000 asteroids drawn as meshes and as impostors, without occlusion\n"
+            << "                     culling, and exit\n"
+            << "  --bench-pacing     time " << BENCH_PACING_ASTEROIDS << " asteroids and " << BENCH_PACING_LIGHTS
+            << " lights unpaced and paced with dynamic resolution, print the\n"
+            << "                     frame time deviation, and exit" << std::endl;
+}
+
+// asteroid transforms relative to the Sun, in a flat belt between the Sun and the Earth
+void generate_asteroids(std::vector<glm::mat4> &asteroids, int count)
+{
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  asteroids.resize(count);
+  for (int i = 0; i < count; i++)
+  {
+    float angle = 6.2831853f * unit(rng);
+    float distance = 8.0f + 14.0f * unit(rng);
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(distance * glm::cos(angle), -2.0f + 4.0f * unit(rng), distance * glm::sin(angle)));
+    model = glm::rotate(model, 6.2831853f * unit(rng), glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.01f)));
+    asteroids[i] = glm::scale(model, glm::vec3(0.3f + 0.7f * unit(rng)));
+  }
+}
+
+// a texture of its own for each of count bodies: the rock texture at BODY_TEXTURE_SIZE (box filtered), tinted with a
+// random hue. RGB
+void generate_body_textures(std::vector<std::vector<unsigned char>> &textures, const std::string &rockPath, int count)
+{
+  int width = 0, height = 0, components;
+  unsigned char *rock = stbi_load(rockPath.c_str(), &width, &height, &components, 3);
+  int stepX = std::max(1, width / BODY_TEXTURE_SIZE), stepY = std::max(1, height / BODY_TEXTURE_SIZE);
+  std::vector<glm::vec3> base(BODY_TEXTURE_SIZE * BODY_TEXTURE_SIZE, glm::vec3(0.5f));
+  if (rock)
+    for (int y = 0; y < BODY_TEXTURE_SIZE; y++)
+      for (int x = 0; x < BODY_TEXTURE_SIZE; x++)
+      {
+        glm::vec3 sum(0.0f);
+        int x0 = x * width / BODY_TEXTURE_SIZE, y0 = y * height / BODY_TEXTURE_SIZE;
+        for (int sy = 0; sy < stepY; sy++)
+          for (int sx = 0; sx < stepX; sx++)
+          {
+            const unsigned char *texel = rock + ((size_t)std::min(y0 + sy, height - 1) * width + std::min(x0 + sx, width - 1)) * 3;
+            sum += glm::vec3(texel[0], texel[1], texel[2]) / 255.0f;
+          }
+        base[y * BODY_TEXTURE_SIZE + x] = sum / float(stepX * stepY);
+      }
+  stbi_image_free(rock);
+
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  textures.resize(count);
+  for (int i = 0; i < count; i++)
+  {
+    float hue = unit(rng) * 6.0f;
+    glm::vec3 tint = glm::mix(glm::vec3(1.0f), glm::clamp(glm::vec3(fabsf(hue - 3.0f) - 1.0f, 2.0f - fabsf(hue - 2.0f), 2.0f - fabsf(hue - 4.0f)), 0.0f, 1.0f), 0.6f);
+    textures[i].resize(base.size() * 3);
+    for (size_t t = 0; t < base.size(); t++)
+    {
+      glm::vec3 color = glm::min(base[t] * tint * 1.4f, glm::vec3(1.0f));
+      textures[i][t * 3] = (unsigned char)(color.x * 255.0f + 0.5f);
+      textures[i][t * 3 + 1] = (unsigned char)(color.y * 255.0f + 0.5f);
+      textures[i][t * 3 + 2] = (unsigned char)(color.z * 255.0f + 0.5f);
+    }
+  }
+}
+
+// loads a model relative to the working directory, printing the heap allocations it took for --bench-loading
+Model load_model(const char *cwd, const char *file)
+{
+  unsigned long count = heapAllocations.count, bytes = heapAllocations.bytes;
+  auto start = std::chrono::steady_clock::now();
+  Model model(std::string(cwd) + file);
+  if (bench == "loading")
+    printf("BENCH::LOADING:: %-32s %8lu allocations %10.2f MB %9.1f ms\n", file, heapAllocations.count - count,
+           (heapAllocations.bytes - bytes) / 1048576.0, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+  return model;
+}
+
+// generates a sphere with about as many triangles as model for --bench-loading, printing its allocations and time
+void bench_sphere(const Model &model)
+{
+  unsigned long triangles = 0;
+  for (const Mesh &mesh : model.meshes)
+    triangles += mesh.indices.size() / 3;
+  unsigned int subdivisions = SphereSubdivisions(triangles);
+  unsigned long count = heapAllocations.count, bytes = heapAllocations.bytes;
+  auto start = std::chrono::steady_clock::now();
+  SphereGeometry sphere;
+  GenerateSphere(subdivisions, sphere);
+  float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::string name = "sphere " + std::to_string(subdivisions) + " (" + std::to_string(sphere.indices.size() / 3) + " triangles)";
+  printf("BENCH::LOADING:: %-32s %8lu allocations %10.2f MB %9.1f ms, vs %lu triangles of %s\n", name.c_str(), heapAllocations.count - count,
+         (heapAllocations.bytes - bytes) / 1048576.0, ms, triangles, model.path.substr(model.path.find_last_of('/') + 1).c_str());
+}
+
+int main(int argc, char **argv)
+{
+  // command line
+  // ------------
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--deferred")
+      render_path = DEFERRED_SHADING;
+    else if (arg == "--clustered")
+      render_path = CLUSTERED_SHADING;
+    else if (arg == "--lights" && i + 1 < argc)
+      num_lights = atoi(argv[++i]);
+    else if (arg == "--asteroids" && i + 1 < argc)
+      num_asteroids = atoi(argv[++i]);
+    else if (arg == "--occlusion" && i + 1 < argc && (std::string(argv[i + 1]) == "gpu" || std::string(argv[i + 1]) == "cpu" || std::string(argv[i + 1]) == "off"))
+      occlusion = argv[++i];
+    else if (arg == "--hud")
+      show_hud = true;
+    else if (arg == "--stats")
+      stats.enabled = true;
+    else if (arg == "--memory")
+      print_memory = true;
+    else if (arg == "--check-allocs")
+      check_allocs = true;
+    else if (arg == "--sync-loading")
+      sync_loading = true;
+    else if (arg == "--no-terrain")
+      use_terrain = false;
+    else if (arg == "--no-virtual-texture")
+      use_virtual_texture = false;
+    else if (arg == "--no-materials")
+      use_materials = false;
+    else if (arg == "--no-starfield")
+      use_starfield = false;
+    else if (arg == "--impostor-pixels" && i + 1 < argc)
+      impostor_pixels = (float)atof(argv[++i]);
+    else if (arg == "--frame-time" && i + 1 < argc)
+      target_frame_ms = (float)atof(argv[++i]);
+    else if (arg == "--no-dynamic-resolution")
+      use_dynamic_resolution = false;
+    else if (arg == "--check-textures")
+      check_textures = true;
+    else if (arg == "--asteroid-textures" && i + 1 < argc &&
+             (std::string(argv[i + 1]) == "shared" || std::string(argv[i + 1]) == "bind" || std::string(argv[i + 1]) == "array" ||
+              std::string(argv[i + 1]) == "bindless"))
+    {
+      std::string mode = argv[++i];
+      asteroid_textures = mode == "bind"       ? ASTEROID_TEXTURES_BIND
+                          : mode == "array"    ? ASTEROID_TEXTURES_ARRAY
+                          : mode == "bindless" ? ASTEROID_TEXTURES_BINDLESS
+                                               : ASTEROID_TEXTURES_SHARED;
+    }
+    else if (arg == "--trace" && i + 1 < argc)
+      trace_path = argv[++i];
+    else if (arg == "--bench-lights")
+      bench = "lights";
+    else if (arg == "--bench-clustered")
+      bench = "clustered";
+    else if (arg == "--bench-occlusion")
+      bench = "occlusion";
+    else if (arg == "--bench-loading")
+      bench = "loading";
+    else if (arg == "--bench-streaming")
+      bench = "streaming";
+    else if (arg == "--bench-terrain")
+      bench = "terrain";
+    else if (arg == "--bench-virtual-texture")
+      bench = "virtual-texture";
+    else if (arg == "--bench-materials")
+      bench = "materials";
+    else if (arg == "--bench-texture-arrays")
+      bench = "texture-arrays";
+    else if (arg == "--bench-starfield")
+      bench = "starfield";
+    else if (arg == "--bench-impostors")
+      bench = "impostors";
+    else if (arg == "--bench-pacing")
+      bench = "pacing";
+    else
+    {
+      print_usage();
+      return 1;
+    }
+  }
+
+  // --check-textures compares images of the same frame, so nothing may change between them: no terrain refining or
+  // tiles paging in, no culling against the depth of an earlier frame, and a stopped clock (see run_scene)
+  if (check_textures)
+  {
+    use_terrain = use_virtual_texture = false;
+    occlusion = "off";
+    impostor_pixels = 0.0f;
+  }
+
+#ifndef PLANETS_PROFILE
+  if (!trace_path.empty())
+    std::cout << "--trace needs a profiling build (make PROFILE=1), no trace will be written" << std::endl;
+#endif
+  PROFILE_THREAD("main");
+
   // glfw: initialize and configure
   // ------------------------------
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  // benchmarks and checks render into a hidden window
+  if (!bench.empty() || check_allocs || check_textures)
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
   // glfw window creation
   // --------------------
@@ -69,11 +430,26 @@ int main()
     std::cout << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
+  BindlessTextures::Load((GLADloadproc)glfwGetProcAddress);
+  Shader::LoadBinaryCache((GLADloadproc)glfwGetProcAddress);
 
   // configure global opengl state
   // -----------------------------
   glEnable(GL_DEPTH_TEST);
+  // benchmarks and checks must not wait for vsync
+  if (!bench.empty() || check_allocs || check_textures)
+    glfwSwapInterval(0);
+
+  // everything the scene allocates is released before the context goes away
+  int result = run_scene(window);
+  GpuResources::Instance().ReportLeaks();
+  glfwTerminate();
+  return result;
+}
 
+// loads the scene and runs the render loop until the window is closed
+int run_scene(GLFWwindow *window)
+{
   // Get path of current working directory (c-like code because there is no alternative in c++11)
   char cwd[PATH_MAX];
   if (getcwd(cwd, sizeof(cwd)) == NULL)
@@ -87,7 +463,8 @@ int main()
   char fs_path[PATH_MAX];
   strcpy(fs_path, cwd);
 
-  // Shaders
+  // Shaders, which size their Materials block like MaterialLibrary
+  Shader::Defines.push_back({"MAX_MATERIALS", std::to_string(MAX_MATERIALS)});
   Shader PlanetShader(strcat(vs_path, "/src/planets.vs"),
                       strcat(fs_path, "/src/planets.fs"));
   strcpy(fs_path, cwd);
@@ -98,15 +475,107 @@ int main()
   PlanetShader.setInt("texture0", 0);
   LightingShader.use();
   LightingShader.setInt("texture1", 1);
+  DeferredRenderer deferred(std::string(cwd) + "/src");
+  Hud hud(std::string(cwd) + "/src");
+  Starfield starfield(std::string(cwd) + "/src");
+  ImpostorRenderer impostors(std::string(cwd) + "/src");
+  std::vector<Shader *> shaders = {&PlanetShader,          &LightingShader,           &deferred.GeometryShader, &deferred.LightingShader,
+                                   &starfield.StarShader, &impostors.ImpostorShader, &hud.HudShader};
+  // clustered shading needs compute shaders
+  std::unique_ptr<ClusteredLighting> clustered;
+  clustered_supported = ClusteredLighting::Supported();
+  if (clustered_supported)
+  {
+    clustered.reset(new ClusteredLighting(std::string(cwd) + "/src"));
+    shaders.push_back(&clustered->PlanetShader);
+    shaders.push_back(&clustered->CullShader);
+  }
+  else
+  {
+    if (render_path == CLUSTERED_SHADING || bench == "clustered")
+      std::cout << "Clustered shading needs OpenGL 4.3, falling back to forward shading" << std::endl;
+    if (render_path == CLUSTERED_SHADING)
+      render_path = FORWARD_SHADING;
+    if (bench == "clustered")
+      bench.clear();
+  }
+  // occlusion culling. Reading results back from a software rasterizer costs more than testing on the CPU
+  JobSystem jobs;
+  OcclusionCuller culler(std::string(cwd) + "/src", jobs);
+  occlusion_culler = &culler;
+  for (Shader *shader : culler.Shaders())
+    shaders.push_back(shader);
+  if (occlusion.empty())
+  {
+    std::string renderer = (const char *)glGetString(GL_RENDERER);
+    bool software = renderer.find("llvmpipe") != std::string::npos || renderer.find("softpipe") != std::string::npos;
+    culler.mode = software ? OcclusionCuller::CPU : OcclusionCuller::GPU;
+  }
+  else
+    culler.mode = occlusion == "gpu" ? OcclusionCuller::GPU : occlusion == "cpu" ? OcclusionCuller::CPU : OcclusionCuller::OFF;
+  // the impostor benchmark measures drawing, culling a million objects would dominate it
+  if (bench == "impostors")
+    culler.mode = OcclusionCuller::OFF;
+
+  // per-frame transforms of the objects drawn with the planet shaders
+  std::unique_ptr<StreamBuffer> transforms(new StreamBuffer(StreamBuffer::DefaultMode()));
 
   // Models
-  char model_path[PATH_MAX];
-  strcpy(model_path, cwd);
-  Model sun(strcat(model_path, "/misc/planet/planet.obj"));
-  strcpy(model_path, cwd);
-  Model moon(strcat(model_path, "/misc/rock/rock.obj"));
-  strcpy(model_path, cwd);
-  Model earth(strcat(model_path, "/misc/earth/Model/Globe.obj"));
+  if (bench == "loading")
+  {
+    Model sun = load_model(cwd, "/misc/planet/planet.obj");
+    Model moon = load_model(cwd, "/misc/rock/rock.obj");
+    Model earth = load_model(cwd, "/misc/earth/Model/Globe.obj");
+    // the OBJ times include reading and decoding the textures, the spheres are geometry only
+    bench_sphere(sun);
+    bench_sphere(earth);
+    if (print_memory)
+      GpuResources::Instance().PrintBreakdown();
+    TextureCache::Instance().PrintStats();
+    return 0;
+  }
+  // streamed in while placeholders are drawn. Benchmarks and checks measure the complete scene, so they wait for it
+  AssetManager assets;
+  sync_loading = sync_loading || !bench.empty() || check_allocs || check_textures;
+  // the Sun and the Earth are procedural spheres, the Moon and the asteroids a rock model
+  std::string sunTexture = std::string(cwd) + "/misc/planet/planet_Quom1200.png";
+  std::string earthTexture = std::string(cwd) + "/misc/earth/Model/Albedo-diffuse_Low-end.jpg";
+  // the Earth's material: albedo, the ocean mask telling water (shiny) from land, and a cloud layer. With a virtual
+  // texture the albedo is its, the model doesn't load it
+  bool earth_virtual_albedo = use_virtual_texture || bench == "virtual-texture";
+  std::vector<Texture> earthTextures = {{0, "texture_specular", std::string(cwd) + "/misc/earth/Model/Ocean_Mask.png"},
+                                        {0, "texture_clouds", std::string(cwd) + "/misc/earth/Model/Clouds_Low-end.png"}};
+  if (!earth_virtual_albedo)
+    earthTextures.insert(earthTextures.begin(), {0, "texture_diffuse", earthTexture});
+  Model *sun = sync_loading ? assets.LoadSphere(PLANET_SUBDIVISIONS, sunTexture) : assets.RequestSphere(PLANET_SUBDIVISIONS, sunTexture);
+  Model *moon = sync_loading ? assets.Load(std::string(cwd) + "/misc/rock/rock.obj") : assets.Request(std::string(cwd) + "/misc/rock/rock.obj");
+  Model *earth = sync_loading ? assets.LoadSphere(PLANET_SUBDIVISIONS, earthTextures) : assets.RequestSphere(PLANET_SUBDIVISIONS, earthTextures);
+  // made from the models' textures once they are loaded
+  MaterialLibrary materials;
+  MaterialParameters earthMaterial;
+  earthMaterial.specular = glm::vec4(1.0f, 32.0f, 0.3f, 2.0f);
+  earthMaterial.clouds = glm::vec4(0.8f, 0.01f, 0.0f, 0.0f);
+  materials.SetParameters(earth, earthMaterial);
+  // the Earth's surface, displaced by its ocean mask. The sphere stands in until the mask is read
+  std::unique_ptr<PlanetTerrain> terrain;
+  if (use_terrain || bench == "terrain")
+  {
+    terrain.reset(new PlanetTerrain(std::string(cwd) + "/misc/earth/Model/Ocean_Mask.png", TERRAIN_HEIGHT));
+    if (sync_loading)
+      terrain->WaitForHeights();
+  }
+  // the Earth's albedo paged in from a tiled copy on disk as the view needs it. The whole image is drawn until the
+  // page file is ready, and when virtual texturing is off
+  std::unique_ptr<VirtualTexture> earthAlbedo;
+  std::unique_ptr<VirtualTextureFeedback> feedback;
+  if (earth_virtual_albedo)
+  {
+    earthAlbedo.reset(new VirtualTexture(earthTexture));
+    feedback.reset(new VirtualTextureFeedback(std::string(cwd) + "/src"));
+    shaders.push_back(&feedback->FeedbackShader);
+    if (sync_loading)
+      earthAlbedo->WaitForPages();
+  }
 
   // Initial positions of planets based on camera
   glm::vec3 sun_init_pos = glm::vec3(0.0f, 0.0f, -60.0f);
@@ -118,49 +587,390 @@ int main()
   glm::vec3 moon_pos = moon_init_pos;
   glm::vec3 earth_pos = earth_init_pos;
 
+  // Point lights orbiting the Sun
+  LightSet lights;
+  lights.Generate(num_lights, sun_init_pos);
+
+  // Asteroid belt
+  std::vector<glm::mat4> asteroids;
+  generate_asteroids(asteroids, num_asteroids);
+
+  // benchmarks
+  const int bench_light_counts[] = {1, 16, 256};
+  const int bench_clustered_counts[] = {1, 4, 16, 64, 256, 1024, 4096};
+  const int bench_asteroid_counts[] = {1000, 4000};
+  const int bench_starfield_sizes[][2] = {{1920, 1080}, {3840, 2160}};
+  // asteroids and whether they're impostors. No million meshes: their transforms alone would take 128 MB per frame
+  const std::pair<int, bool> bench_impostor_configs[] = {{10000, false}, {10000, true}, {100000, false}, {100000, true}, {1000000, true}};
+  const OcclusionCuller::Mode bench_occlusion_modes[] = {OcclusionCuller::OFF, OcclusionCuller::CPU, OcclusionCuller::GPU};
+  std::vector<StreamBuffer::Mode> bench_stream_modes = {StreamBuffer::UNSYNCHRONIZED, StreamBuffer::ORPHAN};
+  if (StreamBuffer::PersistentSupported())
+    bench_stream_modes.insert(bench_stream_modes.begin(), StreamBuffer::PERSISTENT);
+  // model and InvTransModel pairs padding the transforms of a frame up to BENCH_STREAM_TRANSFORMS
+  std::vector<glm::mat4> bench_transforms;
+  std::unique_ptr<Benchmark> benchmark;
+  if (bench == "lights")
+  {
+    std::vector<std::string> configs;
+    for (int count : bench_light_counts)
+    {
+      configs.push_back("forward " + std::to_string(count) + " lights");
+      configs.push_back("deferred " + std::to_string(count) + " lights");
+    }
+    benchmark.reset(new Benchmark("forward vs deferred shading", configs));
+  }
+  else if (bench == "clustered")
+  {
+    std::vector<std::string> configs;
+    for (int count : bench_clustered_counts)
+      configs.push_back("clustered " + std::to_string(count) + " lights");
+    benchmark.reset(new Benchmark("clustered shading light scaling", configs));
+  }
+  else if (bench == "occlusion")
+  {
+    std::vector<std::string> configs;
+    for (int count : bench_asteroid_counts)
+      for (OcclusionCuller::Mode mode : bench_occlusion_modes)
+        configs.push_back(std::to_string(count) + " asteroids, " + occlusion_mode_names[mode]);
+    benchmark.reset(new Benchmark("occlusion culling in the asteroid belt", configs));
+  }
+  else if (bench == "streaming")
+  {
+    std::vector<std::string> configs;
+    for (StreamBuffer::Mode mode : bench_stream_modes)
+      configs.push_back(std::to_string(BENCH_STREAM_TRANSFORMS) + " transforms, " + StreamBuffer::ModeName(mode));
+    benchmark.reset(new Benchmark("per-frame transform upload", configs));
+    std::vector<glm::mat4> bodies;
+    generate_asteroids(bodies, BENCH_STREAM_TRANSFORMS);
+    for (const glm::mat4 &body : bodies)
+    {
+      bench_transforms.push_back(body);
+      bench_transforms.push_back(glm::transpose(glm::inverse(body)));
+    }
+  }
+  else if (bench == "terrain")
+    benchmark.reset(new Benchmark("terrain level of detail, flight from orbit to the surface",
+                                  {"flight, " + std::to_string(TERRAIN_PATCHES_PER_FRAME) + " patches/frame", "flight, unbudgeted"}, 10,
+                                  BENCH_FLIGHT_FRAMES - 10));
+  else if (bench == "virtual-texture")
+    benchmark.reset(new Benchmark("virtual texturing of the Earth's albedo, flight from orbit to the surface",
+                                  {"flight, whole texture", "flight, virtual texture"}, 10, BENCH_FLIGHT_FRAMES - 10));
+  else if (bench == "materials")
+  {
+    benchmark.reset(new Benchmark("texture binding of the planets and " + std::to_string(BENCH_MATERIAL_ASTEROIDS) + " asteroids",
+                                  {"per mesh", "per material batch"}));
+    generate_asteroids(asteroids, BENCH_MATERIAL_ASTEROIDS);
+  }
+  else if (bench == "starfield")
+  {
+    std::vector<std::string> configs;
+    for (const int *size : bench_starfield_sizes)
+    {
+      std::string resolution = std::to_string(size[0]) + "x" + std::to_string(size[1]) + " offscreen, ";
+      configs.push_back(resolution + "clear color");
+      configs.push_back(resolution + "starfield");
+    }
+    benchmark.reset(new Benchmark("starfield fill cost", configs));
+  }
+  else if (bench == "impostors")
+  {
+    std::vector<std::string> configs;
+    for (const std::pair<int, bool> &config : bench_impostor_configs)
+      configs.push_back(std::to_string(config.first) + " asteroids, " + (config.second ? "impostors" : "meshes"));
+    benchmark.reset(new Benchmark("distant asteroids as meshes and impostors", configs, 3, 30));
+  }
+  else if (bench == "pacing")
+  {
+    char paced[64];
+    snprintf(paced, sizeof(paced), "paced to %.1f ms, dynamic resolution", target_frame_ms > 0.0f ? target_frame_ms : BENCH_PACING_FRAME_TIME);
+    benchmark.reset(new Benchmark(std::to_string(BENCH_PACING_ASTEROIDS) + " asteroids and " + std::to_string(BENCH_PACING_LIGHTS) + " lights",
+                                  {"unpaced", paced}, 60, 300));
+    generate_asteroids(asteroids, BENCH_PACING_ASTEROIDS);
+    lights.Generate(BENCH_PACING_LIGHTS, sun_init_pos);
+  }
+  // the asteroid texture paths of --bench-texture-arrays and --check-textures, bindless where the driver has it
+  std::vector<Asteroid_Textures> texture_paths = {ASTEROID_TEXTURES_BIND, ASTEROID_TEXTURES_ARRAY};
+  if (BindlessTextures::Supported())
+    texture_paths.push_back(ASTEROID_TEXTURES_BINDLESS);
+  else if (asteroid_textures == ASTEROID_TEXTURES_BINDLESS)
+  {
+    std::cout << "Bindless textures need ARB_bindless_texture and OpenGL 4.3, falling back to texture arrays" << std::endl;
+    asteroid_textures = ASTEROID_TEXTURES_ARRAY;
+  }
+  if (bench == "texture-arrays")
+  {
+    std::vector<std::string> configs = {"a texture bound per asteroid", "texture arrays"};
+    if (BindlessTextures::Supported())
+      configs.push_back("bindless textures");
+    benchmark.reset(new Benchmark("textures of " + std::to_string(BENCH_DISTINCT_BODIES) + " distinct asteroids", configs));
+    generate_asteroids(asteroids, BENCH_DISTINCT_BODIES);
+  }
+  if (check_textures)
+  {
+    asteroid_textures = texture_paths[0];
+    generate_asteroids(asteroids, CHECK_TEXTURES_ASTEROIDS);
+  }
+  bool all_texture_paths = bench == "texture-arrays" || check_textures;
+  // a texture of its own for every asteroid, each one a texture to bind (and resident, for bindless textures), and all
+  // of them packed into arrays. The arrays also stand in for bindless textures with clustered shading, which has no
+  // bindless shader
+  std::vector<TextureHandle> body_textures;
+  TextureArrayPacker body_arrays;
+  // and their average colors, for their impostors
+  std::vector<glm::vec3> body_albedos;
+  size_t body_count = 0;
+  if (asteroid_textures != ASTEROID_TEXTURES_SHARED || all_texture_paths)
+  {
+    std::vector<std::vector<unsigned char>> pixels;
+    generate_body_textures(pixels, std::string(cwd) + "/misc/rock/rock.png", (int)asteroids.size());
+    body_count = pixels.size();
+    GpuResourceOwner owner("asteroid textures");
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+      if (asteroid_textures == ASTEROID_TEXTURES_BIND || asteroid_textures == ASTEROID_TEXTURES_BINDLESS || all_texture_paths)
+        body_textures.push_back(TextureFromPixels(pixels[i].data(), BODY_TEXTURE_SIZE, BODY_TEXTURE_SIZE, 3, "asteroid " + std::to_string(i)));
+      if (asteroid_textures == ASTEROID_TEXTURES_ARRAY || asteroid_textures == ASTEROID_TEXTURES_BINDLESS || all_texture_paths)
+        body_arrays.Add(pixels[i].data(), BODY_TEXTURE_SIZE, BODY_TEXTURE_SIZE, 3);
+      glm::vec3 sum(0.0f);
+      for (size_t t = 0; t < pixels[i].size(); t += 3)
+        sum += glm::vec3(pixels[i][t], pixels[i][t + 1], pixels[i][t + 2]);
+      body_albedos.push_back(sum / (pixels[i].size() / 3 * 255.0f));
+    }
+    body_arrays.Pack("asteroid texture arrays");
+  }
+  // after the textures, so that their handles are released before them
+  std::unique_ptr<BindlessTextures> bindless;
+  if (!body_textures.empty() && BindlessTextures::Supported())
+  {
+    bindless.reset(new BindlessTextures(std::string(cwd) + "/src"));
+    shaders.push_back(&bindless->ForwardShader);
+    shaders.push_back(&bindless->GeometryShader);
+    for (const TextureHandle &texture : body_textures)
+      bindless->Add(texture.Id());
+    bindless->Upload("asteroid texture handles");
+  }
+  // culling totals of the current benchmark configuration
+  unsigned long bench_tested = 0, bench_culled = 0, bench_raster_triangles = 0;
+  float bench_raster_ms = 0.0f;
+  // transform upload totals of the current benchmark configuration
+  float bench_upload_ms = 0.0f;
+  int bench_upload_frames = 0;
+  // terrain flight of the current benchmark configuration
+  int bench_flight_frame = 0;
+  unsigned long bench_patches_generated = 0;
+  unsigned int bench_patches_drawn = 0, bench_deepest_level = 0;
+  float bench_generate_worst_ms = 0.0f;
+  // texture binds and draw calls of the current benchmark configuration
+  unsigned long bench_texture_binds = 0, bench_draw_calls = 0;
+  int bench_bind_frames = 0;
+  // whether the visible objects have outgrown the transform buffer, logged once
+  bool transforms_clamped = false;
+  // lights clustered shading dropped in the current benchmark configuration, and whether any configuration did
+  unsigned int bench_lights_dropped = 0;
+  bool bench_dropped_any = false;
+  // offscreen target the scene is rendered to instead of the window, at a resolution of its own
+  std::unique_ptr<RenderTarget> sceneTarget;
+  // frame pacing and dynamic resolution, which renders the scene to the target. Benchmarks and checks run unpaced
+  FramePacer pacer;
+  if (bench.empty() && !check_textures)
+    pacer.SetTarget(target_frame_ms, use_dynamic_resolution);
+  if (pacer.Active())
+    glfwSwapInterval(0);
+  if (bench == "starfield" || pacer.DynamicResolution())
+    sceneTarget.reset(new RenderTarget());
+  // frame interval deviation of the current benchmark configuration
+  double bench_interval_sum = 0.0, bench_interval_squares = 0.0;
+  int bench_intervals = 0;
+
   float angle = 0.0f;
 
+  // shader hot reload bookkeeping, to log the frame time hitch of a reload
+  bool shaderReloading = false;
+  float reloadWorstFrame = 0.0f;
+  int reloadFrames = 0;
+
+  // memory of the current frame's transient data, freed at the start of the next frame
+  Arena frameArena(64 * 1024);
+  // streaming bookkeeping: frame times until every model is ready
+  bool streaming = true;
+  float streamingWorstFrame = 0.0f;
+  int streamingFrames = 0;
+  // --check-allocs bookkeeping
+  int allocsFrame = 0;
+  unsigned long checkedAllocations = 0;
+  int allocatingFrames = 0;
+  // --check-textures bookkeeping, counting frames of its own so that it combines with --check-allocs
+  int texturesFrame = 0;
+  std::vector<std::vector<unsigned char>> checkImages(texture_paths.size());
+  size_t checkAsteroids = 0;
+  if (render_path == CLUSTERED_SHADING && (asteroid_textures == ASTEROID_TEXTURES_BINDLESS || check_textures) && bindless)
+    std::cout << "Clustered shading has no bindless shader, its asteroids are drawn from the texture arrays" << std::endl;
+
   // render loop
   // -----------
   while (!glfwWindowShouldClose(window))
   {
+    PROFILE_ZONE("frame");
+    frameArena.Reset();
+    unsigned long frameAllocations = heapAllocations.count;
     // per-frame time logic
     // --------------------
     float currentFrameTime = static_cast<float>(glfwGetTime());
     deltaTime = currentFrameTime - lastFrameTime;
     lastFrameTime = currentFrameTime;
+    // what moves on its own, stopped for checks comparing frames
+    float sceneTime = check_textures ? 0.0f : currentFrameTime;
 
     // input
     // -----
     processInput(window);
 
+    // shader hot reload
+    // -----------------
+    // deltaTime is the duration of the previous frame, so it's accounted to the reload if that frame did reload work
+    if (shaderReloading)
+    {
+      reloadWorstFrame = std::max(reloadWorstFrame, deltaTime);
+      reloadFrames++;
+    }
+    bool reloadWork = false;
+    {
+      PROFILE_ZONE("shader reload");
+      for (Shader *shader : shaders)
+        reloadWork = shader->Update() || reloadWork;
+    }
+    if (shaderReloading && !reloadWork)
+    {
+      std::cout << "SHADER::RELOAD:: worst frame " << reloadWorstFrame * 1000.0f << " ms over " << reloadFrames << " frames" << std::endl;
+      reloadWorstFrame = 0.0f;
+      reloadFrames = 0;
+    }
+    shaderReloading = reloadWork;
+
+    // model streaming
+    // ---------------
+    assets.Update();
+
+    // benchmark configuration
+    // -----------------------
+    if (benchmark)
+    {
+      if (benchmark->ConfigChanged() && bench == "lights")
+      {
+        render_path = benchmark->Config() % 2 == 1 ? DEFERRED_SHADING : FORWARD_SHADING;
+        lights.Generate(bench_light_counts[benchmark->Config() / 2], sun_init_pos);
+      }
+      else if (benchmark->ConfigChanged() && bench == "clustered")
+      {
+        render_path = CLUSTERED_SHADING;
+        lights.Generate(bench_clustered_counts[benchmark->Config()], sun_init_pos);
+      }
+      else if (benchmark->ConfigChanged() && bench == "occlusion")
+      {
+        generate_asteroids(asteroids, bench_asteroid_counts[benchmark->Config() / 3]);
+        culler.mode = bench_occlusion_modes[benchmark->Config() % 3];
+      }
+      else if (benchmark->ConfigChanged() && bench == "terrain")
+      {
+        terrain->Reset();
+        terrain->PatchesPerFrame = benchmark->Config() == 0 ? TERRAIN_PATCHES_PER_FRAME : INT_MAX;
+        bench_flight_frame = 0;
+        bench_patches_generated = bench_patches_drawn = bench_deepest_level = 0;
+        bench_generate_worst_ms = 0.0f;
+      }
+      else if (benchmark->ConfigChanged() && bench == "virtual-texture")
+      {
+        use_virtual_texture = benchmark->Config() == 1;
+        if (terrain)
+          terrain->Reset();
+        earthAlbedo->Reset();
+        bench_flight_frame = 0;
+      }
+      else if (benchmark->ConfigChanged() && bench == "materials")
+      {
+        use_materials = benchmark->Config() == 1;
+        materials.Invalidate();
+      }
+      else if (benchmark->ConfigChanged() && bench == "pacing")
+      {
+        bool paced = benchmark->Config() == 1;
+        pacer.SetTarget(paced ? (target_frame_ms > 0.0f ? target_frame_ms : BENCH_PACING_FRAME_TIME) : 0.0f, true);
+        sceneTarget.reset(paced ? new RenderTarget() : nullptr);
+      }
+      else if (benchmark->ConfigChanged() && bench == "impostors")
+      {
+        generate_asteroids(asteroids, bench_impostor_configs[benchmark->Config()].first);
+        impostor_pixels = bench_impostor_configs[benchmark->Config()].second ? INFINITY : 0.0f;
+      }
+      else if (benchmark->ConfigChanged() && bench == "starfield")
+      {
+        const int *size = bench_starfield_sizes[benchmark->Config() / 2];
+        sceneTarget->Resize(size[0], size[1], "scene target");
+        use_starfield = benchmark->Config() % 2 == 1;
+        starfield.ResetTiming();
+      }
+      else if (benchmark->ConfigChanged() && bench == "texture-arrays")
+        asteroid_textures = texture_paths[benchmark->Config()];
+      else if (benchmark->ConfigChanged() && bench == "streaming")
+        transforms.reset(new StreamBuffer(bench_stream_modes[benchmark->Config()], BENCH_STREAM_TRANSFORMS * 2 * sizeof(glm::mat4)));
+      if (benchmark->ConfigChanged())
+      {
+        bench_tested = bench_culled = bench_raster_triangles = 0;
+        bench_texture_binds = bench_draw_calls = 0;
+        bench_bind_frames = 0;
+        bench_interval_sum = bench_interval_squares = 0.0;
+        bench_intervals = 0;
+        bench_lights_dropped = 0;
+        bench_raster_ms = bench_upload_ms = 0.0f;
+        bench_upload_frames = 0;
+      }
+      // down to the Earth, looking at the ground, the altitude dropping by the same factor every frame
+      if (bench == "terrain" || bench == "virtual-texture")
+      {
+        glm::vec3 earth_center = sun_init_pos + earth_init_pos;
+        glm::vec3 up = glm::normalize(glm::vec3(0.3f, 0.4f, 1.0f));
+        float altitude = BENCH_FLIGHT_FROM * powf(BENCH_FLIGHT_TO / BENCH_FLIGHT_FROM, std::min(1.0f, (float)bench_flight_frame++ / BENCH_FLIGHT_FRAMES));
+        camera.Position = earth_center + up * (EARTH_RADIUS + altitude);
+        camera.Front = -up;
+        camera.Right = glm::normalize(glm::cross(camera.Front, camera.WorldUp));
+        camera.Up = glm::cross(camera.Right, camera.Front);
+      }
+      benchmark->BeginFrame();
+    }
+    // --check-textures: every texture path in turn
+    if (check_textures)
+      asteroid_textures = texture_paths[std::min<size_t>(texturesFrame / CHECK_TEXTURES_FRAMES, texture_paths.size() - 1)];
+
     // render
     // ------
+    pacer.BeginFrame();
     glClearColor(0.01f, 0.01f, 0.01f, 1.0f); // black backround with minimal ambient lighting (0.01f)
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // view/projection transformations
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    const float zNear = 0.1f, zFar = 100.0f;
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, zNear, zFar);
     glm::mat4 view = camera.GetViewMatrix();
 
-    // Render light source (Sun)
-    glm::mat4 model1 = glm::mat4(1.0f);
-    model1 = glm::translate(model1, sun_pos);
+    auto simulationStart = std::chrono::steady_clock::now();
+    {
+      PROFILE_ZONE("simulation");
+      lights.Update(sceneTime);
 
-    LightingShader.use();
-    LightingShader.setMat4("projection", projection);
-    LightingShader.setMat4("view", view);
-    LightingShader.setMat4("model", model1);
-    LightingShader.setVec4("color", glm::vec4(1.8f, 1.5f, 1.0f, 1.0f));
-    sun.Draw(LightingShader); // Draw object
+      // Control movement
+      if (begin_movement)
+      {
+        // Angle is increased based on time instead of frame
+        angle += deltaTime / 20;
+        earth_pos = glm::vec3(30.0f * glm::cos(5 * angle), 0.0f, -30.0f * glm::sin(5 * angle));
+        moon_pos = glm::vec3(20.0f * glm::cos(angle), 0.0f, -20.0f * glm::sin(angle));
+      }
+    }
+    frameStats.simulationMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - simulationStart).count();
 
-    // Render Earth and moon
-    PlanetShader.use();
-    PlanetShader.setMat4("projection", projection);
-    PlanetShader.setMat4("view", view);
-    PlanetShader.setVec3("lightPos", sun_init_pos);
-    PlanetShader.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
-    PlanetShader.setVec3("viewPos", camera.Position);
+    // Sun
+    glm::mat4 model1 = glm::mat4(1.0f);
+    model1 = glm::translate(model1, sun_pos);
 
     // Moon
     glm::mat4 model2 = glm::mat4(1.0f);
@@ -168,15 +978,6 @@ int main()
     // Earth
     glm::mat4 model3 = glm::mat4(1.0f);
 
-    // Control movement
-    if (begin_movement)
-    {
-      // Angle is increased based on time instead of frame
-      angle += deltaTime / 20;
-      earth_pos = glm::vec3(30.0f * glm::cos(5 * angle), 0.0f, -30.0f * glm::sin(5 * angle));
-      moon_pos = glm::vec3(20.0f * glm::cos(angle), 0.0f, -20.0f * glm::sin(angle));
-    }
-
     // Earth positioning
     model3 = glm::translate(model1, earth_pos);
 
@@ -186,23 +987,562 @@ int main()
     // Moon positioning
     model2 = glm::translate(model3, moon_pos);
 
+    // Occlusion culling: the Sun, the Earth and the asteroids hide what's behind them
+    int fbWidth, fbHeight;
+    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+    // dynamic resolution: the target follows the window's size at the pacer's scale
+    if (pacer.DynamicResolution())
+      sceneTarget->Resize(std::max(1, (int)(fbWidth * pacer.Scale() + 0.5f)), std::max(1, (int)(fbHeight * pacer.Scale() + 0.5f)), "scene target");
+    // resolution the scene is rendered at, the window's unless it goes to the offscreen target
+    int sceneWidth = sceneTarget ? sceneTarget->Width() : fbWidth, sceneHeight = sceneTarget ? sceneTarget->Height() : fbHeight;
+    size_t objectCount = 3 + asteroids.size();
+    OcclusionObject *objects = frameArena.Allocate<OcclusionObject>(objectCount);
+    bool *visible = frameArena.Allocate<bool>(objectCount);
+    objects[0] = assets.Drawable(sun, glm::scale(model1, glm::vec3(SUN_RADIUS)), true);
+    objects[1] = assets.Drawable(earth, glm::scale(model3, glm::vec3(EARTH_RADIUS)), true);
+    objects[2] = assets.Drawable(moon, model2, false);
+    for (size_t i = 0; i < asteroids.size(); i++)
+      objects[3 + i] = assets.Drawable(moon, model1 * asteroids[i], true);
+    // the asteroids have textures of their own, unless they're placeholders for now
+    bool distinct_asteroids = asteroid_textures != ASTEROID_TEXTURES_SHARED && body_count > 0 && objects[3].model == moon;
+    // bindless textures have no clustered shader, the texture arrays stand in
+    Asteroid_Textures asteroid_path = asteroid_textures;
+    if (asteroid_path == ASTEROID_TEXTURES_BINDLESS && (!bindless || render_path == CLUSTERED_SHADING))
+      asteroid_path = ASTEROID_TEXTURES_ARRAY;
+    // the terrain picks its patches for this view, if the Earth isn't standing in for itself as a placeholder
+    bool draw_terrain = false;
+    if (terrain)
+    {
+      terrain->Update(objects[1].transform, view, projection, camera.Position, sceneHeight, glm::radians(camera.Zoom));
+      draw_terrain = terrain->Ready() && objects[1].model == earth && !earth->textures_loaded.empty();
+      if (benchmark)
+      {
+        bench_patches_generated += terrain->PatchesGenerated;
+        bench_patches_drawn = std::max(bench_patches_drawn, terrain->PatchesDrawn);
+        bench_deepest_level = std::max(bench_deepest_level, terrain->DeepestLevel);
+        bench_generate_worst_ms = std::max(bench_generate_worst_ms, terrain->GenerateMilliseconds);
+      }
+    }
+    unsigned int culledBefore = frameStats.occlusionCulled, testedBefore = frameStats.occlusionTested;
+    culler.Cull(objects, objectCount, view, projection, sceneWidth, sceneHeight, visible);
+    // asteroids too small on screen for their mesh to matter are drawn as impostors instead, and no longer count as
+    // visible meshes. Their sphere lies between the rock's inner and bounding spheres
+    size_t impostorCount = 0;
+    ImpostorInstance *impostorInstances = frameArena.Allocate<ImpostorInstance>(objectCount - 3);
+    if (impostor_pixels > 0.0f && objectCount > 3)
+    {
+      PROFILE_ZONE("impostor selection");
+      const Model &rock = *objects[3].model;
+      float radiusScale = rock.boundsRadius > 0.0f ? 0.5f + 0.5f * std::min(rock.innerRadius / rock.boundsRadius, 1.0f) : 1.0f;
+      glm::vec4 albedo(impostors.AverageAlbedo(&rock), 1.0f);
+      for (size_t i = 3; i < objectCount; i++)
+      {
+        if (!visible[i])
+          continue;
+        BoundingSphere bounds = WorldBounds(*objects[i].model, objects[i].transform);
+        float radius = bounds.radius * radiusScale;
+        if (ImpostorRenderer::ProjectedPixels(radius, glm::distance(bounds.center, camera.Position), projection, sceneHeight) >= impostor_pixels)
+          continue;
+        if (distinct_asteroids)
+          albedo = glm::vec4(body_albedos[(i - 3) % body_count], 1.0f);
+        impostorInstances[impostorCount++] = {glm::vec4(bounds.center, radius), albedo};
+        visible[i] = false;
+      }
+    }
+    // virtual texturing: the tiles the last feedback asked for, then this frame's feedback from the Earth
+    bool virtual_earth = false;
+    if (earthAlbedo)
+    {
+      PROFILE_ZONE("virtual texture");
+      VirtualTexture *virtualTextures[] = {earthAlbedo.get()};
+      feedback->Resolve(virtualTextures, 1);
+      earthAlbedo->Update();
+      virtual_earth = use_virtual_texture && earthAlbedo->Ready() && objects[1].model == earth && visible[1];
+      if (use_virtual_texture && earthAlbedo->Ready())
+        earthAlbedo->ReleaseWhole();
+      if (virtual_earth && feedback->Begin(sceneWidth, sceneHeight))
+      {
+        PROFILE_GPU_ZONE("virtual texture feedback");
+        feedback->FeedbackShader.setMat4("projection", projection);
+        feedback->FeedbackShader.setMat4("view", view);
+        feedback->FeedbackShader.setInt("transformBase", -1);
+        feedback->FeedbackShader.setMat4("model", objects[1].transform);
+        feedback->FeedbackShader.setMat4("InvTransModel", glm::transpose(glm::inverse(objects[1].transform)));
+        if (draw_terrain)
+          terrain->Draw(feedback->FeedbackShader, nullptr);
+        else
+          earth->Draw(feedback->FeedbackShader, 1, false);
+        feedback->End(sceneWidth, sceneHeight);
+      }
+    }
+    if (benchmark)
+    {
+      bench_tested += frameStats.occlusionTested - testedBefore;
+      bench_culled += frameStats.occlusionCulled - culledBefore;
+      if (culler.mode == OcclusionCuller::CPU)
+      {
+        bench_raster_triangles += culler.Rasterizer().TrianglesRasterized;
+        bench_raster_ms += culler.Rasterizer().RenderMilliseconds;
+      }
+    }
+
+    if (sceneTarget)
+    {
+      sceneTarget->Bind();
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // Render Earth and moon: lit directly, into the G-buffer to be lit in one pass afterwards, or lit by the lights
+    // of their clusters
+    Shader &planetShader = render_path == DEFERRED_SHADING    ? deferred.GeometryShader
+                           : render_path == CLUSTERED_SHADING ? clustered->PlanetShader
+                                                              : PlanetShader;
+    if (render_path == DEFERRED_SHADING)
+    {
+      deferred.Resize(sceneWidth, sceneHeight);
+      deferred.BeginGeometryPass();
+    }
+    else if (render_path == CLUSTERED_SHADING)
+    {
+      clustered->CullLights(view, projection, zNear, zFar, sceneWidth, sceneHeight, camera.Position, sun_init_pos,
+                            glm::vec3(1.0f, 1.0f, 1.0f), lights);
+    }
+    else
+    {
+      PlanetShader.use();
+      PlanetShader.setVec3("lightPos", sun_init_pos);
+      PlanetShader.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
+      PlanetShader.setVec3("viewPos", camera.Position);
+      PlanetShader.setInt("pointLights", LIGHT_BUFFER_UNIT);
+      PlanetShader.setInt("numPointLights", (int)lights.lights.size());
+      lights.Bind();
+    }
+    planetShader.setMat4("projection", projection);
+    planetShader.setMat4("view", view);
+    planetShader.setFloat("time", sceneTime);
+    materials.Begin(planetShader);
+
+    // Transforms of the visible Earth, Moon and asteroids, in that order, written straight into the transform buffer
+    size_t drawnCount = 0, drawnPlanets = 0;
+    for (size_t i = 1; i < objectCount; i++)
+      if (visible[i])
+      {
+        drawnCount++;
+        drawnPlanets += i < 3;
+      }
+    // what the shaders can't reach of the transform buffer isn't drawn: the last asteroids, then the impostors
+    size_t maxTransforms = transforms->MaxFrameBytes() / (2 * sizeof(glm::mat4));
+    if (drawnCount > maxTransforms && !transforms_clamped)
+      std::cout << "ERROR::TRANSFORMS:: " << drawnCount << " visible objects, GL_MAX_TEXTURE_BUFFER_SIZE fits " << maxTransforms
+                << ", the rest aren't drawn" << std::endl;
+    transforms_clamped = transforms_clamped || drawnCount > maxTransforms;
+    for (size_t i = objectCount - 1; drawnCount > maxTransforms; i--)
+      if (visible[i])
+      {
+        visible[i] = false;
+        drawnCount--;
+      }
+    size_t transformCount = bench == "streaming" ? std::max<size_t>(drawnCount, BENCH_STREAM_TRANSFORMS) : drawnCount;
+    transformCount = std::min(transformCount, maxTransforms);
+    impostorCount = std::min(impostorCount, (transforms->MaxFrameBytes() - transformCount * 2 * sizeof(glm::mat4)) / sizeof(ImpostorInstance));
+    {
+      PROFILE_ZONE("upload transforms");
+      auto uploadStart = std::chrono::steady_clock::now();
+      // then the impostors
+      glm::mat4 *transform = (glm::mat4 *)transforms->Begin(transformCount * 2 * sizeof(glm::mat4) + impostorCount * sizeof(ImpostorInstance));
+      for (size_t i = 1; i < objectCount; i++)
+        if (visible[i])
+        {
+          glm::mat4 normal = glm::transpose(glm::inverse(objects[i].transform));
+          // the asteroid's layer of its texture array or index of its texture handle, see planets.vs
+          if (i >= 3 && distinct_asteroids && asteroid_path == ASTEROID_TEXTURES_ARRAY)
+            normal[3].x = (float)body_arrays.Layer((i - 3) % body_count).layer;
+          else if (i >= 3 && distinct_asteroids && asteroid_path == ASTEROID_TEXTURES_BINDLESS)
+            normal[3].x = (float)((i - 3) % body_count);
+          *transform++ = objects[i].transform;
+          *transform++ = normal;
+        }
+      if (transformCount > drawnCount)
+        memcpy(transform, &bench_transforms[drawnCount * 2], (transformCount - drawnCount) * 2 * sizeof(glm::mat4));
+      transform += (transformCount - drawnCount) * 2;
+      std::copy(impostorInstances, impostorInstances + impostorCount, (ImpostorInstance *)transform);
+      transforms->End();
+      if (benchmark)
+      {
+        bench_upload_ms += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+        bench_upload_frames++;
+      }
+    }
+
     // Draw objects after all transformations
-    PlanetShader.setMat4("model", model2);
-    PlanetShader.setMat4("InvTransModel", glm::transpose(glm::inverse(model2)));
-    moon.Draw(PlanetShader);
+    {
+      PROFILE_ZONE("draw planets");
+      PROFILE_GPU_ZONE("draw planets");
+      transforms->BindTexture(TRANSFORM_BUFFER_UNIT);
+      planetShader.setInt("transforms", TRANSFORM_BUFFER_UNIT);
+      planetShader.setInt("texture_array", TEXTURE_ARRAY_UNIT);
+      int transformBase = transforms->TexelOffset();
+      // the Earth, the Moon and the asteroids, which are moon rocks all drawn at once, sorted by material so that
+      // the draws sharing one don't bind its textures again
+      struct PlanetDraw
+      {
+        size_t object;
+        int material;
+        int transformBase;
+        unsigned int instances;
+      };
+      PlanetDraw *draws = frameArena.Allocate<PlanetDraw>(3);
+      int drawCount = 0;
+      for (size_t i = 1; i < 3; i++)
+        if (visible[i])
+        {
+          draws[drawCount++] = {i, materials.Find(objects[i].model), transformBase, 1};
+          transformBase += 8;
+        }
+      if (drawnCount > drawnPlanets && !distinct_asteroids)
+        draws[drawCount++] = {3, materials.Find(objects[3].model), transformBase, (unsigned int)(drawnCount - drawnPlanets)};
+      std::sort(draws, draws + drawCount, [](const PlanetDraw &a, const PlanetDraw &b)
+                { return a.material != b.material ? a.material < b.material : a.object < b.object; });
+      for (int d = 0; d < drawCount; d++)
+      {
+        const PlanetDraw &draw = draws[d];
+        // without a material (the placeholder), or without batching, the meshes bind their own textures
+        bool bindTextures = draw.material < 0 || !use_materials;
+        materials.Bind(draw.material, planetShader, use_materials);
+        if (draw.object == 1 && virtual_earth)
+          earthAlbedo->Bind(planetShader);
+        else if (draw.object == 1 && earthAlbedo && objects[1].model == earth)
+          earthAlbedo->BindWhole(planetShader);
+        if (draw.object == 1 && draw_terrain)
+        {
+          planetShader.setInt("transformBase", -1);
+          planetShader.setMat4("model", objects[1].transform);
+          planetShader.setMat4("InvTransModel", glm::transpose(glm::inverse(objects[1].transform)));
+          terrain->Draw(planetShader, bindTextures ? &earth->meshes[0] : nullptr);
+        }
+        else
+        {
+          planetShader.setInt("transformBase", draw.transformBase);
+          objects[draw.object].model->Draw(planetShader, draw.instances, bindTextures);
+        }
+        if (draw.object == 1 && virtual_earth)
+          planetShader.setBool("virtualTexture", false);
+        frameStats.objectsDrawn += draw.instances;
+      }
+      // asteroids with resident textures: one instanced draw with the bindless shaders, which take the handles from
+      // their buffer
+      if (drawnCount > drawnPlanets && distinct_asteroids && asteroid_path == ASTEROID_TEXTURES_BINDLESS)
+      {
+        Shader &bindlessShader = render_path == DEFERRED_SHADING ? bindless->GeometryShader : bindless->ForwardShader;
+        bindlessShader.use();
+        bindlessShader.setMat4("projection", projection);
+        bindlessShader.setMat4("view", view);
+        bindlessShader.setInt("transforms", TRANSFORM_BUFFER_UNIT);
+        bindlessShader.setInt("transformBase", transformBase);
+        if (render_path == FORWARD_SHADING)
+        {
+          bindlessShader.setVec3("lightPos", sun_init_pos);
+          bindlessShader.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
+          bindlessShader.setVec3("viewPos", camera.Position);
+          bindlessShader.setInt("pointLights", LIGHT_BUFFER_UNIT);
+          bindlessShader.setInt("numPointLights", (int)lights.lights.size());
+        }
+        bindless->Bind();
+        objects[3].model->Draw(bindlessShader, drawnCount - drawnPlanets, false);
+        frameStats.objectsDrawn += drawnCount - drawnPlanets;
+      }
+      // asteroids with textures of their own: a bind and a draw each, or an instanced draw per texture array (the
+      // asteroids are in the order they were packed, so those of an array are consecutive)
+      else if (drawnCount > drawnPlanets && distinct_asteroids)
+      {
+        Model *rock = objects[3].model;
+        materials.Bind(-1, planetShader, false);
+        size_t drawn = 0, runStart = 0;
+        int runArray = -1;
+        auto drawRun = [&]()
+        {
+          if (drawn == runStart)
+            return;
+          body_arrays.Bind(runArray);
+          planetShader.setInt("transformBase", transformBase + 8 * (int)runStart);
+          rock->Draw(planetShader, drawn - runStart, false);
+          runStart = drawn;
+        };
+        planetShader.setInt("texture_diffuse1", 0);
+        planetShader.setBool("textureArray", asteroid_path == ASTEROID_TEXTURES_ARRAY);
+        for (size_t i = 3; i < objectCount; i++)
+        {
+          if (!visible[i])
+            continue;
+          if (asteroid_path == ASTEROID_TEXTURES_BIND)
+          {
+            glBindTexture(GL_TEXTURE_2D, body_textures[(i - 3) % body_count].Id());
+            frameStats.textureBinds++;
+            planetShader.setInt("transformBase", transformBase + 8 * (int)drawn++);
+            rock->Draw(planetShader, 1, false);
+            continue;
+          }
+          int array = body_arrays.Layer((i - 3) % body_count).array;
+          if (array != runArray)
+          {
+            drawRun();
+            runArray = array;
+          }
+          drawn++;
+        }
+        drawRun();
+        planetShader.setBool("textureArray", false);
+        frameStats.objectsDrawn += drawnCount - drawnPlanets;
+      }
+    }
+
+    if (render_path == DEFERRED_SHADING)
+      deferred.LightingPass(view, projection, camera.Position, sun_init_pos, glm::vec3(1.0f, 1.0f, 1.0f), lights,
+                            sceneTarget ? sceneTarget->Framebuffer() : 0);
+
+    // Impostors, forward lit after the deferred lighting like the Sun. The last draw reading the transform buffer
+    impostors.Draw(*transforms, transforms->TexelOffset() + 8 * (int)transformCount, impostorCount, view, projection,
+                   camera.Position, sun_init_pos, glm::vec3(1.0f, 1.0f, 1.0f), lights);
+    transforms->Fence();
+
+    // Render light source (Sun)
+    LightingShader.use();
+    LightingShader.setMat4("projection", projection);
+    LightingShader.setMat4("view", view);
+    LightingShader.setMat4("model", objects[0].transform);
+    LightingShader.setVec4("color", glm::vec4(1.8f, 1.5f, 1.0f, 1.0f));
+    if (visible[0])
+    {
+      PROFILE_GPU_ZONE("draw sun");
+      objects[0].model->Draw(LightingShader); // Draw object
+      frameStats.objectsDrawn++;
+    }
 
-    PlanetShader.setMat4("model", model3);
-    PlanetShader.setMat4("InvTransModel", glm::transpose(glm::inverse(model3)));
-    earth.Draw(PlanetShader);
+    // Stars behind everything opaque, only where nothing was drawn
+    if (use_starfield)
+      starfield.Draw(view, projection, bench == "starfield");
+    if (sceneTarget)
+      sceneTarget->Blit(fbWidth, fbHeight);
+
+    if (benchmark)
+    {
+      if (bench == "clustered")
+      {
+        char note[128];
+        if (benchmark->Measuring())
+          bench_lights_dropped = std::max(bench_lights_dropped, clustered->DroppedLights());
+        bench_dropped_any = bench_dropped_any || bench_lights_dropped > 0;
+        snprintf(note, sizeof(note), "%u lights dropped%s", bench_lights_dropped, bench_lights_dropped ? " (FAILED)" : "");
+        benchmark->SetNote(note);
+      }
+      else if (bench == "occlusion")
+      {
+        char note[128];
+        snprintf(note, sizeof(note), "culled %5.1f%%, raster %.0f tri/ms", bench_tested ? 100.0 * bench_culled / bench_tested : 0.0,
+                 bench_raster_ms > 0.0f ? bench_raster_triangles / bench_raster_ms : 0.0f);
+        benchmark->SetNote(note);
+      }
+      else if (bench == "terrain")
+      {
+        char note[128];
+        snprintf(note, sizeof(note), "%lu patches uploaded, worst %.1f ms, up to %u drawn, level %u", bench_patches_generated,
+                 bench_generate_worst_ms, bench_patches_drawn, bench_deepest_level);
+        benchmark->SetNote(note);
+      }
+      else if (bench == "virtual-texture")
+      {
+        char note[160];
+        if (use_virtual_texture)
+          snprintf(note, sizeof(note), "%.2f MB resident, %lu tiles loaded, miss latency %.1f ms mean %.1f ms worst",
+                   earthAlbedo->ResidentBytes() / 1048576.0, earthAlbedo->TilesLoaded,
+                   earthAlbedo->TilesLoaded ? earthAlbedo->MissMilliseconds / earthAlbedo->TilesLoaded : 0.0f, earthAlbedo->WorstMissMilliseconds);
+        else
+          snprintf(note, sizeof(note), "%.2f MB", earthAlbedo->FullBytes() / 1048576.0);
+        benchmark->SetNote(note);
+      }
+      else if (bench == "pacing")
+      {
+        char note[128];
+        bench_interval_sum += deltaTime;
+        bench_interval_squares += (double)deltaTime * deltaTime;
+        bench_intervals++;
+        double mean = bench_interval_sum / bench_intervals;
+        snprintf(note, sizeof(note), "interval std dev %.2f ms, scale %.2f, GPU %.2f ms, CPU %.2f ms",
+                 std::sqrt(std::max(0.0, bench_interval_squares / bench_intervals - mean * mean)) * 1000.0, pacer.Scale(),
+                 pacer.GpuMilliseconds(), pacer.CpuMilliseconds());
+        benchmark->SetNote(note);
+      }
+      else if (bench == "impostors")
+      {
+        char note[128];
+        snprintf(note, sizeof(note), "%zu impostors, %.2f M triangles, %u draw calls", impostorCount, frameStats.triangles / 1e6,
+                 frameStats.drawCalls);
+        benchmark->SetNote(note);
+      }
+      else if (bench == "starfield" && use_starfield && starfield.TimedDraws > 0)
+      {
+        char note[128];
+        snprintf(note, sizeof(note), "starfield pass %.3f ms", starfield.Milliseconds / starfield.TimedDraws);
+        benchmark->SetNote(note);
+      }
+      else if (bench == "materials" || bench == "texture-arrays")
+      {
+        char note[128];
+        bench_texture_binds += frameStats.textureBinds;
+        bench_draw_calls += frameStats.drawCalls;
+        bench_bind_frames++;
+        snprintf(note, sizeof(note), "%.1f texture binds/frame, %.1f draw calls/frame", (double)bench_texture_binds / bench_bind_frames,
+                 (double)bench_draw_calls / bench_bind_frames);
+        benchmark->SetNote(note);
+      }
+      else if (bench == "streaming" && bench_upload_frames > 0)
+      {
+        char note[128];
+        float upload_ms = bench_upload_ms / bench_upload_frames;
+        snprintf(note, sizeof(note), "upload %.2f ms/frame, %.2f GB/s, fence waits %.2f ms", upload_ms,
+                 BENCH_STREAM_TRANSFORMS * 2 * sizeof(glm::mat4) / (upload_ms * 1e6f), transforms->WaitMilliseconds / bench_upload_frames);
+        benchmark->SetNote(note);
+      }
+      benchmark->EndFrame();
+      if (benchmark->Done())
+        glfwSetWindowShouldClose(window, true);
+    }
+
+    // --check-textures: the image of each path once its frames are rendered
+    if (check_textures && texturesFrame < (int)texture_paths.size() * CHECK_TEXTURES_FRAMES &&
+        ++texturesFrame % CHECK_TEXTURES_FRAMES == 0)
+    {
+      size_t path = texturesFrame / CHECK_TEXTURES_FRAMES - 1;
+      checkImages[path].resize((size_t)fbWidth * fbHeight * 3);
+      glPixelStorei(GL_PACK_ALIGNMENT, 1);
+      glReadPixels(0, 0, fbWidth, fbHeight, GL_RGB, GL_UNSIGNED_BYTE, checkImages[path].data());
+      glPixelStorei(GL_PACK_ALIGNMENT, 4);
+      checkAsteroids = distinct_asteroids ? drawnCount - drawnPlanets : 0;
+    }
+
+    // Performance overlay
+    if (show_hud)
+    {
+      PROFILE_ZONE("hud");
+      char status[192];
+      snprintf(status, sizeof(status), "%s SHADING  OCCLUSION %s  LIGHTS %d  ASTEROIDS %d  IMPOSTORS %d  TERRAIN %u PATCHES LEVEL %u  RES %d%%",
+               render_path_names[render_path], occlusion_mode_names[culler.mode], (int)lights.lights.size(), (int)asteroids.size(),
+               (int)impostorCount, terrain ? terrain->PatchesDrawn : 0, terrain ? terrain->DeepestLevel : 0,
+               (int)(pacer.Scale() * 100.0f + 0.5f));
+      hud.Draw(fbWidth, fbHeight, status);
+    }
+    hud.Record(deltaTime, frameStats);
+    stats.EndFrame(deltaTime);
+
+    PROFILE_FRAME();
 
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved
     // etc.)
     // -------------------------------------------------------------------------------
-    glfwSwapBuffers(window);
+    pacer.EndFrame();
+    {
+      PROFILE_ZONE("frame pacing");
+      pacer.Wait();
+    }
+    {
+      PROFILE_ZONE("swap");
+      glfwSwapBuffers(window);
+    }
     glfwPollEvents();
+
+    if (streaming)
+    {
+      if (streamingFrames == 0)
+        printf("STREAMING:: first frame %.1f ms after start, %u models loading\n",
+               std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - program_start).count(), assets.Loading());
+      streamingWorstFrame = std::max(streamingWorstFrame, static_cast<float>(glfwGetTime()) - currentFrameTime);
+      streamingFrames++;
+      if (assets.Loading() == 0)
+      {
+        printf("STREAMING:: all models ready %.1f ms after start, worst frame %.1f ms over %d frames\n",
+               std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - program_start).count(),
+               streamingWorstFrame * 1000.0f, streamingFrames);
+        fflush(stdout);
+        if (print_memory)
+        {
+          GpuResources::Instance().PrintBreakdown();
+          TextureCache::Instance().PrintStats();
+        }
+        streaming = false;
+      }
+    }
+
+    if (check_allocs)
+    {
+      unsigned long allocations = heapAllocations.count - frameAllocations;
+      if (allocsFrame >= CHECK_ALLOCS_WARMUP && allocations > 0)
+      {
+        checkedAllocations += allocations;
+        allocatingFrames++;
+      }
+      allocsFrame++;
+    }
+    // the checks end once every one asked for is done
+    if ((check_allocs || check_textures) && (!check_allocs || allocsFrame == CHECK_ALLOCS_WARMUP + CHECK_ALLOCS_FRAMES) &&
+        (!check_textures || texturesFrame == (int)texture_paths.size() * CHECK_TEXTURES_FRAMES))
+      glfwSetWindowShouldClose(window, true);
   }
 
-  glfwTerminate();
+  if (earthAlbedo && print_memory)
+    earthAlbedo->PrintStats("earth albedo");
+#ifdef PLANETS_PROFILE
+  if (!trace_path.empty())
+  {
+    if (Profiler::Instance().WriteTrace(trace_path))
+      std::cout << "PROFILER:: trace written to " << trace_path << std::endl;
+    else
+      std::cout << "PROFILER:: failed to write " << trace_path << std::endl;
+  }
+#endif
+  // exit status of the checks, 1 if any failed
+  int status = 0;
+  if (check_textures)
+  {
+    // the images with texture arrays and bindless textures against the one with a texture bound per asteroid
+    bool passed = texturesFrame == (int)texture_paths.size() * CHECK_TEXTURES_FRAMES && checkAsteroids > 0;
+    const std::vector<unsigned char> &reference = checkImages[0];
+    for (size_t path = 1; path < texture_paths.size(); path++)
+    {
+      const std::vector<unsigned char> &image = checkImages[path];
+      size_t differing = reference.size() / 3;
+      if (image.size() == reference.size())
+      {
+        differing = 0;
+        for (size_t p = 0; p < image.size(); p += 3)
+          differing += abs(image[p] - reference[p]) > CHECK_TEXTURES_TOLERANCE || abs(image[p + 1] - reference[p + 1]) > CHECK_TEXTURES_TOLERANCE ||
+                       abs(image[p + 2] - reference[p + 2]) > CHECK_TEXTURES_TOLERANCE;
+      }
+      double share = reference.empty() ? 1.0 : (double)differing / (reference.size() / 3);
+      printf("CHECK::TEXTURES:: %-8s vs bind: %zu pixels differ (%.3f%%)\n", asteroid_textures_names[texture_paths[path]], differing, share * 100.0);
+      passed = passed && share <= CHECK_TEXTURES_FAIL_SHARE;
+    }
+    printf("CHECK::TEXTURES:: %zu asteroids on %s, %zu paths%s: %s\n", checkAsteroids, (const char *)glGetString(GL_RENDERER),
+           texture_paths.size(), bindless ? " with bindless" : ", no bindless textures", passed ? "passed" : "FAILED");
+    fflush(stdout);
+    if (!passed)
+      status = 1;
+  }
+  if (check_allocs)
+  {
+    printf("CHECK::ALLOCS:: %lu heap allocations in %d of %d frames, frame arena peak %zu bytes: %s\n", checkedAllocations,
+           allocatingFrames, CHECK_ALLOCS_FRAMES, frameArena.Peak(), checkedAllocations == 0 ? "passed" : "FAILED");
+    fflush(stdout);
+    if (checkedAllocations > 0 || allocsFrame < CHECK_ALLOCS_WARMUP + CHECK_ALLOCS_FRAMES)
+      status = 1;
+  }
+  // clustered timings with lights left out compare a cheaper image with the other paths
+  if (bench_dropped_any)
+  {
+    printf("BENCHMARK:: FAILED: clustered shading dropped lights of clusters with more than %u\n", CLUSTER_MAX_LIGHTS);
+    fflush(stdout);
+    status = 1;
+  }
+  return status;
 }
 
 void processInput(GLFWwindow *window)
@@ -267,4 +1607,17 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
   {
     begin_movement = !begin_movement;
   }
+  if (key == GLFW_KEY_G && action == GLFW_PRESS)
+  {
+    int paths = clustered_supported ? 3 : 2;
+    render_path = (Render_Path)((render_path + 1) % paths);
+    std::cout << render_path_names[render_path] << " shading" << std::endl;
+  }
+  if (key == GLFW_KEY_H && action == GLFW_PRESS)
+    show_hud = !show_hud;
+  if (key == GLFW_KEY_O && action == GLFW_PRESS && occlusion_culler)
+  {
+    occlusion_culler->mode = (OcclusionCuller::Mode)((occlusion_culler->mode + 1) % 3);
+    std::cout << "occlusion culling " << occlusion_mode_names[occlusion_culler->mode] << std::endl;
+  }
 }
\ No newline at end of file
@@ -5,12 +5,19 @@ in vec2 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
 
-uniform sampler2D texture_diffuse1;
 uniform vec3 lightPos;
 uniform vec3 lightColor;
 uniform vec3 viewPos;
 
+// additional point lights, two texels each: position/radius, color
+uniform samplerBuffer pointLights;
+uniform int numPointLights;
+
+#include "surface.glsl"
+
 void main() {
+  vec2 material;
+  vec4 albedo = shadeMaterial(TexCoords, sampleAlbedo(TexCoords), material);
 
   // ambient
   float ambientStrength = 0.02;
@@ -23,14 +30,26 @@ void main() {
   vec3 diffuse = diff * lightColor;
 
   // specular
-  float specularStrength = 0.3;
+  float specularStrength = material.x;
   vec3 viewDir = normalize(viewPos - FragPos);
   vec3 reflectDir = reflect(-lightDir, norm);
-  float spec = pow(max(dot(viewDir, reflectDir), 0.0), 2);
+  float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.y);
   vec3 specular = specularStrength * spec * lightColor;
 
+  // point lights, same phong terms with a smooth falloff to zero at the light radius
+  for (int i = 0; i < numPointLights; i++) {
+    vec4 posRadius = texelFetch(pointLights, i * 2);
+    vec3 color = texelFetch(pointLights, i * 2 + 1).rgb;
+    vec3 toLight = posRadius.xyz - FragPos;
+    float attenuation = clamp(1.0 - dot(toLight, toLight) / (posRadius.w * posRadius.w), 0.0, 1.0);
+    attenuation *= attenuation;
+    vec3 dir = normalize(toLight);
+    diffuse += max(dot(norm, dir), 0.0) * attenuation * color;
+    specular += specularStrength * pow(max(dot(viewDir, reflect(-dir, norm)), 0.0), material.y) * attenuation * color;
+  }
+
   // result (phong)
   vec4 result = vec4((diffuse + ambient + specular), 1.0);
 
-  FragColor = result * texture(texture_diffuse1, TexCoords);
-}
\ No newline at end of file
+  FragColor = result * albedo;
+}
@@ -6,15 +6,31 @@ layout(location = 2) in vec2 aTexCoords;
 out vec2 TexCoords;
 out vec3 FragPos;
 out vec3 Normal;
+// layer of the texture array (see texture_array.hpp) the instance's albedo is in, or the index of its texture handle
+// (see bindless.hpp)
+flat out int Layer;
 
 uniform mat4 model;
 uniform mat4 InvTransModel;
 uniform mat4 view;
 uniform mat4 projection;
+// with transformBase >= 0, model and InvTransModel of each instance are read from the transform buffer instead: 8
+// texels per object starting at texel transformBase + 8 * gl_InstanceID. The last column of InvTransModel, which the
+// normals don't use, carries the texture layer or handle index in x
+uniform int transformBase = -1;
+uniform samplerBuffer transforms;
 
 void main() {
+  mat4 M = model;
+  mat4 N = InvTransModel;
+  if (transformBase >= 0) {
+    int texel = transformBase + 8 * gl_InstanceID;
+    M = mat4(texelFetch(transforms, texel), texelFetch(transforms, texel + 1), texelFetch(transforms, texel + 2), texelFetch(transforms, texel + 3));
+    N = mat4(texelFetch(transforms, texel + 4), texelFetch(transforms, texel + 5), texelFetch(transforms, texel + 6), texelFetch(transforms, texel + 7));
+  }
   TexCoords = aTexCoords;
-  FragPos = vec3(model * vec4(aPos, 1.0));
-  Normal = mat3(InvTransModel) * aNormal;
-  gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+  FragPos = vec3(M * vec4(aPos, 1.0));
+  Normal = mat3(N) * aNormal;
+  Layer = int(N[3].x + 0.5);
+  gl_Position = projection * view * M * vec4(aPos, 1.0);
+}
@@ -0,0 +1,61 @@
+#version 430 core
+#extension GL_ARB_bindless_texture : require
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+// index of the instance's texture handle
+flat in int Layer;
+
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+uniform vec3 viewPos;
+
+// additional point lights, two texels each: position/radius, color
+uniform samplerBuffer pointLights;
+uniform int numPointLights;
+
+// handles of the resident textures, see bindless.hpp. The index varies between the instances of a draw, which the
+// extension allows without the handle being dynamically uniform
+layout(std430, binding = 3) readonly buffer TextureHandles { uvec2 textureHandles[]; };
+
+void main() {
+  vec4 albedo = texture(sampler2D(textureHandles[Layer]), TexCoords);
+  // the asteroids have no material, the default one's specular strength and exponent
+  vec2 material = vec2(0.3, 2.0);
+
+  // ambient
+  float ambientStrength = 0.02;
+  vec3 ambient = ambientStrength * lightColor;
+
+  // diffuse
+  vec3 norm = normalize(Normal);
+  vec3 lightDir = normalize(lightPos - FragPos);
+  float diff = max(dot(norm, lightDir), 0.0);
+  vec3 diffuse = diff * lightColor;
+
+  // specular
+  float specularStrength = material.x;
+  vec3 viewDir = normalize(viewPos - FragPos);
+  vec3 reflectDir = reflect(-lightDir, norm);
+  float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.y);
+  vec3 specular = specularStrength * spec * lightColor;
+
+  // point lights, same phong terms with a smooth falloff to zero at the light radius
+  for (int i = 0; i < numPointLights; i++) {
+    vec4 posRadius = texelFetch(pointLights, i * 2);
+    vec3 color = texelFetch(pointLights, i * 2 + 1).rgb;
+    vec3 toLight = posRadius.xyz - FragPos;
+    float attenuation = clamp(1.0 - dot(toLight, toLight) / (posRadius.w * posRadius.w), 0.0, 1.0);
+    attenuation *= attenuation;
+    vec3 dir = normalize(toLight);
+    diffuse += max(dot(norm, dir), 0.0) * attenuation * color;
+    specular += specularStrength * pow(max(dot(viewDir, reflect(-dir, norm)), 0.0), material.y) * attenuation * color;
+  }
+
+  // result (phong)
+  vec4 result = vec4((diffuse + ambient + specular), 1.0);
+
+  FragColor = result * albedo;
+}
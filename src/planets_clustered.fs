@@ -0,0 +1,73 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+
+uniform vec3 lightPos;
+uniform vec3 lightColor;
+uniform vec3 viewPos;
+uniform mat4 view;
+
+// light lists written by cluster_cull.cs
+struct PointLight {
+  vec4 positionRadius;
+  vec4 color;
+};
+layout(std430, binding = 0) readonly buffer Lights { PointLight pointLights[]; };
+layout(std430, binding = 1) readonly buffer ClusterGrid { uvec2 clusters[]; };
+layout(std430, binding = 2) readonly buffer ClusterIndices {
+  uint indexCount;
+  uint droppedLights;
+  uint lightIndices[];
+};
+
+uniform uvec3 gridSize;
+uniform vec2 screenSize;
+uniform float zNear;
+uniform float zFar;
+
+#include "surface.glsl"
+
+void main() {
+  vec2 material;
+  vec4 albedo = shadeMaterial(TexCoords, sampleAlbedo(TexCoords), material);
+
+  // ambient
+  float ambientStrength = 0.02;
+  vec3 ambient = ambientStrength * lightColor;
+
+  // diffuse
+  vec3 norm = normalize(Normal);
+  vec3 lightDir = normalize(lightPos - FragPos);
+  float diff = max(dot(norm, lightDir), 0.0);
+  vec3 diffuse = diff * lightColor;
+
+  // specular
+  float specularStrength = material.x;
+  vec3 viewDir = normalize(viewPos - FragPos);
+  vec3 reflectDir = reflect(-lightDir, norm);
+  float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.y);
+  vec3 specular = specularStrength * spec * lightColor;
+
+  // point lights of this fragment's cluster only
+  float viewZ = -(view * vec4(FragPos, 1.0)).z;
+  uint slice = uint(clamp(log(viewZ / zNear) / log(zFar / zNear) * float(gridSize.z), 0.0, float(gridSize.z - 1u)));
+  uvec2 tile = min(uvec2(gl_FragCoord.xy / screenSize * vec2(gridSize.xy)), gridSize.xy - 1u);
+  uvec2 range = clusters[tile.x + tile.y * gridSize.x + slice * gridSize.x * gridSize.y];
+  for (uint i = 0u; i < range.y; i++) {
+    PointLight light = pointLights[lightIndices[range.x + i]];
+    vec3 toLight = light.positionRadius.xyz - FragPos;
+    float attenuation = clamp(1.0 - dot(toLight, toLight) / (light.positionRadius.w * light.positionRadius.w), 0.0, 1.0);
+    attenuation *= attenuation;
+    vec3 dir = normalize(toLight);
+    diffuse += max(dot(norm, dir), 0.0) * attenuation * light.color.rgb;
+    specular += specularStrength * pow(max(dot(viewDir, reflect(-dir, norm)), 0.0), material.y) * attenuation * light.color.rgb;
+  }
+
+  // result (phong)
+  vec4 result = vec4((diffuse + ambient + specular), 1.0);
+
+  FragColor = result * albedo;
+}
@@ -0,0 +1,56 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec4 ViewRay;
+
+uniform float cells; // grid cells per cube face side, see starfield.hpp
+
+// three pseudo-random values in [0, 1) for a grid cell
+vec3 hash3(vec3 p) {
+  p = fract(p * vec3(0.1031, 0.1030, 0.0973));
+  p += dot(p, p.yxz + 33.33);
+  return fract((p.xxy + p.yxx) * p.zyx);
+}
+
+void main() {
+  vec3 dir = normalize(ViewRay.xyz / ViewRay.w);
+
+  // the cube face the direction points at and the position on it, in cells
+  vec3 a = abs(dir);
+  vec2 face;
+  float faceIndex;
+  if (a.x >= a.y && a.x >= a.z) {
+    face = dir.yz / a.x;
+    faceIndex = dir.x > 0.0 ? 0.0 : 1.0;
+  } else if (a.y >= a.z) {
+    face = dir.zx / a.y;
+    faceIndex = dir.y > 0.0 ? 2.0 : 3.0;
+  } else {
+    face = dir.xy / a.z;
+    faceIndex = dir.z > 0.0 ? 4.0 : 5.0;
+  }
+  vec2 p = (face * 0.5 + 0.5) * cells;
+  vec2 cell = floor(p);
+
+  // a star in one cell of ten, away from the cell's edges so that it's never cut, about a pixel wide whatever the
+  // resolution (fwidth jumps across cube edges, where no star is)
+  vec3 h = hash3(vec3(cell, faceIndex));
+  vec3 color = vec3(0.01);
+  if (h.z < 0.1) {
+    vec2 center = cell + 0.25 + 0.5 * h.xy;
+    float pixel = max(length(fwidth(p)), 1e-4);
+    float brightness = pow(h.z * 10.0, 4.0);
+    float falloff = max(1.0 - length(p - center) / pixel, 0.0);
+    // from red dwarfs to blue giants
+    vec3 tint = mix(vec3(1.0, 0.75, 0.55), vec3(0.7, 0.8, 1.0), h.x);
+    color += tint * brightness * falloff * falloff;
+  }
+
+  // the galaxy's band, tilted against the orbits and brighter towards its center
+  vec3 galacticPole = normalize(vec3(0.3, 1.0, 0.2));
+  float band = exp(-pow(dot(dir, galacticPole) / 0.15, 2.0));
+  float core = 0.5 + 0.5 * max(dot(dir, normalize(vec3(1.0, -0.3, -0.4))), 0.0);
+  color += vec3(0.025, 0.022, 0.03) * band * core * (0.7 + 0.3 * hash3(vec3(floor(p / 4.0), faceIndex + 6.0)).x);
+
+  FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 ViewRay;
+
+uniform mat4 invViewProjection; // of the view's rotation only
+
+// the fullscreen triangle of fullscreen.vs, at the far plane so that the depth test keeps it behind everything drawn
+void main() {
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+  gl_Position = vec4(p, 1.0, 1.0);
+  // homogeneous, interpolated as is and divided per fragment
+  ViewRay = invViewProjection * gl_Position;
+}
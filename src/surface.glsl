@@ -0,0 +1,67 @@
+// Surface of the bodies drawn with planets.vs, shared by the fragment shaders of every shading path (planets.fs,
+// planets_clustered.fs and gbuffer.fs), which #include it, see Shader::expandIncludes()
+
+// virtual texture, see virtual_texture.hpp: tiles of the mip chain resident in vtCache, found through vtIndirection
+// which has a texel per tile of every level with the cache slot and level of the finest resident tile covering it
+uniform bool virtualTexture = false;
+uniform sampler2D vtCache;
+uniform sampler2D vtIndirection;
+uniform vec2 vtSize;        // level 0, in texels
+uniform int vtLevels;
+uniform vec3 vtCacheLayout; // padded tile, border and tile sizes in cache texture coordinates
+
+vec4 sampleVirtual(vec2 uv) {
+  // the level vt_feedback.fs asks for
+  vec2 dx = dFdx(uv), dy = dFdy(uv);
+  float lod = max(log2(max(max(abs(dx.x), abs(dy.x)) * vtSize.x, 1e-9)), log2(max(max(abs(dx.y), abs(dy.y)) * vtSize.y, 1e-9)));
+  int level = int(clamp(floor(lod), 0.0, float(vtLevels - 1)));
+  vec2 wrapped = vec2(fract(uv.x), clamp(uv.y, 0.0, 0.99999));
+  vec4 entry = texelFetch(vtIndirection, ivec2(wrapped * vec2(textureSize(vtIndirection, level))), level) * 255.0;
+  int resident = int(entry.b + 0.5);
+  vec2 inTile = fract(wrapped * vec2(textureSize(vtIndirection, resident)));
+  return textureLod(vtCache, floor(entry.rg + 0.5) * vtCacheLayout.x + vtCacheLayout.y + inTile * vtCacheLayout.z, 0.0);
+}
+
+// albedo: the virtual texture, or with textureArray (see texture_array.hpp) the instance's layer of texture_array, or
+// the mesh's diffuse texture
+uniform sampler2D texture_diffuse1;
+uniform bool textureArray = false;
+uniform sampler2DArray texture_array;
+flat in int Layer;
+
+vec4 sampleAlbedo(vec2 uv) {
+  if (virtualTexture)
+    return sampleVirtual(uv);
+  if (textureArray)
+    return texture(texture_array, vec3(uv, float(Layer)));
+  return texture(texture_diffuse1, uv);
+}
+
+// materials, see material.hpp: parameters of every material in one block of MAX_MATERIALS (defined by the loader, see
+// Shader::Defines), the draw's picked by materialIndex (-1 when it has none), and its textures
+struct Material {
+  vec4 specular; // strength and exponent over water (white in the specular mask), then over land
+  vec4 clouds;   // opacity, rotation in radians per second
+  ivec4 layers;  // has a specular mask, has clouds
+};
+layout(std140) uniform Materials { Material materials[MAX_MATERIALS]; };
+uniform int materialIndex = -1;
+uniform sampler2D texture_specular1;
+uniform sampler2D texture_clouds;
+uniform float time;
+
+// albedo under the material's cloud layer, and the specular strength and exponent there
+vec4 shadeMaterial(vec2 uv, vec4 albedo, out vec2 specular) {
+  specular = vec2(0.3, 2.0);
+  if (materialIndex < 0)
+    return albedo;
+  Material material = materials[materialIndex];
+  float water = material.layers.x != 0 ? texture(texture_specular1, uv).r : 0.0;
+  specular = mix(material.specular.zw, material.specular.xy, water);
+  if (material.layers.y != 0) {
+    float cover = texture(texture_clouds, uv + vec2(fract(time * material.clouds.y / 6.2831853), 0.0)).r * material.clouds.x;
+    albedo.rgb = mix(albedo.rgb, vec3(1.0), cover);
+    specular.x *= 1.0 - cover;
+  }
+  return albedo;
+}
@@ -0,0 +1,12 @@
+#version 330 core
+// virtual texture feedback, see virtual_texture.hpp: the texture coordinates of each pixel (u wrapped into [0, 1])
+// and the log2 of their footprint along u and v, stored from [-32, 0] so that zero is left for pixels not drawn
+layout(location = 0) out vec4 Feedback;
+
+in vec2 TexCoords;
+
+void main() {
+  vec2 dx = dFdx(TexCoords), dy = dFdy(TexCoords);
+  vec2 footprint = log2(max(max(abs(dx), abs(dy)), vec2(1e-9)));
+  Feedback = vec4(fract(TexCoords.x), clamp(TexCoords.y, 0.0, 1.0), clamp((footprint + 32.0) / 32.0, 1.0 / 65535.0, 1.0));
+}